@@ -0,0 +1,347 @@
+// Benchmarks compile time, execution throughput, and memory use over a few families of patterns.
+// Every result is printed as one JSON object per line so runs can be stored and compared, e.g.
+//   cc -O2 -Iinclude bench/bench.c src/*.c -o c_nfa_bench -lpthread && ./c_nfa_bench > bench_output.txt
+// Pass --quick to only run the smallest input size
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <c_nfa/core.h>
+#include <c_nfa/nfa.h>
+#include <c_nfa/regex.h>
+#include <c_nfa/frozen.h>
+#include <c_nfa/lazy_dfa.h>
+#include <c_nfa/dfa.h>
+#include <c_nfa/glushkov.h>
+
+// builds the Thompson NFA of a parsed regex, defined in bridge.c
+nfa_machine* handle_regex(const regex_t* regex);
+
+// On glibc every allocation goes through the wrappers below so allocations and live bytes can be counted,
+// elsewhere the allocation columns are reported as -1
+#if defined(__GLIBC__)
+#define BENCH_COUNT_ALLOCATIONS
+#include <malloc.h>
+
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* pointer, size_t size);
+void __libc_free(void* pointer);
+
+static size_t bench_allocations;
+static size_t bench_live_bytes;
+static size_t bench_peak_bytes;
+
+static void bench_track(void* pointer)
+{
+	if (pointer != NULL)
+	{
+		++bench_allocations;
+		bench_live_bytes += malloc_usable_size(pointer);
+		if (bench_live_bytes > bench_peak_bytes)
+		{
+			bench_peak_bytes = bench_live_bytes;
+		}
+	}
+}
+
+void* malloc(size_t size)
+{
+	void* pointer = __libc_malloc(size);
+	bench_track(pointer);
+	return pointer;
+}
+
+void* calloc(size_t count, size_t size)
+{
+	void* pointer = __libc_calloc(count, size);
+	bench_track(pointer);
+	return pointer;
+}
+
+void* realloc(void* pointer, size_t size)
+{
+	size_t old_size = pointer != NULL ? malloc_usable_size(pointer) : 0;
+	void* result = __libc_realloc(pointer, size);
+	if (result != NULL || size == 0)
+	{
+		bench_live_bytes -= old_size;
+		bench_track(result);
+	}
+	return result;
+}
+
+void free(void* pointer)
+{
+	if (pointer != NULL)
+	{
+		bench_live_bytes -= malloc_usable_size(pointer);
+	}
+	__libc_free(pointer);
+}
+#endif
+
+typedef struct
+{
+	long long allocations;
+	long long live_bytes;
+	long long peak_bytes;
+} bench_memory;
+
+static bench_memory bench_memory_begin(void)
+{
+	bench_memory memory = { -1, -1, -1 };
+#ifdef BENCH_COUNT_ALLOCATIONS
+	bench_peak_bytes = bench_live_bytes;
+	memory.allocations = (long long)bench_allocations;
+	memory.live_bytes = (long long)bench_live_bytes;
+	memory.peak_bytes = (long long)bench_peak_bytes;
+#endif
+	return memory;
+}
+
+// Returns what was allocated since begin, peak_bytes is the most memory held at once above what was live at begin
+static bench_memory bench_memory_end(bench_memory begin)
+{
+	bench_memory memory = { -1, -1, -1 };
+#ifdef BENCH_COUNT_ALLOCATIONS
+	memory.allocations = (long long)bench_allocations - begin.allocations;
+	memory.live_bytes = (long long)bench_live_bytes - begin.live_bytes;
+	memory.peak_bytes = (long long)bench_peak_bytes - begin.live_bytes;
+#else
+	(void)begin;
+#endif
+	return memory;
+}
+
+static double bench_now(void)
+{
+	struct timespec now;
+	timespec_get(&now, TIME_UTC);
+	return (double)now.tv_sec + (double)now.tv_nsec * 1e-9;
+}
+
+typedef struct
+{
+	const char* name;
+	const char* pattern;
+	const char* alphabet; // input is filler drawn from alphabet with suffix appended
+	const char* suffix;
+} bench_workload;
+
+static const bench_workload bench_workloads[] = {
+	{ "literal", "(a|b|c|d)*hello(a|b|c|d)*", "abcd", "hello" },
+	{ "alternation", "(foo|bar|baz|qux|quux|corge|grault|garply|waldo|fred|plugh|xyzzy|thud)*", NULL, "" },
+	{ "star", "(a*b*c*)*d", "abc", "d" },
+	{ "pathological", "(a*)*b", "a", "" },
+};
+
+static const char* bench_words[] = { "foo", "bar", "baz", "qux", "quux", "corge", "grault", "garply", "waldo", "fred", "plugh", "xyzzy", "thud" };
+
+static uint8_t* bench_input(const bench_workload* workload, size_t len)
+{
+	uint8_t* input = malloc(len);
+	uint32_t seed = 12345;
+	size_t suffix_len = strlen(workload->suffix);
+	size_t filler_len = len - suffix_len;
+
+	if (workload->alphabet == NULL)
+	{
+		// whole words, with the last one cut short if it doesn't fit
+		size_t index = 0;
+		while (index < len)
+		{
+			seed = seed * 1103515245 + 12345;
+			const char* word = bench_words[(seed >> 16) % (sizeof(bench_words) / sizeof(bench_words[0]))];
+			for (size_t offset = 0; word[offset] != '\0' && index < len; ++offset)
+			{
+				input[index++] = (uint8_t)word[offset];
+			}
+		}
+		return input;
+	}
+
+	size_t alphabet_len = strlen(workload->alphabet);
+	for (size_t index = 0; index < filler_len; ++index)
+	{
+		seed = seed * 1103515245 + 12345;
+		input[index] = (uint8_t)workload->alphabet[(seed >> 16) % alphabet_len];
+	}
+	memcpy(input + filler_len, workload->suffix, suffix_len);
+	return input;
+}
+
+typedef enum
+{
+	BENCH_ENGINE_NFA,
+	BENCH_ENGINE_FROZEN,
+	BENCH_ENGINE_LAZY_DFA,
+	BENCH_ENGINE_DFA,
+	BENCH_ENGINE_GLUSHKOV,
+	BENCH_ENGINES_LEN
+} bench_engine;
+
+static const char* bench_engine_names[] = { "nfa_machine_execute", "frozen", "lazy_dfa", "dfa", "glushkov" };
+
+typedef struct
+{
+	nfa_machine* machine;
+	nfa_frozen_machine* frozen;
+	nfa_exec_scratch* scratch;
+	nfa_lazy_dfa* lazy_dfa;
+	dfa_machine* dfa;
+	nfa_glushkov_machine* glushkov;
+} bench_compiled;
+
+static int bench_execute(const bench_compiled* compiled, bench_engine engine, const uint8_t* input, size_t len)
+{
+	switch (engine)
+	{
+	case BENCH_ENGINE_NFA:
+		return nfa_machine_execute_n(compiled->machine, input, len);
+	case BENCH_ENGINE_FROZEN:
+		return nfa_frozen_machine_execute_n(compiled->frozen, input, len, compiled->scratch);
+	case BENCH_ENGINE_LAZY_DFA:
+		return nfa_lazy_dfa_execute_n(compiled->lazy_dfa, input, len);
+	case BENCH_ENGINE_DFA:
+		return dfa_machine_execute_n(compiled->dfa, input, len);
+	case BENCH_ENGINE_GLUSHKOV:
+		return nfa_glushkov_machine_execute_n(compiled->glushkov, input, len);
+	default:
+		return 0;
+	}
+}
+
+static void bench_compile(const bench_workload* workload, bench_compiled* compiled, double min_seconds)
+{
+	// latency is averaged over as many rounds as fit in min_seconds
+	size_t rounds = 0;
+	double parse_seconds = 0;
+	double build_seconds = 0;
+	do
+	{
+		double start = bench_now();
+		regex_t* regex = regex_parse(workload->pattern);
+		double parsed = bench_now();
+		nfa_machine* machine = handle_regex(regex);
+		double built = bench_now();
+		nfa_machine_free(machine);
+		regex_free(regex);
+
+		parse_seconds += parsed - start;
+		build_seconds += built - parsed;
+		++rounds;
+	} while (parse_seconds + build_seconds < min_seconds);
+
+	// memory held by each compiled form
+	bench_memory begin = bench_memory_begin();
+	regex_t* regex = regex_parse(workload->pattern);
+	compiled->machine = handle_regex(regex);
+	bench_memory nfa_memory = bench_memory_end(begin);
+
+	begin = bench_memory_begin();
+	compiled->frozen = nfa_machine_freeze(compiled->machine);
+	bench_memory frozen_memory = bench_memory_end(begin);
+
+	begin = bench_memory_begin();
+	dfa_machine* dfa = nfa_to_dfa(compiled->machine, 100000);
+	compiled->dfa = dfa != NULL ? dfa_minimize(dfa) : NULL;
+	if (dfa != NULL)
+	{
+		dfa_machine_free(dfa);
+	}
+	bench_memory dfa_memory = bench_memory_end(begin);
+
+	begin = bench_memory_begin();
+	compiled->glushkov = regex_to_glushkov(regex);
+	bench_memory glushkov_memory = bench_memory_end(begin);
+	regex_free(regex);
+
+	compiled->scratch = nfa_exec_scratch_alloc();
+	nfa_exec_scratch_reserve(compiled->scratch, compiled->frozen);
+	compiled->lazy_dfa = nfa_lazy_dfa_alloc(compiled->frozen, C_NFA_LAZY_DFA_DEFAULT_BUDGET);
+
+	printf("{\"bench\":\"compile\",\"workload\":\"%s\",\"rounds\":%zu,\"parse_ns\":%.0f,\"handle_regex_ns\":%.0f,"
+		"\"nfa_states\":%zu,\"nfa_transitions\":%zu,"
+		"\"nfa_bytes\":%lld,\"nfa_peak_bytes\":%lld,\"frozen_bytes\":%lld,\"dfa_states\":%u,\"dfa_bytes\":%lld,\"dfa_peak_bytes\":%lld,\"glushkov_bytes\":%lld}\n",
+		workload->name, rounds, parse_seconds / (double)rounds * 1e9, build_seconds / (double)rounds * 1e9,
+		get_machine_max_state_index(compiled->machine) + 1, compiled->machine->transitions_len,
+		nfa_memory.live_bytes, nfa_memory.peak_bytes, frozen_memory.live_bytes, compiled->dfa != NULL ? compiled->dfa->states_len : 0,
+		dfa_memory.live_bytes, dfa_memory.peak_bytes, compiled->glushkov != NULL ? glushkov_memory.live_bytes : -1);
+}
+
+static void bench_compiled_free(bench_compiled* compiled)
+{
+	nfa_lazy_dfa_free(compiled->lazy_dfa);
+	nfa_exec_scratch_free(compiled->scratch);
+	if (compiled->glushkov != NULL)
+	{
+		nfa_glushkov_machine_free(compiled->glushkov);
+	}
+	if (compiled->dfa != NULL)
+	{
+		dfa_machine_free(compiled->dfa);
+	}
+	nfa_frozen_machine_free(compiled->frozen);
+	nfa_machine_free(compiled->machine);
+}
+
+static void bench_throughput(const bench_workload* workload, const bench_compiled* compiled, size_t len, double min_seconds)
+{
+	uint8_t* input = bench_input(workload, len);
+
+	for (int engine = 0; engine < BENCH_ENGINES_LEN; ++engine)
+	{
+		if ((engine == BENCH_ENGINE_DFA && compiled->dfa == NULL) || (engine == BENCH_ENGINE_GLUSHKOV && compiled->glushkov == NULL))
+		{
+			continue;
+		}
+
+		// one untimed run so caches and the lazy DFA are warm
+		int result = bench_execute(compiled, engine, input, len);
+
+		size_t executions = 0;
+		bench_memory begin = bench_memory_begin();
+		double start = bench_now();
+		double seconds;
+		do
+		{
+			bench_execute(compiled, engine, input, len);
+			++executions;
+			seconds = bench_now() - start;
+		} while (seconds < min_seconds);
+		bench_memory memory = bench_memory_end(begin);
+
+		printf("{\"bench\":\"execute\",\"workload\":\"%s\",\"engine\":\"%s\",\"input_len\":%zu,\"result\":%d,\"executions\":%zu,"
+			"\"mb_per_s\":%.2f,\"matches_per_s\":%.1f,\"allocations_per_match\":%.2f}\n",
+			workload->name, bench_engine_names[engine], len, result, executions,
+			(double)len * (double)executions / seconds / 1e6, (double)executions / seconds,
+			memory.allocations < 0 ? -1.0 : (double)memory.allocations / (double)executions);
+	}
+
+	free(input);
+}
+
+int main(int argc, char** argv)
+{
+	int quick = argc > 1 && strcmp(argv[1], "--quick") == 0;
+	double min_seconds = quick ? 0.02 : 0.2;
+	size_t input_lens[] = { 1 << 10, 1 << 16, 1 << 20 };
+	size_t input_lens_len = quick ? 1 : sizeof(input_lens) / sizeof(input_lens[0]);
+
+	for (size_t workload_index = 0; workload_index < sizeof(bench_workloads) / sizeof(bench_workloads[0]); ++workload_index)
+	{
+		const bench_workload* workload = &bench_workloads[workload_index];
+		bench_compiled compiled;
+		bench_compile(workload, &compiled, min_seconds);
+		for (size_t len_index = 0; len_index < input_lens_len; ++len_index)
+		{
+			bench_throughput(workload, &compiled, input_lens[len_index], min_seconds);
+		}
+		bench_compiled_free(&compiled);
+	}
+
+	return 0;
+}
@@ -0,0 +1,28 @@
+#ifndef C_NFA_BATCH_H
+#define C_NFA_BATCH_H
+
+#include <c_nfa/frozen.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct
+{
+	size_t threads_len; // number of workers, 0 uses one per online processor
+	size_t chunk_len; // inputs a worker takes at a time, rounded up to a multiple of 64, 0 picks a default
+} nfa_batch_options;
+
+// Run inputs_len inputs through the machine, input i is lengths[i] bytes starting at inputs[i]. Bit i % 64 of
+// results[i / 64] is set if input i passes and cleared otherwise, so results needs (inputs_len + 63) / 64 words.
+// The inputs are split into chunks that workers steal from each other once they run out, every worker has its
+// own scratch and writes whole result words, so workers share nothing mutable but the chunk queues. The calling
+// thread is one of the workers and the others run on a pool of threads that the first batch to need them starts
+// and later batches reuse. A batch that starts while another is using the pool runs on its calling thread.
+// Returns the number of inputs that passed, options can be NULL
+size_t nfa_frozen_machine_execute_batch(const nfa_frozen_machine* machine, const uint8_t* const* inputs, const size_t* lengths, size_t inputs_len, uint64_t* results, const nfa_batch_options* options);
+
+// Same as nfa_frozen_machine_execute_batch, the machine is compiled once for the whole batch. No input passes
+// if the machine can't be compiled, see nfa_machine_freeze
+size_t nfa_machine_execute_batch(const nfa_machine* machine, const uint8_t* const* inputs, const size_t* lengths, size_t inputs_len, uint64_t* results, const nfa_batch_options* options);
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef C_NFA_CACHE_H
+#define C_NFA_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Number of compiled patterns regex_execute keeps by default
+#ifndef C_NFA_REGEX_CACHE_DEFAULT_CAPACITY
+#define C_NFA_REGEX_CACHE_DEFAULT_CAPACITY 256
+#endif
+
+// The cache is split into this many stripes, each with its own lock and LRU list, so threads
+// executing different patterns rarely wait on each other
+#define C_NFA_REGEX_CACHE_STRIPES 16
+
+typedef struct
+{
+	size_t hits;
+	size_t misses;
+	size_t evictions;
+	size_t entries_len;
+	size_t capacity;
+} regex_cache_stats;
+
+// A compiled pattern held by the cache
+typedef struct regex_cache_entry regex_cache_entry;
+
+// Returns the compiled form of regex, compiling and caching it on a miss, or NULL if the capacity is 0.
+// The entry stays valid until it is released, even if it is evicted in the meantime
+regex_cache_entry* regex_cache_acquire(const char* regex);
+
+void regex_cache_release(regex_cache_entry* entry);
+
+// Run len bytes of data through a cached pattern, returns 0 if the pattern isn't a valid regex. The buffers
+// for running it are kept per thread, so once they have grown to fit the pattern nothing is allocated
+int regex_cache_entry_execute_n(const regex_cache_entry* entry, const uint8_t* data, size_t len);
+
+// Sets how many compiled patterns are kept, split evenly across the stripes, and evicts the least
+// recently used ones that no longer fit. 0 turns caching off
+void regex_cache_set_capacity(size_t capacity);
+
+// Counters summed over every stripe since the start of the program or the last regex_cache_clear
+void regex_cache_get_stats(regex_cache_stats* stats);
+
+// Evicts every pattern and resets the counters
+void regex_cache_clear(void);
+
+#endif
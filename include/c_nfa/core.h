@@ -1,11 +1,20 @@
 #ifndef C_NFA_CORE_H
 #define C_NFA_CORE_H
 
+#include <stddef.h>
+#include <stdint.h>
+
 // forward declare;
 struct nfa_machine;
 
+// Returns NULL if input isn't a valid regex, see regex_try_parse for the reason
 struct nfa_machine* regex_to_nfa(const char* input);
 
+// Returns 1 if input is in the language of regex, 0 if it isn't or if regex isn't valid. Compiled patterns
+// are kept in a cache shared by every thread, see cache.h
 int regex_execute(const char* regex, const char* input);
 
+// Same as regex_execute for len bytes of data, which can contain any byte including '\0'
+int regex_execute_n(const char* regex, const uint8_t* data, size_t len);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,44 @@
+#ifndef C_NFA_CURSOR_H
+#define C_NFA_CURSOR_H
+
+#include <c_nfa/frozen.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+// How often, in bytes, a cursor looks at its cancel flag
+#define C_NFA_CURSOR_CANCEL_INTERVAL 4096
+
+typedef enum
+{
+	NFA_REJECTED = 0,
+	NFA_ACCEPTED = 1,
+	NFA_IN_PROGRESS, // the budget ran out, resume the cursor to continue
+	NFA_CANCELLED // the cancel flag was set, resuming returns NFA_CANCELLED again
+} nfa_exec_status;
+
+// Limits on the work done by one call to nfa_cursor_resume, 0 means no limit
+typedef struct
+{
+	size_t max_steps; // (active state, byte) pairs stepped
+	size_t max_bytes;
+} nfa_exec_budget;
+
+// Execution of a compiled machine over an input that can be paused and resumed, so many executions can be
+// interleaved on one thread with a bound on how long each slice takes
+typedef struct nfa_cursor nfa_cursor;
+
+// Start executing len bytes of data, neither the machine nor the data are copied so both must outlive the cursor.
+// cancel can be NULL, otherwise the execution stops soon after *cancel becomes non-zero, e.g. from another thread
+nfa_cursor* nfa_cursor_begin(const nfa_frozen_machine* machine, const uint8_t* data, size_t len, const volatile int* cancel);
+
+// Continue the execution for at most budget, NULL for no limit. Every call consumes at least one byte even if
+// that goes over max_steps. Returns NFA_ACCEPTED or NFA_REJECTED once the result is known
+nfa_exec_status nfa_cursor_resume(nfa_cursor* cursor, const nfa_exec_budget* budget);
+
+// Number of bytes of the input consumed so far
+size_t nfa_cursor_position(const nfa_cursor* cursor);
+
+void nfa_cursor_free(nfa_cursor* cursor);
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef C_NFA_DFA_H
+#define C_NFA_DFA_H
+
+#include <c_nfa/nfa.h>
+
+#include <stdint.h>
+
+#define DFA_NO_DEAD_STATE UINT32_MAX
+
+// Deterministic machine with a dense transition table, every state has exactly one transition per byte
+// class, bytes in the same class always go to the same state
+typedef struct
+{
+	uint32_t states_len;
+	uint32_t start_state_index;
+	uint32_t dead_state_index; // state that can never reach a final state, DFA_NO_DEAD_STATE if there is none
+	uint32_t classes_len;
+	uint8_t byte_classes[256];
+	uint32_t* transitions; // transitions[state * classes_len + byte_classes[byte]]
+	unsigned char* final_states; // final_states[state] is 1 if state is a final state
+	uint32_t borrowed; // 1 if the tables point into a loaded image rather than being owned by the machine
+} dfa_machine;
+
+// Returns a DFA accepting the same language as the NFA via subset construction,
+// or NULL if the DFA would need more than max_states states or the NFA can't be frozen, see nfa_machine_freeze
+dfa_machine* nfa_to_dfa(const nfa_machine* machine, size_t max_states);
+
+// Returns the minimal DFA accepting the same language as the given DFA, via Hopcroft's algorithm
+dfa_machine* dfa_minimize(const dfa_machine* machine);
+
+// Dealloc a DFA machine
+void dfa_machine_free(dfa_machine* machine);
+
+// Run some input through the DFA, return 1 if passes, 0 otherwise
+int dfa_machine_execute(const dfa_machine* machine, const char* string);
+
+// Run len bytes of data through the DFA, data can contain any byte including '\0'
+int dfa_machine_execute_n(const dfa_machine* machine, const uint8_t* data, size_t len);
+
+#endif
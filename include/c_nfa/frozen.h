@@ -0,0 +1,124 @@
+#ifndef C_NFA_FROZEN_H
+#define C_NFA_FROZEN_H
+
+#include <c_nfa/nfa.h>
+
+#include <stdint.h>
+
+// Upper bound on the total number of entries in a precomputed e-closure table
+#ifndef C_NFA_CLOSURE_TABLE_MAX
+#define C_NFA_CLOSURE_TABLE_MAX (1 << 24)
+#endif
+
+// Most states a machine can have once counter bodies are expanded, nfa_machine_freeze refuses machines
+// with more since execution keeps several words per state
+#ifndef C_NFA_FROZEN_STATES_MAX
+#define C_NFA_FROZEN_STATES_MAX (1 << 24)
+#endif
+
+typedef struct
+{
+	uint32_t to_state_index;
+	unsigned char rule;
+	unsigned char rule_last; // the edge matches every byte in [rule, rule_last]
+} nfa_frozen_edge;
+
+#define C_NFA_NO_COUNTER UINT32_MAX
+
+// Compiled nfa_counter, see nfa_frozen_machine
+typedef struct
+{
+	uint32_t first_state_index;
+	uint32_t states_len;
+	uint32_t last_state_index;
+	uint32_t exit_state_index;
+	uint32_t min;
+	uint32_t passes; // passes told apart, max or, for an unbounded counter, min since passes past it behave the same
+	uint32_t unbounded;
+	uint32_t parent; // index of the counter whose body holds this one, C_NFA_NO_COUNTER if there is none
+} nfa_frozen_counter;
+
+// Immutable compiled form of an nfa_machine, transitions are grouped by from_state_index in
+// compressed-sparse-row order so the outgoing edges of graph state s are [offsets[s], offsets[s + 1]).
+// Graph states are the states of the nfa_machine. A graph state inside the bodies of counters is one
+// state per combination of passes through those bodies, numbered from pass_offsets[s] with the pass
+// through the innermost body changing fastest, so the body of x{m,n} is stored once but executed as if
+// it was copied. Every other graph state is a single state, so without counters states are graph states
+typedef struct
+{
+	uint32_t states_len;
+	uint32_t start_state_index;
+
+	uint32_t graph_states_len;
+	uint32_t* epsilon_offsets; // graph_states_len + 1 entries
+	uint32_t* epsilon_targets; // graph states
+
+	uint32_t* byte_offsets; // graph_states_len + 1 entries
+	nfa_frozen_edge* byte_edges; // to_state_index is a graph state
+
+	uint64_t* final_bitmap; // bit s is set if graph state s is a final state
+
+	nfa_frozen_counter* counters; // sorted by first_state_index, a body comes before the bodies it holds
+	uint32_t counters_len;
+	uint32_t* pass_offsets; // graph_states_len + 1 entries, NULL if there are no counters
+	uint32_t* graph_state_counters; // innermost counter whose body holds each graph state, NULL if there are no counters
+
+	// bytes no transition tells apart share a class, so tables built from the machine can have a column
+	// per class instead of per byte
+	uint8_t byte_classes[256];
+	uint32_t classes_len;
+
+	// e-closure of every state, only keeping states that are final or have character transitions
+	// since those are the only ones that affect a match, NULL if the table would exceed C_NFA_CLOSURE_TABLE_MAX
+	// or the machine has counters, whose closures depend on the pass
+	uint32_t* closure_offsets; // states_len + 1 entries
+	uint32_t* closure_states;
+
+	// literal that every match contains, search skips input until it appears. prefilter_len is 0 if
+	// there is none, e.g. for machines frozen with nfa_machine_freeze
+	uint8_t* prefilter;
+	uint32_t prefilter_len;
+	uint32_t prefilter_is_prefix; // 1 if every match starts with the literal
+
+	uint32_t borrowed; // 1 if the arrays point into a loaded image rather than being owned by the machine
+} nfa_frozen_machine;
+
+// Per-thread buffers for executing compiled machines. Execution only reads the compiled machine, so any
+// number of threads can execute the same one concurrently as long as each uses its own scratch
+typedef struct nfa_exec_scratch nfa_exec_scratch;
+
+// Build the compiled form of a machine, the machine can be modified or freed afterwards. Returns NULL if its
+// counters expand it past C_NFA_FROZEN_STATES_MAX states
+nfa_frozen_machine* nfa_machine_freeze(const nfa_machine* machine);
+
+// Returns the compiled form of regex along with a search prefilter from the literals it requires, NULL if
+// input isn't a valid regex
+nfa_frozen_machine* regex_compile(const char* input);
+
+// Dealloc a compiled machine
+void nfa_frozen_machine_free(nfa_frozen_machine* machine);
+
+// Returns 1 if state_index is a final state, 0 otherwise
+int nfa_frozen_machine_is_final(const nfa_frozen_machine* machine, size_t state_index);
+
+// Run some input through the compiled machine, return 1 if passes, 0 otherwise
+int nfa_frozen_machine_execute(const nfa_frozen_machine* machine, const char* string);
+
+// Same as nfa_frozen_machine_execute but reuses the buffers in scratch, so no memory is allocated
+// once scratch has grown to fit the machine
+int nfa_frozen_machine_execute_scratch(const nfa_frozen_machine* machine, const char* string, nfa_exec_scratch* scratch);
+
+// Run len bytes of data through the compiled machine, data can contain any byte including '\0'.
+// scratch can be NULL, in which case buffers are allocated for this call only
+int nfa_frozen_machine_execute_n(const nfa_frozen_machine* machine, const uint8_t* data, size_t len, nfa_exec_scratch* scratch);
+
+// Create an empty scratch, buffers are allocated on first use and grow geometrically
+nfa_exec_scratch* nfa_exec_scratch_alloc(void);
+
+// Grow scratch up front so executing machine never allocates
+void nfa_exec_scratch_reserve(nfa_exec_scratch* scratch, const nfa_frozen_machine* machine);
+
+// Dealloc a scratch
+void nfa_exec_scratch_free(nfa_exec_scratch* scratch);
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef C_NFA_GLUSHKOV_H
+#define C_NFA_GLUSHKOV_H
+
+#include <c_nfa/regex.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Patterns with at most this many characters and classes can be run bit-parallel, bit 0 is the initial state
+#define C_NFA_GLUSHKOV_MAX_POSITIONS 63
+
+// Glushkov position automaton, state p is "just matched the p-th character of the pattern", so there
+// are no e-transitions and the set of active states fits in one word. Each byte costs eight table
+// lookups to find the states that can follow the active ones, and a mask for the states entered on that byte
+typedef struct
+{
+	uint64_t follow_tables[8][256]; // follow_tables[k][v] is the union of the follow sets of the states in bits [8k, 8k + 8) of v
+	uint64_t byte_masks[256]; // byte_masks[c] has bit p set if position p is the character c or a class holding c
+	uint64_t final_mask;
+} nfa_glushkov_machine;
+
+// Returns the position automaton of regex, or NULL if regex has more than C_NFA_GLUSHKOV_MAX_POSITIONS characters
+// or a counted repetition other than x{0}, x{1}, x{0,1}, x{0,} and x{1,}
+nfa_glushkov_machine* regex_to_glushkov(const regex_t* regex);
+
+// Dealloc a position automaton
+void nfa_glushkov_machine_free(nfa_glushkov_machine* machine);
+
+// Run some input through the position automaton, return 1 if passes, 0 otherwise
+int nfa_glushkov_machine_execute(const nfa_glushkov_machine* machine, const char* string);
+
+// Run len bytes of data through the position automaton, data can contain any byte including '\0'
+int nfa_glushkov_machine_execute_n(const nfa_glushkov_machine* machine, const uint8_t* data, size_t len);
+
+#endif
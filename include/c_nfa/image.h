@@ -0,0 +1,51 @@
+#ifndef C_NFA_IMAGE_H
+#define C_NFA_IMAGE_H
+
+#include <c_nfa/frozen.h>
+#include <c_nfa/dfa.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Bumped whenever the layout of an image changes, images from other versions are refused
+#define C_NFA_IMAGE_VERSION 4
+
+// Compiled machines can be written to a binary image that holds every table at a fixed offset from the
+// start, so loading one only builds a small handle pointing into it. The image itself is never written
+// to or fixed up, so a file mapped read-only can be shared by every process that loads it.
+// Images use the byte order and struct layout of the machine that wrote them.
+
+// Writes the image of machine into buffer if capacity is large enough, returns the size of the image either way
+size_t nfa_frozen_machine_serialize(const nfa_frozen_machine* machine, void* buffer, size_t capacity);
+
+// Returns a machine whose tables point into image, or NULL if image isn't a valid frozen machine image.
+// image must be 8-byte aligned and outlive the machine. Offsets, state indices and byte classes are always
+// checked against the table sizes, so a damaged image is refused rather than read out of bounds. The
+// checksum covers the whole image, pass verify_checksum = 0 to skip it for images that are trusted
+nfa_frozen_machine* nfa_frozen_machine_load(const void* image, size_t size, int verify_checksum);
+
+// Same as nfa_frozen_machine_serialize for a DFA
+size_t dfa_machine_serialize(const dfa_machine* machine, void* buffer, size_t capacity);
+
+// Same as nfa_frozen_machine_load for a DFA
+dfa_machine* dfa_machine_load(const void* image, size_t size, int verify_checksum);
+
+// Writes the image of machine to a file, returns 1 on success, 0 otherwise
+int nfa_frozen_machine_save(const nfa_frozen_machine* machine, const char* path);
+
+int dfa_machine_save(const dfa_machine* machine, const char* path);
+
+// A file mapped read-only into memory, pages are shared with every other process mapping the same file
+typedef struct nfa_image_file nfa_image_file;
+
+// Returns NULL if the file can't be opened or mapped
+nfa_image_file* nfa_image_file_map(const char* path);
+
+const void* nfa_image_file_data(const nfa_image_file* file);
+
+size_t nfa_image_file_size(const nfa_image_file* file);
+
+// Unmap the file, machines loaded from it can't be used afterwards
+void nfa_image_file_unmap(nfa_image_file* file);
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef C_NFA_LAZY_DFA_H
+#define C_NFA_LAZY_DFA_H
+
+#include <c_nfa/frozen.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef C_NFA_LAZY_DFA_DEFAULT_BUDGET
+#define C_NFA_LAZY_DFA_DEFAULT_BUDGET (1 << 20)
+#endif
+
+// Number of cache flushes in a single execution before giving up on the DFA and finishing with the NFA simulation
+#ifndef C_NFA_LAZY_DFA_MAX_FLUSHES
+#define C_NFA_LAZY_DFA_MAX_FLUSHES 8
+#endif
+
+// DFA built on demand from sets of NFA states while scanning input, each DFA state and its
+// transitions are cached so repeated inputs only cost a table lookup per character
+typedef struct nfa_lazy_dfa nfa_lazy_dfa;
+
+// Create a lazy DFA over a compiled machine, the cache never holds more than memory_budget bytes, counting
+// the full capacity of its transition rows, state sets and hash table.
+// The compiled machine must outlive the lazy DFA
+nfa_lazy_dfa* nfa_lazy_dfa_alloc(const nfa_frozen_machine* machine, size_t memory_budget);
+
+// Dealloc a lazy DFA, the compiled machine is not freed
+void nfa_lazy_dfa_free(nfa_lazy_dfa* dfa);
+
+// Run some input through the DFA, return 1 if passes, 0 otherwise.
+// The cache is updated so a lazy DFA must not be shared between threads
+int nfa_lazy_dfa_execute(nfa_lazy_dfa* dfa, const char* string);
+
+// Run len bytes of data through the DFA, data can contain any byte including '\0'
+int nfa_lazy_dfa_execute_n(nfa_lazy_dfa* dfa, const uint8_t* data, size_t len);
+
+// Number of DFA states currently cached
+size_t nfa_lazy_dfa_states_len(const nfa_lazy_dfa* dfa);
+
+// Number of times the cache has been flushed because it hit its memory budget
+size_t nfa_lazy_dfa_flush_count(const nfa_lazy_dfa* dfa);
+
+#endif
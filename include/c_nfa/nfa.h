@@ -2,46 +2,119 @@
 #define C_NFA_NFA_H
 
 #include <stdlib.h>
+#include <stdint.h>
 
-#define C_NFA_EPSILON 0
+// Rule of an e-transition, outside the byte range so every byte value can label a transition
+#define C_NFA_EPSILON 256
+
+struct nfa_machine_stats;
+struct nfa_machine_compiled;
 
 typedef struct
 {
 	size_t from_state_index;
 	size_t to_state_index;
-	char rule;
+	int rule; // byte in [0, 255] or C_NFA_EPSILON
+	int rule_last; // the transition matches every byte in [rule, rule_last], C_NFA_EPSILON for e-transitions
 } nfa_transition;
 
+// max of a counter whose body can be passed through any number of times
+#define C_NFA_COUNTER_UNBOUNDED SIZE_MAX
+
+// Counted repetition x{min,max} built from a single copy of x. The body is the states [first_state_index,
+// first_state_index + states_len), and a machine is in a state along with the pass it is on through every
+// body holding that state. Entering a body from outside starts pass 1 and transitions inside it stay in the
+// current pass. From last_state_index an e-transition goes back to first_state_index for the next pass while
+// pass < max, and another goes to exit_state_index, outside the body, once pass >= min.
+// Bodies are either disjoint or one holds the other, and min <= max with max at least 1
 typedef struct
+{
+	size_t first_state_index;
+	size_t states_len;
+	size_t last_state_index;
+	size_t exit_state_index;
+	size_t min;
+	size_t max; // C_NFA_COUNTER_UNBOUNDED if there is no upper bound
+} nfa_counter;
+
+// Named so core.h can forward declare it
+typedef struct nfa_machine
 {
 	int start_state_index;
 	int* final_states;
 	size_t final_state_len; // TODO: rename final_states_len
-	nfa_transition* transitions; // TODO: sort via from_state_index and bin_search into transitions when searching for transitions to take
+	nfa_transition* transitions; // unordered, nfa_machine_freeze groups them by from_state_index
 	size_t transitions_len;
+	size_t transitions_capacity;
+	nfa_counter* counters;
+	size_t counters_len;
+	size_t counters_capacity;
+	struct nfa_machine_stats* stats; // totals of every execution, only allocated when built with C_NFA_STATS_ENABLED, see stats.h
+	struct nfa_machine_compiled* compiled; // built by the first execution and reused by later ones, see nfa_machine_invalidate
 } nfa_machine;
 
+typedef enum
+{
+	NFA_EXECUTION_MODE_STATE_SET, // steps all active states together, O(len * states)
+	NFA_EXECUTION_MODE_BACKTRACK, // depth-first search over (state, string_index), exponential in the worst case
+	NFA_EXECUTION_MODE_LAZY_DFA // builds DFA states from sets of NFA states on demand, see lazy_dfa.h
+} nfa_execution_mode;
+
 // Create a new NFA machine
 nfa_machine* nfa_machine_alloc();
 
 // Dealloc a NFA machine
 void nfa_machine_free(nfa_machine* machine);
 
+// Make room for at least transitions_capacity transitions without reallocating
+void nfa_machine_reserve(nfa_machine* machine, const size_t transitions_capacity);
+
 // Add a transition to a NFA machine
-void nfa_machine_add_transition(nfa_machine* machine, const size_t from_state_index, const size_t to_state_index, const char rule);
+void nfa_machine_add_transition(nfa_machine* machine, const size_t from_state_index, const size_t to_state_index, const int rule);
+
+// Add a transition matching every byte in [first, last] to a NFA machine
+void nfa_machine_add_range_transition(nfa_machine* machine, const size_t from_state_index, const size_t to_state_index, const int first, const int last);
 
-// Run some input through the NFA, return 1 if passes, 0 otherwise
+// Add a counted repetition to a NFA machine, see nfa_counter
+void nfa_machine_add_counter(nfa_machine* machine, const nfa_counter* counter);
+
+// Drop the compiled form cached by execution. Adding transitions does this already, call it after changing
+// the fields of a machine that has been executed by hand
+void nfa_machine_invalidate(nfa_machine* machine);
+
+// Run some input through the NFA, return 1 if passes, 0 otherwise. The first execution compiles the machine,
+// see nfa_machine_freeze, and later ones reuse it. Nothing passes if the machine can't be compiled
 int nfa_machine_execute(const nfa_machine* machine, const char* string);
 
+// Run len bytes of data through the NFA, data can contain any byte including '\0', return 1 if passes, 0 otherwise
+int nfa_machine_execute_n(const nfa_machine* machine, const uint8_t* data, size_t len);
+
+// Same as nfa_machine_execute but with an explicit choice of execution engine
+int nfa_machine_execute_mode(const nfa_machine* machine, const char* string, nfa_execution_mode mode);
+
+// Same as nfa_machine_execute_n but with an explicit choice of execution engine
+int nfa_machine_execute_mode_n(const nfa_machine* machine, const uint8_t* data, size_t len, nfa_execution_mode mode);
+
+// Returns the largest state index referenced by the machine's start state, final states, transitions, or counters
+size_t get_machine_max_state_index(const nfa_machine* machine);
+
 // Returns the union of two NFAs, i.e. adds a initial state with an e-transition to the initial states of machine_a and machine_b
 nfa_machine* nfa_machine_union(const nfa_machine* machine_a, const nfa_machine* machine_b);
 
+// Returns the union of machines_len NFAs. If final_tags isn't NULL it's set to a malloc'd array with an entry per
+// final state of the union, giving the index of the machine that final state came from
+nfa_machine* nfa_machine_union_n(const nfa_machine* const* machines, size_t machines_len, size_t** final_tags);
+
 // Returns the concatenation of two NFAs, i.e. the final state(s) of machine_a is piped into the initial state of machine_b
 nfa_machine* nfa_machine_concat(const nfa_machine* machine_a, const nfa_machine* machine_b);
 
 // Returns the Kleene star of an NFA, i.e. a new NFA where you can take machine 0 times or any number of times
 nfa_machine* nfa_machine_kleene_star(const nfa_machine* machine);
 
+// Returns an equivalent NFA with no e-transitions, no states that are unreachable or can't reach a final state,
+// and states with the same behaviour merged together. Returns NULL if the machine can't be frozen, see nfa_machine_freeze
+nfa_machine* nfa_machine_optimize(const nfa_machine* machine);
+
 // Returns a NFA equivalent to the given regex, only supports concatenation, union, and kleene star
 nfa_machine* nfa_machine_construct(const char* regex);
 
@@ -1,13 +1,34 @@
 #ifndef C_NFA_REGEX_H
 #define C_NFA_REGEX_H
 
+#include <stddef.h>
+#include <stdint.h>
+
+// Longest literal kept by regex_required_literal
+#define C_NFA_LITERAL_MAX 32
+
+// Largest bound allowed in {m,n}
+#define C_NFA_REGEX_REPEAT_MAX 1000
+
+// Counted repetitions build their body once, but execution tells apart every pass through it, so one is refused
+// if the pattern would have more than this many nodes with the body copied once per pass, including the passes
+// of any repetitions nested in it, e.g. (a{1000}){1000}
+#define C_NFA_REGEX_EXPANDED_MAX (1 << 18)
+
+// max of a REPEAT node for {m,}
+#define C_NFA_REGEX_REPEAT_UNBOUNDED UINT32_MAX
+
 typedef enum
 {
     BLANK,
     CHAR,
     UNION,
     CONCAT,
-    STAR
+    STAR,
+    CLASS, // one byte out of a set, from [...], [^...] or .
+    PLUS, // one or more of data.pair.first
+    OPTIONAL, // zero or one of data.pair.first
+    REPEAT // between data.repeat.min and data.repeat.max of data.repeat.first
 } regex_type;
 
 typedef struct regex_t
@@ -15,15 +36,56 @@ typedef struct regex_t
     regex_type type;
     union {
         char primitive;
+        uint64_t bytes[4]; // CLASS, bit b is set if the class matches byte b
         struct
         {
             struct regex_t* first;
             struct regex_t* second;
         } pair;
+        struct
+        {
+            struct regex_t* first;
+            uint32_t min;
+            uint32_t max; // C_NFA_REGEX_REPEAT_UNBOUNDED for {m,}
+        } repeat;
     } data;
 } regex_t;
 
+typedef enum
+{
+    REGEX_OK,
+    REGEX_ERROR_UNMATCHED_OPEN_PAREN,
+    REGEX_ERROR_UNMATCHED_CLOSE_PAREN,
+    REGEX_ERROR_NOTHING_TO_REPEAT,
+    REGEX_ERROR_TRAILING_ESCAPE,
+    REGEX_ERROR_INVALID_ESCAPE,
+    REGEX_ERROR_UNMATCHED_OPEN_BRACKET,
+    REGEX_ERROR_INVALID_RANGE,
+    REGEX_ERROR_INVALID_REPEAT,
+    REGEX_ERROR_REPEAT_TOO_LARGE
+} regex_error;
+
+// Parses input into an AST stored in *regex. On failure *regex is NULL and, if error_position isn't NULL,
+// it is set to the index in input where the error was found
+regex_error regex_try_parse(const char* input, regex_t** regex, size_t* error_position);
+
+// Same as regex_try_parse, returns NULL if input isn't a valid regex
 regex_t* regex_parse(const char* input);
+
+// Frees every node of a parsed regex at once
 void regex_free(regex_t* regex);
 
+const char* regex_error_string(regex_error error);
+
+typedef struct
+{
+    uint8_t bytes[C_NFA_LITERAL_MAX];
+    size_t len; // 0 if no literal was found
+    int is_prefix; // 1 if every match starts with the literal, otherwise it appears somewhere in every match
+} regex_literal;
+
+// Returns a literal that every string in the language of regex contains, preferring one that every string
+// starts with. Used to skip input that can't match before running an automaton
+regex_literal regex_required_literal(const regex_t* regex);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,40 @@
+#ifndef C_NFA_SEARCH_H
+#define C_NFA_SEARCH_H
+
+#include <c_nfa/frozen.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Matched bytes are data[start, end)
+typedef struct
+{
+	size_t start;
+	size_t end;
+} nfa_match;
+
+// Iterates over non-overlapping matches from left to right
+typedef struct
+{
+	const nfa_frozen_machine* machine;
+	const uint8_t* data;
+	size_t len;
+	size_t position;
+	nfa_exec_scratch* scratch;
+} nfa_match_iterator;
+
+// Finds the leftmost match of machine anywhere in data, preferring the longest match at that start.
+// Returns 1 and fills match if there is one, 0 otherwise. scratch can be NULL
+int nfa_frozen_machine_search(const nfa_frozen_machine* machine, const uint8_t* data, size_t len, nfa_match* match, nfa_exec_scratch* scratch);
+
+// Same as nfa_frozen_machine_search but only considers matches starting at or after from
+int nfa_frozen_machine_search_from(const nfa_frozen_machine* machine, const uint8_t* data, size_t len, size_t from, nfa_match* match, nfa_exec_scratch* scratch);
+
+// Start iterating over the matches in data, scratch can't be NULL and must outlive the iterator
+void nfa_match_iterator_init(nfa_match_iterator* iterator, const nfa_frozen_machine* machine, const uint8_t* data, size_t len, nfa_exec_scratch* scratch);
+
+// Returns 1 and fills match with the next match, 0 once there are no more. After an empty match the
+// search resumes one byte further along so the iterator always makes progress
+int nfa_match_iterator_next(nfa_match_iterator* iterator, nfa_match* match);
+
+#endif
@@ -0,0 +1,30 @@
+#ifndef C_NFA_SET_H
+#define C_NFA_SET_H
+
+#include <c_nfa/frozen.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Many patterns compiled into one machine, so the input is only scanned once no matter how many
+// patterns there are. Final states remember which pattern they belong to
+typedef struct nfa_regex_set nfa_regex_set;
+
+// Returns NULL if any pattern isn't a valid regex, and sets error_index (if not NULL) to the first one that isn't,
+// or to patterns_len if the patterns together are too big to compile, see nfa_machine_freeze
+nfa_regex_set* nfa_regex_set_compile(const char* const* patterns, size_t patterns_len, size_t* error_index);
+
+void nfa_regex_set_free(nfa_regex_set* set);
+
+size_t nfa_regex_set_patterns_len(const nfa_regex_set* set);
+
+// Number of uint64_t words in the matched bitmask, i.e. ceil(patterns_len / 64)
+size_t nfa_regex_set_mask_words(const nfa_regex_set* set);
+
+// Runs len bytes of data through every pattern at once. Bit i % 64 of matched[i / 64] is set if pattern i
+// matches the whole input and cleared otherwise. Returns the number of patterns that matched, scratch can be NULL
+size_t nfa_regex_set_execute_n(const nfa_regex_set* set, const uint8_t* data, size_t len, uint64_t* matched, nfa_exec_scratch* scratch);
+
+size_t nfa_regex_set_execute(const nfa_regex_set* set, const char* string, uint64_t* matched, nfa_exec_scratch* scratch);
+
+#endif
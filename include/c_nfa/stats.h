@@ -0,0 +1,43 @@
+#ifndef C_NFA_STATS_H
+#define C_NFA_STATS_H
+
+#include <c_nfa/nfa.h>
+
+#include <stdint.h>
+
+// Counters are only collected when the library is built with C_NFA_STATS_ENABLED defined, otherwise the
+// functions below still work but every counter stays 0 and execution pays nothing for them
+
+// What one execution did, fields that don't apply to the engine that ran stay 0
+typedef struct
+{
+	uint64_t contexts_pushed; // (state, offset) contexts pushed by backtracking, states pushed while expanding e-closures
+	uint64_t contexts_popped;
+	uint64_t epsilon_expansions; // e-transitions followed
+	uint64_t set_hits; // e-transitions or states skipped because they were already seen
+	uint64_t transitions_scanned; // character transitions compared against an input byte
+	uint64_t peak_stack_depth;
+	uint64_t bytes_consumed; // input bytes read by the engine, less than the input length if it stopped early
+	uint64_t allocations;
+} nfa_exec_stats;
+
+// Totals of every execution of one machine, peak_stack_depth is the largest seen by any execution
+typedef struct nfa_machine_stats
+{
+	uint64_t executions;
+	nfa_exec_stats totals;
+} nfa_machine_stats;
+
+// Called after every execution of an nfa_machine, from the thread that ran it, only when C_NFA_STATS_ENABLED is defined
+typedef void (*nfa_stats_callback)(const nfa_machine* machine, const nfa_exec_stats* stats, void* user_data);
+
+// Same as nfa_machine_execute_mode_n, and if stats isn't NULL fills it with the counters of this execution
+int nfa_machine_execute_stats_n(const nfa_machine* machine, const uint8_t* data, size_t len, nfa_execution_mode mode, nfa_exec_stats* stats);
+
+// Reads the totals of every execution of machine so far, updated atomically so other threads may be executing it
+void nfa_machine_get_stats(const nfa_machine* machine, nfa_machine_stats* stats);
+
+// Sets the callback invoked after each execution, NULL removes it. Set it before executing from several threads
+void nfa_stats_set_callback(nfa_stats_callback callback, void* user_data);
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef C_NFA_STREAM_H
+#define C_NFA_STREAM_H
+
+#include <c_nfa/frozen.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Incremental execution of a compiled machine over input that arrives in chunks. The set of active
+// states is kept between chunks, so memory use doesn't depend on the length of the input
+typedef struct nfa_stream nfa_stream;
+
+// Start matching from the start state, the compiled machine must outlive the stream
+nfa_stream* nfa_stream_begin(const nfa_frozen_machine* machine);
+
+// Consume the next len bytes of input
+void nfa_stream_feed(nfa_stream* stream, const uint8_t* data, size_t len);
+
+// Consume bytes from data until len bytes are consumed or the next byte would step more active states than
+// *steps_left, which is decreased by the states stepped. Returns the number of bytes consumed, after the stream
+// is dead every remaining byte is consumed for free
+size_t nfa_stream_feed_budget(nfa_stream* stream, const uint8_t* data, size_t len, size_t* steps_left);
+
+// Returns 1 if the input fed so far passes, 0 otherwise, then deallocs the stream
+int nfa_stream_end(nfa_stream* stream);
+
+// Returns 1 if the input fed so far passes, without ending the stream
+int nfa_stream_is_accepting(const nfa_stream* stream);
+
+// Returns 1 if no more input can make the stream pass, so feeding can stop early
+int nfa_stream_is_dead(const nfa_stream* stream);
+
+// Number of bytes fed so far
+size_t nfa_stream_bytes_fed(const nfa_stream* stream);
+
+#endif
@@ -0,0 +1,305 @@
+#include <c_nfa/batch.h>
+
+#include "util.h"
+#include "state_set.h"
+#include <stdlib.h>
+#include <string.h>
+
+// MSVC has no pthreads, batches run on the calling thread there unless pthreads are provided
+#if !defined(_WIN32) || defined(C_NFA_USE_PTHREADS)
+#define C_NFA_BATCH_THREADS
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+#define C_NFA_BATCH_DEFAULT_CHUNK_LEN 256
+
+// Returns the compiled form of machine, frozen on first use, defined in nfa.c
+const nfa_frozen_machine* nfa_machine_compiled_frozen(const nfa_machine* machine);
+
+typedef struct
+{
+	const nfa_frozen_machine* machine;
+	const uint8_t* const* inputs;
+	const size_t* lengths;
+	size_t inputs_len;
+	uint64_t* results;
+	size_t chunk_len;
+} nfa_batch_job;
+
+// Runs the inputs in chunk, a chunk covers whole result words so no other worker touches them
+size_t nfa_batch_run_chunk(const nfa_batch_job* job, size_t chunk, nfa_exec_scratch* scratch)
+{
+	size_t matched_len = 0;
+	size_t begin = chunk * job->chunk_len;
+	size_t end = begin + job->chunk_len < job->inputs_len ? begin + job->chunk_len : job->inputs_len;
+
+	for (size_t word_begin = begin; word_begin < end; word_begin += 64)
+	{
+		uint64_t word = 0;
+		size_t word_end = word_begin + 64 < end ? word_begin + 64 : end;
+		for (size_t index = word_begin; index < word_end; ++index)
+		{
+			if (nfa_frozen_machine_execute_n(job->machine, job->inputs[index], job->lengths[index], scratch))
+			{
+				word |= (uint64_t)1 << (index - word_begin);
+				++matched_len;
+			}
+		}
+		job->results[word_begin / 64] = word;
+	}
+
+	return matched_len;
+}
+
+#ifdef C_NFA_BATCH_THREADS
+
+// Chunks [begin, end) that are still waiting, the owner takes from the front and thieves from the back
+typedef struct
+{
+	pthread_mutex_t mutex;
+	size_t begin;
+	size_t end;
+} nfa_batch_queue;
+
+typedef struct
+{
+	const nfa_batch_job* job;
+	nfa_batch_queue* queues;
+	size_t workers_len;
+	size_t worker_index;
+	size_t matched_len;
+} nfa_batch_worker;
+
+int nfa_batch_queue_pop(nfa_batch_queue* queue, size_t* chunk)
+{
+	pthread_mutex_lock(&queue->mutex);
+	int popped = queue->begin < queue->end;
+	if (popped)
+	{
+		*chunk = queue->begin++;
+	}
+	pthread_mutex_unlock(&queue->mutex);
+	return popped;
+}
+
+// Moves the back half of another worker's queue into the worker's own, returns 0 once every queue is empty
+int nfa_batch_steal(nfa_batch_worker* worker)
+{
+	for (size_t offset = 1; offset < worker->workers_len; ++offset)
+	{
+		nfa_batch_queue* victim = &worker->queues[(worker->worker_index + offset) % worker->workers_len];
+
+		pthread_mutex_lock(&victim->mutex);
+		size_t stolen_len = (victim->end - victim->begin + 1) / 2;
+		size_t stolen_end = victim->end;
+		victim->end -= stolen_len;
+		pthread_mutex_unlock(&victim->mutex);
+
+		if (stolen_len > 0)
+		{
+			nfa_batch_queue* own = &worker->queues[worker->worker_index];
+			pthread_mutex_lock(&own->mutex);
+			own->begin = stolen_end - stolen_len;
+			own->end = stolen_end;
+			pthread_mutex_unlock(&own->mutex);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+void nfa_batch_worker_run(nfa_batch_worker* worker)
+{
+	nfa_exec_scratch* scratch = nfa_exec_scratch_thread();
+	nfa_exec_scratch_reserve(scratch, worker->job->machine);
+
+	size_t chunk;
+	do
+	{
+		while (nfa_batch_queue_pop(&worker->queues[worker->worker_index], &chunk))
+		{
+			worker->matched_len += nfa_batch_run_chunk(worker->job, chunk, scratch);
+		}
+	} while (nfa_batch_steal(worker));
+}
+
+// Threads kept once started so later batches don't create and join their own. Pool thread i runs worker
+// i + 1 of a batch and the calling thread runs worker 0. One batch uses the pool at a time, a batch that
+// starts while it's busy runs on its calling thread
+typedef struct
+{
+	pthread_mutex_t mutex;
+	pthread_cond_t work_ready; // some thread was given a worker
+	pthread_cond_t work_done; // every thread given a worker is done with it
+	int busy;
+	size_t threads_len;
+	size_t running; // threads still running their worker
+	unsigned char* has_work; // set for each thread that has a worker to run
+	nfa_batch_worker* workers;
+	nfa_batch_queue* queues;
+	size_t capacity; // entries in has_work, workers, and queues
+} nfa_batch_pool;
+
+static nfa_batch_pool nfa_batch_pool_shared = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, PTHREAD_COND_INITIALIZER, 0, 0, 0, NULL, NULL, NULL, 0 };
+
+void* nfa_batch_pool_thread_run(void* argument)
+{
+	size_t thread_index = (size_t)(uintptr_t)argument;
+	nfa_batch_pool* pool = &nfa_batch_pool_shared;
+
+	pthread_mutex_lock(&pool->mutex);
+	for (;;)
+	{
+		while (!pool->has_work[thread_index])
+		{
+			pthread_cond_wait(&pool->work_ready, &pool->mutex);
+		}
+		nfa_batch_worker* worker = &pool->workers[thread_index + 1];
+		pthread_mutex_unlock(&pool->mutex);
+
+		nfa_batch_worker_run(worker);
+
+		pthread_mutex_lock(&pool->mutex);
+		pool->has_work[thread_index] = 0;
+		if (--pool->running == 0)
+		{
+			pthread_cond_signal(&pool->work_done);
+		}
+	}
+	return NULL;
+}
+
+// Grows the pool to hold workers_len workers and starts threads for all but one of them, must be called with
+// the mutex held and no batch running. Returns how many threads can be given a worker
+size_t nfa_batch_pool_reserve(nfa_batch_pool* pool, size_t workers_len)
+{
+	if (workers_len > pool->capacity)
+	{
+		// the queue mutexes can't be moved, so the queues are set up again rather than reallocated
+		for (size_t queue_index = 0; queue_index < pool->capacity; ++queue_index)
+		{
+			pthread_mutex_destroy(&pool->queues[queue_index].mutex);
+		}
+		free(pool->queues);
+		pool->queues = malloc(workers_len * sizeof(nfa_batch_queue));
+		for (size_t queue_index = 0; queue_index < workers_len; ++queue_index)
+		{
+			pthread_mutex_init(&pool->queues[queue_index].mutex, NULL);
+		}
+		pool->workers = realloc(pool->workers, workers_len * sizeof(nfa_batch_worker));
+		pool->has_work = realloc(pool->has_work, workers_len);
+		memset(pool->has_work + pool->capacity, 0, workers_len - pool->capacity);
+		pool->capacity = workers_len;
+	}
+
+	while (pool->threads_len + 1 < workers_len)
+	{
+		pthread_t thread;
+		if (pthread_create(&thread, NULL, nfa_batch_pool_thread_run, (void*)(uintptr_t)pool->threads_len) != 0)
+		{
+			break;
+		}
+		pthread_detach(thread);
+		++pool->threads_len;
+	}
+	return pool->threads_len < workers_len - 1 ? pool->threads_len : workers_len - 1;
+}
+
+#endif
+
+size_t nfa_frozen_machine_execute_batch(const nfa_frozen_machine* machine, const uint8_t* const* inputs, const size_t* lengths, size_t inputs_len, uint64_t* results, const nfa_batch_options* options)
+{
+	nfa_batch_job job;
+	job.machine = machine;
+	job.inputs = inputs;
+	job.lengths = lengths;
+	job.inputs_len = inputs_len;
+	job.results = results;
+	job.chunk_len = options != NULL && options->chunk_len > 0 ? options->chunk_len : C_NFA_BATCH_DEFAULT_CHUNK_LEN;
+	job.chunk_len = C_NFA_BITSET_WORDS(job.chunk_len) * 64;
+
+	size_t chunks_len = (inputs_len + job.chunk_len - 1) / job.chunk_len;
+	size_t workers_len = options != NULL ? options->threads_len : 0;
+
+#ifdef C_NFA_BATCH_THREADS
+	if (workers_len == 0)
+	{
+		long processors_len = sysconf(_SC_NPROCESSORS_ONLN);
+		workers_len = processors_len > 0 ? (size_t)processors_len : 1;
+	}
+	if (workers_len > chunks_len)
+	{
+		workers_len = chunks_len;
+	}
+
+	if (workers_len > 1)
+	{
+		nfa_batch_pool* pool = &nfa_batch_pool_shared;
+		pthread_mutex_lock(&pool->mutex);
+		if (!pool->busy)
+		{
+			pool->busy = 1;
+			size_t threads_len = nfa_batch_pool_reserve(pool, workers_len);
+
+			// every worker starts with an even share of the chunks, if there are fewer threads than workers the
+			// chunks of the workers without one are stolen by the others
+			for (size_t worker_index = 0; worker_index < workers_len; ++worker_index)
+			{
+				pool->queues[worker_index].begin = chunks_len * worker_index / workers_len;
+				pool->queues[worker_index].end = chunks_len * (worker_index + 1) / workers_len;
+
+				nfa_batch_worker* worker = &pool->workers[worker_index];
+				worker->job = &job;
+				worker->queues = pool->queues;
+				worker->workers_len = workers_len;
+				worker->worker_index = worker_index;
+				worker->matched_len = 0;
+			}
+			memset(pool->has_work, 1, threads_len);
+			pool->running = threads_len;
+			pthread_cond_broadcast(&pool->work_ready);
+			pthread_mutex_unlock(&pool->mutex);
+
+			nfa_batch_worker_run(&pool->workers[0]);
+
+			pthread_mutex_lock(&pool->mutex);
+			while (pool->running > 0)
+			{
+				pthread_cond_wait(&pool->work_done, &pool->mutex);
+			}
+			size_t matched_len = 0;
+			for (size_t worker_index = 0; worker_index < workers_len; ++worker_index)
+			{
+				matched_len += pool->workers[worker_index].matched_len;
+			}
+			pool->busy = 0;
+			pthread_mutex_unlock(&pool->mutex);
+			return matched_len;
+		}
+
+		// another batch holds the pool, this one runs on the calling thread
+		pthread_mutex_unlock(&pool->mutex);
+	}
+#endif
+
+	(void)workers_len;
+	nfa_exec_scratch* scratch = nfa_exec_scratch_thread();
+	size_t matched_len = 0;
+	for (size_t chunk = 0; chunk < chunks_len; ++chunk)
+	{
+		matched_len += nfa_batch_run_chunk(&job, chunk, scratch);
+	}
+	return matched_len;
+}
+
+size_t nfa_machine_execute_batch(const nfa_machine* machine, const uint8_t* const* inputs, const size_t* lengths, size_t inputs_len, uint64_t* results, const nfa_batch_options* options)
+{
+	const nfa_frozen_machine* frozen = nfa_machine_compiled_frozen(machine);
+	if (frozen == NULL)
+	{
+		memset(results, 0, C_NFA_BITSET_WORDS(inputs_len) * sizeof(uint64_t));
+		return 0;
+	}
+	return nfa_frozen_machine_execute_batch(frozen, inputs, lengths, inputs_len, results, options);
+}
@@ -1,71 +1,449 @@
 #include <c_nfa/regex.h>
 #include <c_nfa/nfa.h>
 #include <c_nfa/core.h>
+#include <c_nfa/frozen.h>
+#include <c_nfa/glushkov.h>
+#include <c_nfa/cache.h>
 
-nfa_machine* handle_regex(const regex_t* regex)
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct
+{
+    const regex_t* regex;
+    size_t start_state_index;
+    size_t stage;
+    size_t saved_state_index;
+} nfa_builder_frame;
+
+// Explicit stack for walking the AST, so deeply nested patterns don't grow the call stack
+typedef struct
+{
+    nfa_builder_frame* frames;
+    size_t frames_len;
+    size_t frames_capacity;
+} nfa_builder_stack;
+
+void nfa_builder_stack_push(nfa_builder_stack* stack, const regex_t* regex, size_t start_state_index)
 {
-    switch (regex->type)
+    if (stack->frames_len == stack->frames_capacity)
     {
-        case BLANK:
-        {
-            nfa_machine* machine = nfa_machine_alloc();
-            machine->start_state_index = 0;
-            machine->final_states = malloc(sizeof(int));
-            machine->final_states[0] = 1;
-            machine->final_state_len = 1;
-            nfa_machine_add_transition(machine, 0, 1, C_NFA_EPSILON);
-            return machine;
-        }
-        case CHAR:
-        {
-            nfa_machine* machine = nfa_machine_alloc();
-            machine->start_state_index = 0;
-            machine->final_states = malloc(sizeof(int));
-            machine->final_states[0] = 1;
-            machine->final_state_len = 1;
-            nfa_machine_add_transition(machine, 0, 1, regex->data.primitive);
-            return machine;
-        }
-        case UNION:
-        {
-            nfa_machine* machine_a = handle_regex(regex->data.pair.first);
-            nfa_machine* machine_b = handle_regex(regex->data.pair.second);
-            nfa_machine* machine_union = nfa_machine_union(machine_a, machine_b);
-            nfa_machine_free(machine_a);
-            nfa_machine_free(machine_b);
-            return machine_union;
-        }
-        case CONCAT:
+        stack->frames_capacity = stack->frames_capacity == 0 ? 64 : 2 * stack->frames_capacity;
+        stack->frames = realloc(stack->frames, stack->frames_capacity * sizeof(nfa_builder_frame));
+    }
+
+    nfa_builder_frame* frame = &stack->frames[stack->frames_len++];
+    frame->regex = regex;
+    frame->start_state_index = start_state_index;
+    frame->stage = 0;
+    frame->saved_state_index = 0;
+}
+
+// How handle_regex builds x{m,n}: bounds that have an operator of their own are built like it, x{0} like
+// BLANK and x{1} like x, the rest run a single build of x through a counter, see nfa_counter
+regex_type nfa_builder_repeat_shape(const regex_t* node)
+{
+    uint32_t min = node->data.repeat.min;
+    uint32_t max = node->data.repeat.max;
+    if (max == 0)
+    {
+        return BLANK;
+    }
+    if (max == C_NFA_REGEX_REPEAT_UNBOUNDED && min <= 1)
+    {
+        return min == 0 ? STAR : PLUS;
+    }
+    if (max == 1 && min == 0)
+    {
+        return OPTIONAL;
+    }
+    return REPEAT;
+}
+
+// Node type handle_regex builds node as, and the body of STAR, PLUS, OPTIONAL and REPEAT
+regex_type nfa_builder_type(const regex_t* node)
+{
+    return node->type == REPEAT ? nfa_builder_repeat_shape(node) : node->type;
+}
+
+const regex_t* nfa_builder_body(const regex_t* node)
+{
+    return node->type == REPEAT ? node->data.repeat.first : node->data.pair.first;
+}
+
+// Returns the number of runs of consecutive bytes in a class, each becomes one range transition
+size_t nfa_builder_class_ranges_len(const regex_t* node)
+{
+    size_t ranges_len = 0;
+    int previous = 0;
+    for (size_t byte = 0; byte < 256; ++byte)
+    {
+        int has = (node->data.bytes[byte / 64] >> (byte % 64)) & 1;
+        ranges_len += has && !previous;
+        previous = has;
+    }
+    return ranges_len;
+}
+
+// Count the states and transitions handle_regex will emit so the machine can be allocated once
+void nfa_builder_count(const regex_t* regex, nfa_builder_stack* stack, size_t* states_len, size_t* transitions_len)
+{
+    *states_len = 1;
+    *transitions_len = 0;
+
+    stack->frames_len = 0;
+    nfa_builder_stack_push(stack, regex, 0);
+    while (stack->frames_len > 0)
+    {
+        const regex_t* node = stack->frames[--stack->frames_len].regex;
+        switch (nfa_builder_type(node))
         {
-            nfa_machine* machine_a = handle_regex(regex->data.pair.first);
-            nfa_machine* machine_b = handle_regex(regex->data.pair.second);
-            nfa_machine* machine_concat = nfa_machine_concat(machine_a, machine_b);
-            nfa_machine_free(machine_a);
-            nfa_machine_free(machine_b);
-            return machine_concat;
+            case BLANK:
+                break;
+            case CHAR:
+                *states_len += 1;
+                *transitions_len += 1;
+                break;
+            case UNION:
+                *states_len += 1;
+                *transitions_len += 2;
+                nfa_builder_stack_push(stack, node->data.pair.first, 0);
+                nfa_builder_stack_push(stack, node->data.pair.second, 0);
+                break;
+            case CONCAT:
+                nfa_builder_stack_push(stack, node->data.pair.first, 0);
+                nfa_builder_stack_push(stack, node->data.pair.second, 0);
+                break;
+            case STAR:
+            case PLUS:
+            case OPTIONAL:
+                *states_len += 1;
+                *transitions_len += 2;
+                nfa_builder_stack_push(stack, nfa_builder_body(node), 0);
+                break;
+            case REPEAT:
+                if (node->data.repeat.min != 1 || node->data.repeat.max != 1)
+                {
+                    *states_len += 2;
+                    *transitions_len += 1 + (node->data.repeat.min == 0);
+                }
+                nfa_builder_stack_push(stack, node->data.repeat.first, 0);
+                break;
+            case CLASS:
+                *states_len += 1;
+                *transitions_len += nfa_builder_class_ranges_len(node);
+                break;
         }
-        case STAR:
+    }
+}
+
+// Thompson's construction in a single walk of the AST, emitting straight into one pre-sized machine.
+// Every sub-expression is built from a given start state and returns its final state, the start state
+// never has incoming transitions from inside the sub-expression so siblings can safely share it:
+//  - BLANK ends where it starts
+//  - CHAR adds one transition to a new state
+//  - CONCAT starts the second half from the final state of the first half
+//  - UNION starts both halves from the same state and joins them into a new final state
+//  - STAR loops through a new state Q, which is also its final state
+//  - PLUS loops from its final state back through a new state Q, so the body is taken at least once
+//  - OPTIONAL joins its body and an e-transition that skips it into a new final state, the body's final
+//    state can't be reused since it may loop back into the body
+//  - CLASS adds one range transition per run of consecutive bytes to a new state
+//  - REPEAT enters its body through a new state B and leaves it through a new state X, the counter added for
+//    the body loops back to B and steps out to X as the bounds allow, see nfa_builder_repeat_shape
+nfa_machine* handle_regex(const regex_t* regex)
+{
+    nfa_builder_stack stack = { NULL, 0, 0 };
+
+    size_t states_len;
+    size_t transitions_len;
+    nfa_builder_count(regex, &stack, &states_len, &transitions_len);
+
+    nfa_machine* machine = nfa_machine_alloc();
+    nfa_machine_reserve(machine, transitions_len);
+    machine->start_state_index = 0;
+
+    size_t next_state_index = 1;
+    size_t result_state_index = 0;
+
+    stack.frames_len = 0;
+    nfa_builder_stack_push(&stack, regex, 0);
+    while (stack.frames_len > 0)
+    {
+        // frames can move when pushing, so index rather than holding a pointer across pushes
+        size_t frame_index = stack.frames_len - 1;
+        nfa_builder_frame* frame = &stack.frames[frame_index];
+        const regex_t* node = frame->regex;
+
+        switch (nfa_builder_type(node))
         {
-            nfa_machine* machine_a = handle_regex(regex->data.pair.first);
-            nfa_machine* machine_star = nfa_machine_kleene_star(machine_a);
-            nfa_machine_free(machine_a);
-            return machine_star;
+            case BLANK:
+            {
+                result_state_index = frame->start_state_index;
+                --stack.frames_len;
+                break;
+            }
+            case CHAR:
+            {
+                result_state_index = next_state_index++;
+                nfa_machine_add_transition(machine, frame->start_state_index, result_state_index, node->data.primitive);
+                --stack.frames_len;
+                break;
+            }
+            case CLASS:
+            {
+                result_state_index = next_state_index++;
+                for (size_t byte = 0; byte < 256; ++byte)
+                {
+                    if ((node->data.bytes[byte / 64] >> (byte % 64)) & 1)
+                    {
+                        size_t last = byte;
+                        while (last < 255 && ((node->data.bytes[(last + 1) / 64] >> ((last + 1) % 64)) & 1))
+                        {
+                            ++last;
+                        }
+                        nfa_machine_add_range_transition(machine, frame->start_state_index, result_state_index, (int)byte, (int)last);
+                        byte = last;
+                    }
+                }
+                --stack.frames_len;
+                break;
+            }
+            case CONCAT:
+            {
+                if (frame->stage == 0)
+                {
+                    frame->stage = 1;
+                    nfa_builder_stack_push(&stack, node->data.pair.first, frame->start_state_index);
+                }
+                else if (frame->stage == 1)
+                {
+                    frame->stage = 2;
+                    nfa_builder_stack_push(&stack, node->data.pair.second, result_state_index);
+                }
+                else
+                {
+                    --stack.frames_len;
+                }
+                break;
+            }
+            case UNION:
+            {
+                if (frame->stage == 0)
+                {
+                    frame->stage = 1;
+                    nfa_builder_stack_push(&stack, node->data.pair.first, frame->start_state_index);
+                }
+                else if (frame->stage == 1)
+                {
+                    frame->stage = 2;
+                    frame->saved_state_index = result_state_index;
+                    nfa_builder_stack_push(&stack, node->data.pair.second, frame->start_state_index);
+                }
+                else
+                {
+                    size_t final_state_index = next_state_index++;
+                    nfa_machine_add_transition(machine, frame->saved_state_index, final_state_index, C_NFA_EPSILON);
+                    nfa_machine_add_transition(machine, result_state_index, final_state_index, C_NFA_EPSILON);
+                    result_state_index = final_state_index;
+                    --stack.frames_len;
+                }
+                break;
+            }
+            case STAR:
+            {
+                if (frame->stage == 0)
+                {
+                    size_t state_index_q = next_state_index++;
+                    frame->stage = 1;
+                    frame->saved_state_index = state_index_q;
+                    nfa_machine_add_transition(machine, frame->start_state_index, state_index_q, C_NFA_EPSILON);
+                    nfa_builder_stack_push(&stack, nfa_builder_body(node), state_index_q);
+                }
+                else
+                {
+                    size_t state_index_q = frame->saved_state_index;
+                    if (result_state_index != state_index_q)
+                    {
+                        nfa_machine_add_transition(machine, result_state_index, state_index_q, C_NFA_EPSILON);
+                    }
+                    result_state_index = state_index_q;
+                    --stack.frames_len;
+                }
+                break;
+            }
+            case PLUS:
+            {
+                if (frame->stage == 0)
+                {
+                    size_t state_index_q = next_state_index++;
+                    frame->stage = 1;
+                    frame->saved_state_index = state_index_q;
+                    nfa_machine_add_transition(machine, frame->start_state_index, state_index_q, C_NFA_EPSILON);
+                    nfa_builder_stack_push(&stack, nfa_builder_body(node), state_index_q);
+                }
+                else
+                {
+                    // the body's final state is the final state of the loop, so at least one pass is needed
+                    if (result_state_index != frame->saved_state_index)
+                    {
+                        nfa_machine_add_transition(machine, result_state_index, frame->saved_state_index, C_NFA_EPSILON);
+                    }
+                    --stack.frames_len;
+                }
+                break;
+            }
+            case REPEAT:
+            {
+                int counted = node->data.repeat.min != 1 || node->data.repeat.max != 1;
+                if (frame->stage == 0)
+                {
+                    // x{1} is x, otherwise the body starts from B so nothing outside it leads into its middle
+                    frame->stage = 1;
+                    frame->saved_state_index = frame->start_state_index;
+                    if (counted)
+                    {
+                        frame->saved_state_index = next_state_index++;
+                        nfa_machine_add_transition(machine, frame->start_state_index, frame->saved_state_index, C_NFA_EPSILON);
+                    }
+                    nfa_builder_stack_push(&stack, node->data.repeat.first, frame->saved_state_index);
+                }
+                else
+                {
+                    if (counted)
+                    {
+                        nfa_counter counter;
+                        counter.first_state_index = frame->saved_state_index;
+                        counter.last_state_index = result_state_index;
+                        counter.exit_state_index = next_state_index++;
+                        counter.states_len = counter.exit_state_index - counter.first_state_index;
+                        counter.min = node->data.repeat.min;
+                        counter.max = node->data.repeat.max == C_NFA_REGEX_REPEAT_UNBOUNDED ? C_NFA_COUNTER_UNBOUNDED : node->data.repeat.max;
+                        nfa_machine_add_counter(machine, &counter);
+                        if (counter.min == 0)
+                        {
+                            nfa_machine_add_transition(machine, frame->start_state_index, counter.exit_state_index, C_NFA_EPSILON);
+                        }
+                        result_state_index = counter.exit_state_index;
+                    }
+                    --stack.frames_len;
+                }
+                break;
+            }
+            case OPTIONAL:
+            {
+                if (frame->stage == 0)
+                {
+                    frame->stage = 1;
+                    nfa_builder_stack_push(&stack, nfa_builder_body(node), frame->start_state_index);
+                }
+                else
+                {
+                    size_t final_state_index = next_state_index++;
+                    nfa_machine_add_transition(machine, frame->start_state_index, final_state_index, C_NFA_EPSILON);
+                    if (result_state_index != frame->start_state_index)
+                    {
+                        nfa_machine_add_transition(machine, result_state_index, final_state_index, C_NFA_EPSILON);
+                    }
+                    result_state_index = final_state_index;
+                    --stack.frames_len;
+                }
+                break;
+            }
         }
     }
+
+    free(stack.frames);
+
+    machine->final_states = malloc(sizeof(int));
+    machine->final_states[0] = (int)result_state_index;
+    machine->final_state_len = 1;
+
+    return machine;
 }
 
 struct nfa_machine* regex_to_nfa(const char* input)
 {
     regex_t* regex = regex_parse(input);
+    if (regex == NULL)
+    {
+        return NULL;
+    }
     nfa_machine* machine = handle_regex(regex);
     regex_free(regex);
     return machine;
 }
 
-int regex_execute(const char* regex, const char* input)
+nfa_frozen_machine* regex_compile(const char* input)
 {
-    nfa_machine* machine = regex_to_nfa(regex);
-    int result = nfa_machine_execute(machine, input);
+    regex_t* regex = regex_parse(input);
+    if (regex == NULL)
+    {
+        return NULL;
+    }
+
+    nfa_machine* machine = handle_regex(regex);
+    nfa_frozen_machine* frozen = nfa_machine_freeze(machine);
     nfa_machine_free(machine);
+    if (frozen == NULL)
+    {
+        regex_free(regex);
+        return NULL;
+    }
+
+    regex_literal literal = regex_required_literal(regex);
+    regex_free(regex);
+    if (literal.len > 0)
+    {
+        frozen->prefilter = malloc(literal.len);
+        memcpy(frozen->prefilter, literal.bytes, literal.len);
+        frozen->prefilter_len = (uint32_t)literal.len;
+        frozen->prefilter_is_prefix = (uint32_t)literal.is_prefix;
+    }
+    return frozen;
+}
+
+int regex_execute_uncached_n(const char* regex, const uint8_t* data, size_t len)
+{
+    regex_t* parsed = regex_parse(regex);
+    if (parsed == NULL)
+    {
+        return 0;
+    }
+
+    // short patterns run bit-parallel, longer ones fall back to the Thompson NFA
+    int result;
+    nfa_glushkov_machine* glushkov = regex_to_glushkov(parsed);
+    if (glushkov != NULL)
+    {
+        result = nfa_glushkov_machine_execute_n(glushkov, data, len);
+        nfa_glushkov_machine_free(glushkov);
+    }
+    else
+    {
+        nfa_machine* machine = handle_regex(parsed);
+        result = nfa_machine_execute_n(machine, data, len);
+        nfa_machine_free(machine);
+    }
+
+    regex_free(parsed);
     return result;
+}
+
+int regex_execute_n(const char* regex, const uint8_t* data, size_t len)
+{
+    regex_cache_entry* entry = regex_cache_acquire(regex);
+    if (entry == NULL)
+    {
+        // caching is turned off
+        return regex_execute_uncached_n(regex, data, len);
+    }
+    int result = regex_cache_entry_execute_n(entry, data, len);
+    regex_cache_release(entry);
+    return result;
+}
+
+int regex_execute(const char* regex, const char* input)
+{
+    return regex_execute_n(regex, (const uint8_t*)input, strlen(input));
 }
\ No newline at end of file
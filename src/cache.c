@@ -0,0 +1,331 @@
+#include <c_nfa/cache.h>
+#include <c_nfa/frozen.h>
+#include <c_nfa/glushkov.h>
+#include <c_nfa/regex.h>
+
+#include "mutex.h"
+#include "state_set.h"
+#include <stdlib.h>
+#include <string.h>
+
+struct regex_cache_entry
+{
+	struct regex_cache_entry* bucket_next;
+	struct regex_cache_entry* lru_prev; // towards the most recently used entry
+	struct regex_cache_entry* lru_next;
+	uint64_t hash;
+	char* pattern;
+
+	// one held by the stripe while the entry is cached, plus one per acquire
+	size_t references;
+
+	// short patterns are run bit-parallel, both are NULL if the pattern isn't a valid regex
+	nfa_glushkov_machine* glushkov;
+	nfa_frozen_machine* frozen;
+};
+
+typedef struct
+{
+	c_nfa_mutex mutex;
+	regex_cache_entry** buckets;
+	size_t buckets_len;
+	regex_cache_entry* lru_head; // most recently used
+	regex_cache_entry* lru_tail; // least recently used
+	size_t entries_len;
+	size_t capacity;
+	size_t hits;
+	size_t misses;
+	size_t evictions;
+} regex_cache_stripe;
+
+#define C_NFA_REGEX_CACHE_STRIPE(index) { C_NFA_MUTEX_INIT, NULL, 0, NULL, NULL, 0, \
+	C_NFA_REGEX_CACHE_DEFAULT_CAPACITY / C_NFA_REGEX_CACHE_STRIPES + ((index) < C_NFA_REGEX_CACHE_DEFAULT_CAPACITY % C_NFA_REGEX_CACHE_STRIPES), 0, 0, 0 }
+
+static regex_cache_stripe regex_cache_stripes[C_NFA_REGEX_CACHE_STRIPES] = {
+	C_NFA_REGEX_CACHE_STRIPE(0), C_NFA_REGEX_CACHE_STRIPE(1), C_NFA_REGEX_CACHE_STRIPE(2), C_NFA_REGEX_CACHE_STRIPE(3),
+	C_NFA_REGEX_CACHE_STRIPE(4), C_NFA_REGEX_CACHE_STRIPE(5), C_NFA_REGEX_CACHE_STRIPE(6), C_NFA_REGEX_CACHE_STRIPE(7),
+	C_NFA_REGEX_CACHE_STRIPE(8), C_NFA_REGEX_CACHE_STRIPE(9), C_NFA_REGEX_CACHE_STRIPE(10), C_NFA_REGEX_CACHE_STRIPE(11),
+	C_NFA_REGEX_CACHE_STRIPE(12), C_NFA_REGEX_CACHE_STRIPE(13), C_NFA_REGEX_CACHE_STRIPE(14), C_NFA_REGEX_CACHE_STRIPE(15)
+};
+
+// FNV-1a, the low bits pick the stripe and the rest the bucket
+uint64_t regex_cache_hash(const char* pattern)
+{
+	uint64_t hash = 14695981039346656037ULL;
+	for (const unsigned char* c = (const unsigned char*)pattern; *c != '\0'; ++c)
+	{
+		hash ^= *c;
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+size_t regex_cache_bucket(const regex_cache_stripe* stripe, uint64_t hash)
+{
+	return (size_t)(hash / C_NFA_REGEX_CACHE_STRIPES) & (stripe->buckets_len - 1);
+}
+
+regex_cache_entry* regex_cache_entry_compile(const char* pattern, uint64_t hash)
+{
+	regex_cache_entry* entry = malloc(sizeof(regex_cache_entry));
+	size_t pattern_len = strlen(pattern);
+	entry->pattern = malloc(pattern_len + 1);
+	memcpy(entry->pattern, pattern, pattern_len + 1);
+	entry->hash = hash;
+	entry->glushkov = NULL;
+	entry->frozen = NULL;
+
+	regex_t* regex = regex_parse(pattern);
+	if (regex != NULL)
+	{
+		entry->glushkov = regex_to_glushkov(regex);
+		regex_free(regex);
+		if (entry->glushkov == NULL)
+		{
+			entry->frozen = regex_compile(pattern);
+		}
+	}
+	return entry;
+}
+
+void regex_cache_entry_free(regex_cache_entry* entry)
+{
+	if (entry->glushkov != NULL)
+	{
+		nfa_glushkov_machine_free(entry->glushkov);
+	}
+	if (entry->frozen != NULL)
+	{
+		nfa_frozen_machine_free(entry->frozen);
+	}
+	free(entry->pattern);
+	free(entry);
+}
+
+regex_cache_entry* regex_cache_stripe_find(const regex_cache_stripe* stripe, const char* pattern, uint64_t hash)
+{
+	if (stripe->buckets_len == 0)
+	{
+		return NULL;
+	}
+	for (regex_cache_entry* entry = stripe->buckets[regex_cache_bucket(stripe, hash)]; entry != NULL; entry = entry->bucket_next)
+	{
+		if (entry->hash == hash && strcmp(entry->pattern, pattern) == 0)
+		{
+			return entry;
+		}
+	}
+	return NULL;
+}
+
+void regex_cache_stripe_unlink_lru(regex_cache_stripe* stripe, regex_cache_entry* entry)
+{
+	if (entry->lru_prev != NULL)
+	{
+		entry->lru_prev->lru_next = entry->lru_next;
+	}
+	else
+	{
+		stripe->lru_head = entry->lru_next;
+	}
+	if (entry->lru_next != NULL)
+	{
+		entry->lru_next->lru_prev = entry->lru_prev;
+	}
+	else
+	{
+		stripe->lru_tail = entry->lru_prev;
+	}
+}
+
+void regex_cache_stripe_push_lru(regex_cache_stripe* stripe, regex_cache_entry* entry)
+{
+	entry->lru_prev = NULL;
+	entry->lru_next = stripe->lru_head;
+	if (stripe->lru_head != NULL)
+	{
+		stripe->lru_head->lru_prev = entry;
+	}
+	stripe->lru_head = entry;
+	if (stripe->lru_tail == NULL)
+	{
+		stripe->lru_tail = entry;
+	}
+}
+
+void regex_cache_stripe_insert(regex_cache_stripe* stripe, regex_cache_entry* entry)
+{
+	// keep at most one entry per bucket on average
+	if (stripe->entries_len >= stripe->buckets_len)
+	{
+		size_t buckets_len = stripe->buckets_len == 0 ? 16 : 2 * stripe->buckets_len;
+		regex_cache_entry** buckets = calloc(buckets_len, sizeof(regex_cache_entry*));
+		regex_cache_entry** old_buckets = stripe->buckets;
+		size_t old_buckets_len = stripe->buckets_len;
+		stripe->buckets = buckets;
+		stripe->buckets_len = buckets_len;
+		for (size_t bucket = 0; bucket < old_buckets_len; ++bucket)
+		{
+			regex_cache_entry* moved = old_buckets[bucket];
+			while (moved != NULL)
+			{
+				regex_cache_entry* next = moved->bucket_next;
+				size_t new_bucket = regex_cache_bucket(stripe, moved->hash);
+				moved->bucket_next = buckets[new_bucket];
+				buckets[new_bucket] = moved;
+				moved = next;
+			}
+		}
+		free(old_buckets);
+	}
+
+	size_t bucket = regex_cache_bucket(stripe, entry->hash);
+	entry->bucket_next = stripe->buckets[bucket];
+	stripe->buckets[bucket] = entry;
+	regex_cache_stripe_push_lru(stripe, entry);
+	++stripe->entries_len;
+}
+
+// Drops the cache's reference, the entry is freed once nobody is executing it either
+void regex_cache_stripe_remove(regex_cache_stripe* stripe, regex_cache_entry* entry)
+{
+	regex_cache_entry** link = &stripe->buckets[regex_cache_bucket(stripe, entry->hash)];
+	while (*link != entry)
+	{
+		link = &(*link)->bucket_next;
+	}
+	*link = entry->bucket_next;
+	regex_cache_stripe_unlink_lru(stripe, entry);
+	--stripe->entries_len;
+
+	if (--entry->references == 0)
+	{
+		regex_cache_entry_free(entry);
+	}
+}
+
+void regex_cache_stripe_evict(regex_cache_stripe* stripe)
+{
+	while (stripe->entries_len > stripe->capacity)
+	{
+		regex_cache_stripe_remove(stripe, stripe->lru_tail);
+		++stripe->evictions;
+	}
+}
+
+regex_cache_entry* regex_cache_acquire(const char* regex)
+{
+	uint64_t hash = regex_cache_hash(regex);
+	regex_cache_stripe* stripe = &regex_cache_stripes[hash % C_NFA_REGEX_CACHE_STRIPES];
+
+	c_nfa_mutex_lock(&stripe->mutex);
+	if (stripe->capacity == 0)
+	{
+		c_nfa_mutex_unlock(&stripe->mutex);
+		return NULL;
+	}
+	regex_cache_entry* entry = regex_cache_stripe_find(stripe, regex, hash);
+	if (entry != NULL)
+	{
+		++stripe->hits;
+		++entry->references;
+		regex_cache_stripe_unlink_lru(stripe, entry);
+		regex_cache_stripe_push_lru(stripe, entry);
+		c_nfa_mutex_unlock(&stripe->mutex);
+		return entry;
+	}
+	++stripe->misses;
+	c_nfa_mutex_unlock(&stripe->mutex);
+
+	// compile without holding the lock, if another thread cached the same pattern meanwhile its entry is used
+	regex_cache_entry* compiled = regex_cache_entry_compile(regex, hash);
+
+	c_nfa_mutex_lock(&stripe->mutex);
+	entry = regex_cache_stripe_find(stripe, regex, hash);
+	if (entry != NULL)
+	{
+		++entry->references;
+		c_nfa_mutex_unlock(&stripe->mutex);
+		regex_cache_entry_free(compiled);
+		return entry;
+	}
+	compiled->references = 2;
+	regex_cache_stripe_insert(stripe, compiled);
+	regex_cache_stripe_evict(stripe);
+	c_nfa_mutex_unlock(&stripe->mutex);
+	return compiled;
+}
+
+void regex_cache_release(regex_cache_entry* entry)
+{
+	regex_cache_stripe* stripe = &regex_cache_stripes[entry->hash % C_NFA_REGEX_CACHE_STRIPES];
+	c_nfa_mutex_lock(&stripe->mutex);
+	size_t references = --entry->references;
+	c_nfa_mutex_unlock(&stripe->mutex);
+
+	if (references == 0)
+	{
+		regex_cache_entry_free(entry);
+	}
+}
+
+int regex_cache_entry_execute_n(const regex_cache_entry* entry, const uint8_t* data, size_t len)
+{
+	if (entry->glushkov != NULL)
+	{
+		return nfa_glushkov_machine_execute_n(entry->glushkov, data, len);
+	}
+	if (entry->frozen != NULL)
+	{
+		return nfa_frozen_machine_execute_n(entry->frozen, data, len, nfa_exec_scratch_thread());
+	}
+	return 0;
+}
+
+void regex_cache_set_capacity(size_t capacity)
+{
+	for (size_t stripe_index = 0; stripe_index < C_NFA_REGEX_CACHE_STRIPES; ++stripe_index)
+	{
+		regex_cache_stripe* stripe = &regex_cache_stripes[stripe_index];
+		c_nfa_mutex_lock(&stripe->mutex);
+		stripe->capacity = capacity / C_NFA_REGEX_CACHE_STRIPES + (stripe_index < capacity % C_NFA_REGEX_CACHE_STRIPES);
+		regex_cache_stripe_evict(stripe);
+		c_nfa_mutex_unlock(&stripe->mutex);
+	}
+}
+
+void regex_cache_get_stats(regex_cache_stats* stats)
+{
+	memset(stats, 0, sizeof(regex_cache_stats));
+	for (size_t stripe_index = 0; stripe_index < C_NFA_REGEX_CACHE_STRIPES; ++stripe_index)
+	{
+		regex_cache_stripe* stripe = &regex_cache_stripes[stripe_index];
+		c_nfa_mutex_lock(&stripe->mutex);
+		stats->hits += stripe->hits;
+		stats->misses += stripe->misses;
+		stats->evictions += stripe->evictions;
+		stats->entries_len += stripe->entries_len;
+		stats->capacity += stripe->capacity;
+		c_nfa_mutex_unlock(&stripe->mutex);
+	}
+}
+
+void regex_cache_clear(void)
+{
+	for (size_t stripe_index = 0; stripe_index < C_NFA_REGEX_CACHE_STRIPES; ++stripe_index)
+	{
+		regex_cache_stripe* stripe = &regex_cache_stripes[stripe_index];
+		c_nfa_mutex_lock(&stripe->mutex);
+		while (stripe->lru_tail != NULL)
+		{
+			regex_cache_stripe_remove(stripe, stripe->lru_tail);
+		}
+		free(stripe->buckets);
+		stripe->buckets = NULL;
+		stripe->buckets_len = 0;
+		stripe->hits = 0;
+		stripe->misses = 0;
+		stripe->evictions = 0;
+		c_nfa_mutex_unlock(&stripe->mutex);
+	}
+}
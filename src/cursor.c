@@ -0,0 +1,80 @@
+#include <c_nfa/cursor.h>
+#include <c_nfa/stream.h>
+
+#include <stdlib.h>
+
+struct nfa_cursor
+{
+	nfa_stream* stream;
+	const uint8_t* data;
+	size_t len;
+	size_t position;
+	const volatile int* cancel;
+	int cancelled;
+};
+
+nfa_cursor* nfa_cursor_begin(const nfa_frozen_machine* machine, const uint8_t* data, size_t len, const volatile int* cancel)
+{
+	nfa_cursor* cursor = malloc(sizeof(nfa_cursor));
+	cursor->stream = nfa_stream_begin(machine);
+	cursor->data = data;
+	cursor->len = len;
+	cursor->position = 0;
+	cursor->cancel = cancel;
+	cursor->cancelled = 0;
+	return cursor;
+}
+
+nfa_exec_status nfa_cursor_resume(nfa_cursor* cursor, const nfa_exec_budget* budget)
+{
+	size_t steps_left = budget != NULL && budget->max_steps != 0 ? budget->max_steps : SIZE_MAX;
+	size_t bytes_left = budget != NULL && budget->max_bytes != 0 ? budget->max_bytes : SIZE_MAX;
+	size_t start = cursor->position;
+
+	for (;;)
+	{
+		if (cursor->position == cursor->len || nfa_stream_is_dead(cursor->stream))
+		{
+			return nfa_stream_is_accepting(cursor->stream) ? NFA_ACCEPTED : NFA_REJECTED;
+		}
+		cursor->cancelled = cursor->cancelled || (cursor->cancel != NULL && *cursor->cancel != 0);
+		if (cursor->cancelled)
+		{
+			return NFA_CANCELLED;
+		}
+		if (bytes_left == 0)
+		{
+			return NFA_IN_PROGRESS;
+		}
+
+		size_t chunk_len = cursor->len - cursor->position;
+		chunk_len = chunk_len < bytes_left ? chunk_len : bytes_left;
+		chunk_len = chunk_len < C_NFA_CURSOR_CANCEL_INTERVAL ? chunk_len : C_NFA_CURSOR_CANCEL_INTERVAL;
+
+		size_t consumed = nfa_stream_feed_budget(cursor->stream, cursor->data + cursor->position, chunk_len, &steps_left);
+		if (consumed == 0)
+		{
+			if (cursor->position != start)
+			{
+				return NFA_IN_PROGRESS;
+			}
+			// the next byte alone costs more than the whole budget, take it anyway so the cursor always moves
+			nfa_stream_feed(cursor->stream, cursor->data + cursor->position, 1);
+			consumed = 1;
+			steps_left = 0;
+		}
+		cursor->position += consumed;
+		bytes_left -= consumed;
+	}
+}
+
+size_t nfa_cursor_position(const nfa_cursor* cursor)
+{
+	return cursor->position;
+}
+
+void nfa_cursor_free(nfa_cursor* cursor)
+{
+	nfa_stream_end(cursor->stream);
+	free(cursor);
+}
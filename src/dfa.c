@@ -0,0 +1,492 @@
+#include <c_nfa/dfa.h>
+#include <c_nfa/frozen.h>
+
+#include "util.h"
+#include "state_set.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Every DFA state built so far during subset construction, keyed by its sorted set of NFA states
+typedef struct
+{
+	uint32_t* set_pool;
+	size_t set_pool_len;
+	size_t set_pool_capacity;
+	uint32_t* set_offsets;
+	uint32_t* set_lens;
+	uint32_t* transitions;
+	uint32_t classes_len;
+	uint32_t states_len;
+	uint32_t states_capacity;
+
+	// open addressing table, slots hold state + 1 and 0 when empty
+	uint32_t* table;
+	size_t table_capacity;
+} dfa_subset_index;
+
+void dfa_subset_index_table_insert(dfa_subset_index* index, uint32_t dfa_state)
+{
+	size_t mask = index->table_capacity - 1;
+	size_t slot = nfa_frozen_states_hash(index->set_pool + index->set_offsets[dfa_state], index->set_lens[dfa_state]) & mask;
+	while (index->table[slot] != 0)
+	{
+		slot = (slot + 1) & mask;
+	}
+	index->table[slot] = dfa_state + 1;
+}
+
+// Returns the DFA state for a sorted set of NFA states, adding it if needed, or -1 if that would exceed max_states
+int64_t dfa_subset_index_find_or_add(dfa_subset_index* index, const uint32_t* states, uint32_t states_len, size_t max_states)
+{
+	size_t mask = index->table_capacity - 1;
+	size_t slot = nfa_frozen_states_hash(states, states_len) & mask;
+	while (index->table[slot] != 0)
+	{
+		uint32_t dfa_state = index->table[slot] - 1;
+		if (index->set_lens[dfa_state] == states_len && memcmp(index->set_pool + index->set_offsets[dfa_state], states, states_len * sizeof(uint32_t)) == 0)
+		{
+			return dfa_state;
+		}
+		slot = (slot + 1) & mask;
+	}
+
+	if (index->states_len >= max_states)
+	{
+		return -1;
+	}
+
+	if (index->states_len == index->states_capacity)
+	{
+		index->states_capacity = C_NFA_MAX(index->states_capacity * 2, 16);
+		index->set_offsets = realloc(index->set_offsets, index->states_capacity * sizeof(uint32_t));
+		index->set_lens = realloc(index->set_lens, index->states_capacity * sizeof(uint32_t));
+		index->transitions = realloc(index->transitions, (size_t)index->states_capacity * index->classes_len * sizeof(uint32_t));
+	}
+	if (index->set_pool_len + states_len > index->set_pool_capacity)
+	{
+		index->set_pool_capacity = C_NFA_MAX(index->set_pool_capacity * 2, index->set_pool_len + states_len);
+		index->set_pool = realloc(index->set_pool, index->set_pool_capacity * sizeof(uint32_t));
+	}
+
+	uint32_t dfa_state = index->states_len++;
+	if (states_len > 0)
+	{
+		memcpy(index->set_pool + index->set_pool_len, states, states_len * sizeof(uint32_t));
+	}
+	index->set_offsets[dfa_state] = (uint32_t)index->set_pool_len;
+	index->set_lens[dfa_state] = states_len;
+	index->set_pool_len += states_len;
+
+	// keep the table at most half full
+	if (2 * (size_t)index->states_len > index->table_capacity)
+	{
+		index->table_capacity *= 2;
+		index->table = realloc(index->table, index->table_capacity * sizeof(uint32_t));
+		memset(index->table, 0, index->table_capacity * sizeof(uint32_t));
+		for (uint32_t state = 0; state < index->states_len; ++state)
+		{
+			dfa_subset_index_table_insert(index, state);
+		}
+	}
+	else
+	{
+		dfa_subset_index_table_insert(index, dfa_state);
+	}
+
+	return dfa_state;
+}
+
+dfa_machine* dfa_machine_alloc(uint32_t states_len, uint32_t classes_len, const uint8_t* byte_classes)
+{
+	dfa_machine* machine = malloc(sizeof(dfa_machine));
+	machine->states_len = states_len;
+	machine->start_state_index = 0;
+	machine->dead_state_index = DFA_NO_DEAD_STATE;
+	machine->classes_len = classes_len;
+	memcpy(machine->byte_classes, byte_classes, sizeof(machine->byte_classes));
+	machine->transitions = malloc((size_t)states_len * classes_len * sizeof(uint32_t));
+	machine->final_states = calloc(states_len, sizeof(unsigned char));
+	machine->borrowed = 0;
+	return machine;
+}
+
+void dfa_machine_free(dfa_machine* machine)
+{
+	if (!machine->borrowed)
+	{
+		free(machine->transitions);
+		free(machine->final_states);
+	}
+	free(machine);
+}
+
+dfa_machine* nfa_to_dfa(const nfa_machine* machine, size_t max_states)
+{
+	nfa_frozen_machine* frozen = nfa_machine_freeze(machine);
+	if (frozen == NULL)
+	{
+		return NULL;
+	}
+	uint32_t nfa_states_len = frozen->states_len;
+
+	dfa_subset_index index = { 0 };
+	index.table_capacity = 64;
+	index.table = calloc(index.table_capacity, sizeof(uint32_t));
+	index.classes_len = frozen->classes_len;
+
+	// the sets are sorted before being looked up, which leaves graph_states out of step with dense, so graph
+	// states are looked up again when a DFA state is expanded
+	uint32_t* scratch = calloc(7 * (size_t)nfa_states_len, sizeof(uint32_t));
+	nfa_frozen_state_set current = { .dense = scratch, .sparse = scratch + nfa_states_len, .graph_states = scratch + 2 * (size_t)nfa_states_len, .len = 0 };
+	nfa_frozen_state_set next = { .dense = scratch + 3 * (size_t)nfa_states_len, .sparse = scratch + 4 * (size_t)nfa_states_len, .graph_states = scratch + 5 * (size_t)nfa_states_len, .len = 0 };
+	uint32_t* stack = scratch + 6 * (size_t)nfa_states_len;
+
+	// targets of the character transitions out of a DFA state, bucketed by byte class. Every transition
+	// label is a class of its own, so each transition lands in exactly one bucket
+	uint32_t classes_len = frozen->classes_len;
+	size_t targets_capacity = 64;
+	uint32_t* targets = malloc(targets_capacity * sizeof(uint32_t));
+	uint32_t target_offsets[257];
+
+	int failed = 0;
+	int64_t dead_state = -1;
+
+	nfa_frozen_state_set_add_closure(frozen, &next, frozen->start_state_index, nfa_frozen_graph_state(frozen, frozen->start_state_index), stack);
+	qsort(next.dense, next.len, sizeof(uint32_t), nfa_frozen_states_compare);
+	failed = dfa_subset_index_find_or_add(&index, next.dense, next.len, max_states) < 0;
+
+	// every state added is processed once, in order, so the state list doubles as the work queue
+	for (uint32_t dfa_state = 0; !failed && dfa_state < index.states_len; ++dfa_state)
+	{
+		memcpy(current.dense, index.set_pool + index.set_offsets[dfa_state], index.set_lens[dfa_state] * sizeof(uint32_t));
+		current.len = index.set_lens[dfa_state];
+
+		memset(target_offsets, 0, sizeof(target_offsets));
+		size_t targets_len = 0;
+		for (uint32_t set_index = 0; set_index < current.len; ++set_index)
+		{
+			uint32_t graph_state = nfa_frozen_graph_state(frozen, current.dense[set_index]);
+			for (uint32_t edge_index = frozen->byte_offsets[graph_state]; edge_index < frozen->byte_offsets[graph_state + 1]; ++edge_index)
+			{
+				// a range covers a run of whole classes, see nfa_frozen_build_byte_classes
+				const nfa_frozen_edge* edge = &frozen->byte_edges[edge_index];
+				for (uint32_t class_index = frozen->byte_classes[edge->rule]; class_index <= frozen->byte_classes[edge->rule_last]; ++class_index)
+				{
+					++target_offsets[class_index + 1];
+					++targets_len;
+				}
+			}
+		}
+		for (size_t class_index = 0; class_index < classes_len; ++class_index)
+		{
+			target_offsets[class_index + 1] += target_offsets[class_index];
+		}
+		if (targets_len > targets_capacity)
+		{
+			targets_capacity = C_NFA_MAX(targets_capacity * 2, targets_len);
+			targets = realloc(targets, targets_capacity * sizeof(uint32_t));
+		}
+		uint32_t cursors[256];
+		memcpy(cursors, target_offsets, classes_len * sizeof(uint32_t));
+		for (uint32_t set_index = 0; set_index < current.len; ++set_index)
+		{
+			uint32_t state = current.dense[set_index];
+			uint32_t graph_state = nfa_frozen_graph_state(frozen, state);
+			for (uint32_t edge_index = frozen->byte_offsets[graph_state]; edge_index < frozen->byte_offsets[graph_state + 1]; ++edge_index)
+			{
+				const nfa_frozen_edge* edge = &frozen->byte_edges[edge_index];
+				uint32_t to_state = nfa_frozen_state_target(frozen, state, graph_state, edge->to_state_index);
+				for (uint32_t class_index = frozen->byte_classes[edge->rule]; class_index <= frozen->byte_classes[edge->rule_last]; ++class_index)
+				{
+					targets[cursors[class_index]++] = to_state;
+				}
+			}
+		}
+
+		for (size_t class_index = 0; class_index < classes_len && !failed; ++class_index)
+		{
+			next.len = 0;
+			for (uint32_t target_index = target_offsets[class_index]; target_index < target_offsets[class_index + 1]; ++target_index)
+			{
+				nfa_frozen_state_set_add_closure(frozen, &next, targets[target_index], nfa_frozen_graph_state(frozen, targets[target_index]), stack);
+			}
+
+			int64_t next_state;
+			if (next.len == 0 && dead_state >= 0)
+			{
+				next_state = dead_state;
+			}
+			else
+			{
+				qsort(next.dense, next.len, sizeof(uint32_t), nfa_frozen_states_compare);
+				next_state = dfa_subset_index_find_or_add(&index, next.dense, next.len, max_states);
+				if (next.len == 0)
+				{
+					dead_state = next_state;
+				}
+			}
+
+			if (next_state < 0)
+			{
+				failed = 1;
+				break;
+			}
+			index.transitions[(size_t)dfa_state * classes_len + class_index] = (uint32_t)next_state;
+		}
+	}
+
+	dfa_machine* dfa = NULL;
+	if (!failed)
+	{
+		dfa = dfa_machine_alloc(index.states_len, classes_len, frozen->byte_classes);
+		dfa->start_state_index = 0;
+		dfa->dead_state_index = dead_state >= 0 ? (uint32_t)dead_state : DFA_NO_DEAD_STATE;
+		memcpy(dfa->transitions, index.transitions, (size_t)index.states_len * classes_len * sizeof(uint32_t));
+		for (uint32_t dfa_state = 0; dfa_state < index.states_len; ++dfa_state)
+		{
+			const uint32_t* states = index.set_pool + index.set_offsets[dfa_state];
+			for (uint32_t set_index = 0; set_index < index.set_lens[dfa_state]; ++set_index)
+			{
+				if (C_NFA_BITSET_HAS(frozen->final_bitmap, nfa_frozen_graph_state(frozen, states[set_index])))
+				{
+					dfa->final_states[dfa_state] = 1;
+					break;
+				}
+			}
+		}
+	}
+
+	free(targets);
+	free(scratch);
+	free(index.set_pool);
+	free(index.set_offsets);
+	free(index.set_lens);
+	free(index.transitions);
+	free(index.table);
+	nfa_frozen_machine_free(frozen);
+
+	return dfa;
+}
+
+// Partition of the DFA states refined in place, block b holds elements[first[b], end[b]) and
+// the elements of a block that have been marked during a split are kept in [first[b], mid[b])
+typedef struct
+{
+	uint32_t* elements;
+	uint32_t* location; // location[state] is the index of state in elements
+	uint32_t* block_of;
+	uint32_t* first;
+	uint32_t* mid;
+	uint32_t* end;
+	uint32_t blocks_len;
+} dfa_partition;
+
+void dfa_partition_mark(dfa_partition* partition, uint32_t state, uint32_t* touched, uint32_t* touched_len)
+{
+	uint32_t block = partition->block_of[state];
+	uint32_t location = partition->location[state];
+	if (location < partition->mid[block])
+	{
+		// already marked
+		return;
+	}
+	if (partition->mid[block] == partition->first[block])
+	{
+		touched[(*touched_len)++] = block;
+	}
+
+	// swap state to the end of the marked prefix
+	uint32_t swap_location = partition->mid[block]++;
+	uint32_t swap_state = partition->elements[swap_location];
+	partition->elements[swap_location] = state;
+	partition->location[state] = swap_location;
+	partition->elements[location] = swap_state;
+	partition->location[swap_state] = location;
+}
+
+dfa_machine* dfa_minimize(const dfa_machine* machine)
+{
+	uint32_t states_len = machine->states_len;
+	uint32_t classes_len = machine->classes_len;
+
+	// predecessors of every state for every byte class, in compressed-sparse-row order keyed by (class, to_state)
+	uint32_t* inverse_offsets = calloc((size_t)states_len * classes_len + 1, sizeof(uint32_t));
+	uint32_t* inverse_states = malloc((size_t)states_len * classes_len * sizeof(uint32_t));
+	for (uint32_t state = 0; state < states_len; ++state)
+	{
+		for (size_t class_index = 0; class_index < classes_len; ++class_index)
+		{
+			++inverse_offsets[class_index * states_len + machine->transitions[(size_t)state * classes_len + class_index] + 1];
+		}
+	}
+	for (size_t key = 0; key < (size_t)states_len * classes_len; ++key)
+	{
+		inverse_offsets[key + 1] += inverse_offsets[key];
+	}
+	uint32_t* cursors = malloc((size_t)states_len * classes_len * sizeof(uint32_t));
+	memcpy(cursors, inverse_offsets, (size_t)states_len * classes_len * sizeof(uint32_t));
+	for (uint32_t state = 0; state < states_len; ++state)
+	{
+		for (size_t class_index = 0; class_index < classes_len; ++class_index)
+		{
+			inverse_states[cursors[class_index * states_len + machine->transitions[(size_t)state * classes_len + class_index]]++] = state;
+		}
+	}
+	free(cursors);
+
+	dfa_partition partition;
+	partition.elements = malloc(states_len * sizeof(uint32_t));
+	partition.location = malloc(states_len * sizeof(uint32_t));
+	partition.block_of = malloc(states_len * sizeof(uint32_t));
+	partition.first = malloc(states_len * sizeof(uint32_t));
+	partition.mid = malloc(states_len * sizeof(uint32_t));
+	partition.end = malloc(states_len * sizeof(uint32_t));
+	partition.blocks_len = 0;
+
+	// initial partition, final states and non-final states
+	uint32_t elements_len = 0;
+	for (int is_final = 1; is_final >= 0; --is_final)
+	{
+		uint32_t block_first = elements_len;
+		for (uint32_t state = 0; state < states_len; ++state)
+		{
+			if (machine->final_states[state] == is_final)
+			{
+				partition.elements[elements_len] = state;
+				partition.location[state] = elements_len;
+				partition.block_of[state] = partition.blocks_len;
+				++elements_len;
+			}
+		}
+		if (elements_len > block_first)
+		{
+			partition.first[partition.blocks_len] = block_first;
+			partition.mid[partition.blocks_len] = block_first;
+			partition.end[partition.blocks_len] = elements_len;
+			++partition.blocks_len;
+		}
+	}
+
+	// blocks waiting to be used as splitters
+	uint32_t* waiting = malloc(states_len * sizeof(uint32_t));
+	unsigned char* is_waiting = calloc(states_len, sizeof(unsigned char));
+	uint32_t waiting_len = 0;
+	for (uint32_t block = 0; block < partition.blocks_len; ++block)
+	{
+		waiting[waiting_len++] = block;
+		is_waiting[block] = 1;
+	}
+
+	uint32_t* splitter = malloc(states_len * sizeof(uint32_t));
+	uint32_t* touched = malloc(states_len * sizeof(uint32_t));
+
+	while (waiting_len > 0)
+	{
+		uint32_t splitter_block = waiting[--waiting_len];
+		is_waiting[splitter_block] = 0;
+
+		// the splitter block can itself be split below, so work from a copy of its states
+		uint32_t splitter_len = partition.end[splitter_block] - partition.first[splitter_block];
+		memcpy(splitter, partition.elements + partition.first[splitter_block], splitter_len * sizeof(uint32_t));
+
+		for (size_t class_index = 0; class_index < classes_len; ++class_index)
+		{
+			uint32_t touched_len = 0;
+			for (uint32_t splitter_index = 0; splitter_index < splitter_len; ++splitter_index)
+			{
+				size_t key = class_index * states_len + splitter[splitter_index];
+				for (uint32_t index = inverse_offsets[key]; index < inverse_offsets[key + 1]; ++index)
+				{
+					dfa_partition_mark(&partition, inverse_states[index], touched, &touched_len);
+				}
+			}
+
+			for (uint32_t touched_index = 0; touched_index < touched_len; ++touched_index)
+			{
+				uint32_t block = touched[touched_index];
+				if (partition.mid[block] == partition.end[block])
+				{
+					// every state of the block was marked, nothing to split
+					partition.mid[block] = partition.first[block];
+					continue;
+				}
+
+				// the marked prefix becomes a new block
+				uint32_t new_block = partition.blocks_len++;
+				partition.first[new_block] = partition.first[block];
+				partition.mid[new_block] = partition.first[block];
+				partition.end[new_block] = partition.mid[block];
+				partition.first[block] = partition.mid[block];
+				for (uint32_t location = partition.first[new_block]; location < partition.end[new_block]; ++location)
+				{
+					partition.block_of[partition.elements[location]] = new_block;
+				}
+
+				if (is_waiting[block])
+				{
+					waiting[waiting_len++] = new_block;
+					is_waiting[new_block] = 1;
+				}
+				else
+				{
+					uint32_t smaller = partition.end[new_block] - partition.first[new_block] <= partition.end[block] - partition.first[block] ? new_block : block;
+					waiting[waiting_len++] = smaller;
+					is_waiting[smaller] = 1;
+				}
+			}
+		}
+	}
+
+	// one state per block, any member of a block can stand for it
+	dfa_machine* minimal = dfa_machine_alloc(partition.blocks_len, classes_len, machine->byte_classes);
+	for (uint32_t block = 0; block < partition.blocks_len; ++block)
+	{
+		uint32_t representative = partition.elements[partition.first[block]];
+		minimal->final_states[block] = machine->final_states[representative];
+		for (size_t class_index = 0; class_index < classes_len; ++class_index)
+		{
+			minimal->transitions[(size_t)block * classes_len + class_index] = partition.block_of[machine->transitions[(size_t)representative * classes_len + class_index]];
+		}
+	}
+	minimal->start_state_index = partition.block_of[machine->start_state_index];
+	minimal->dead_state_index = machine->dead_state_index == DFA_NO_DEAD_STATE ? DFA_NO_DEAD_STATE : partition.block_of[machine->dead_state_index];
+
+	free(inverse_offsets);
+	free(inverse_states);
+	free(partition.elements);
+	free(partition.location);
+	free(partition.block_of);
+	free(partition.first);
+	free(partition.mid);
+	free(partition.end);
+	free(waiting);
+	free(is_waiting);
+	free(splitter);
+	free(touched);
+
+	return minimal;
+}
+
+int dfa_machine_execute_n(const dfa_machine* machine, const uint8_t* data, size_t len)
+{
+	const uint32_t* transitions = machine->transitions;
+	const uint8_t* byte_classes = machine->byte_classes;
+	size_t classes_len = machine->classes_len;
+	uint32_t state = machine->start_state_index;
+
+	for (size_t data_index = 0; data_index < len; ++data_index)
+	{
+		state = transitions[(size_t)state * classes_len + byte_classes[data[data_index]]];
+		if (state == machine->dead_state_index)
+		{
+			return 0;
+		}
+	}
+
+	return machine->final_states[state];
+}
+
+int dfa_machine_execute(const dfa_machine* machine, const char* string)
+{
+	return dfa_machine_execute_n(machine, (const uint8_t*)string, strlen(string));
+}
@@ -0,0 +1,729 @@
+#include <c_nfa/frozen.h>
+
+#include "util.h"
+#include "state_set.h"
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+// Bucket edges by from_state_index, offsets must be zeroed and hold states_len + 1 entries
+void nfa_frozen_count_edges(const nfa_machine* machine, uint32_t* epsilon_offsets, uint32_t* byte_offsets, uint32_t states_len)
+{
+	for (size_t transition_index = 0; transition_index < machine->transitions_len; ++transition_index)
+	{
+		const nfa_transition* transition = &machine->transitions[transition_index];
+		uint32_t* offsets = transition->rule == C_NFA_EPSILON ? epsilon_offsets : byte_offsets;
+		++offsets[transition->from_state_index + 1];
+	}
+
+	for (uint32_t state = 0; state < states_len; ++state)
+	{
+		epsilon_offsets[state + 1] += epsilon_offsets[state];
+		byte_offsets[state + 1] += byte_offsets[state];
+	}
+}
+
+// Compute the e-closure of every state once, so execution can jump straight to it after each character
+void nfa_frozen_build_closures(nfa_frozen_machine* frozen)
+{
+	uint32_t states_len = frozen->graph_states_len;
+
+	uint32_t* offsets = malloc((states_len + 1) * sizeof(uint32_t));
+	size_t closure_states_capacity = states_len;
+	size_t closure_states_len = 0;
+	uint32_t* closure_states = malloc(C_NFA_MAX(closure_states_capacity, 1) * sizeof(uint32_t));
+
+	// seen[u] == s + 1 marks u as visited while computing the closure of s, so seen is never cleared
+	uint32_t* seen = calloc(states_len, sizeof(uint32_t));
+	uint32_t* stack = malloc(states_len * sizeof(uint32_t));
+	C_NFA_STATS_ADD(allocations, 4);
+
+	for (uint32_t state = 0; state < states_len; ++state)
+	{
+		offsets[state] = (uint32_t)closure_states_len;
+
+		uint32_t stack_len = 0;
+		stack[stack_len++] = state;
+		seen[state] = state + 1;
+		while (stack_len > 0)
+		{
+			uint32_t top = stack[--stack_len];
+
+			int is_important = frozen->byte_offsets[top] != frozen->byte_offsets[top + 1] || C_NFA_BITSET_HAS(frozen->final_bitmap, top);
+			if (is_important)
+			{
+				if (closure_states_len == C_NFA_CLOSURE_TABLE_MAX)
+				{
+					// too big to be worth keeping, execution falls back to walking e-transitions
+					free(offsets);
+					free(closure_states);
+					free(seen);
+					free(stack);
+					return;
+				}
+				if (closure_states_len == closure_states_capacity)
+				{
+					closure_states_capacity *= 2;
+					closure_states = realloc(closure_states, closure_states_capacity * sizeof(uint32_t));
+					C_NFA_STATS_ADD(allocations, 1);
+				}
+				closure_states[closure_states_len++] = top;
+			}
+
+			for (uint32_t index = frozen->epsilon_offsets[top]; index < frozen->epsilon_offsets[top + 1]; ++index)
+			{
+				uint32_t to_state = frozen->epsilon_targets[index];
+				if (seen[to_state] != state + 1)
+				{
+					seen[to_state] = state + 1;
+					stack[stack_len++] = to_state;
+				}
+			}
+		}
+	}
+	offsets[states_len] = (uint32_t)closure_states_len;
+
+	free(seen);
+	free(stack);
+
+	frozen->closure_offsets = offsets;
+	frozen->closure_states = closure_states;
+}
+
+// Bytes between two boundaries share a class, a boundary is placed at the start of every transition's
+// range and just after its end, so each range covers a run of whole classes
+void nfa_frozen_build_byte_classes(nfa_frozen_machine* frozen, const nfa_machine* machine)
+{
+	unsigned char boundaries[257] = { 0 };
+	for (size_t transition_index = 0; transition_index < machine->transitions_len; ++transition_index)
+	{
+		const nfa_transition* transition = &machine->transitions[transition_index];
+		if (transition->rule != C_NFA_EPSILON)
+		{
+			boundaries[transition->rule] = 1;
+			boundaries[transition->rule_last + 1] = 1;
+		}
+	}
+
+	uint32_t class_index = 0;
+	for (size_t c = 0; c < 256; ++c)
+	{
+		if (c > 0 && boundaries[c])
+		{
+			++class_index;
+		}
+		frozen->byte_classes[c] = (uint8_t)class_index;
+	}
+	frozen->classes_len = class_index + 1;
+}
+
+int nfa_frozen_counters_compare(const void* a, const void* b)
+{
+	const nfa_frozen_counter* counter_a = a;
+	const nfa_frozen_counter* counter_b = b;
+	if (counter_a->first_state_index != counter_b->first_state_index)
+	{
+		return counter_a->first_state_index < counter_b->first_state_index ? -1 : 1;
+	}
+	return (counter_a->states_len < counter_b->states_len) - (counter_a->states_len > counter_b->states_len);
+}
+
+// Sorts the counters, links each one to the body holding it, and numbers the states of every graph state.
+// Returns 0 if that would take more than C_NFA_FROZEN_STATES_MAX states
+int nfa_frozen_build_counters(nfa_frozen_machine* frozen, const nfa_machine* machine)
+{
+	frozen->counters_len = (uint32_t)machine->counters_len;
+	frozen->counters = NULL;
+	frozen->pass_offsets = NULL;
+	frozen->graph_state_counters = NULL;
+	frozen->states_len = frozen->graph_states_len;
+	if (machine->counters_len == 0)
+	{
+		return 1;
+	}
+
+	frozen->counters = malloc(machine->counters_len * sizeof(nfa_frozen_counter));
+	for (size_t counter_index = 0; counter_index < machine->counters_len; ++counter_index)
+	{
+		const nfa_counter* counter = &machine->counters[counter_index];
+		size_t passes = counter->max == C_NFA_COUNTER_UNBOUNDED ? C_NFA_MAX(counter->min, 1) : counter->max;
+		if (passes > C_NFA_FROZEN_STATES_MAX)
+		{
+			frozen->counters_len = 0;
+			return 0;
+		}
+		nfa_frozen_counter* frozen_counter = &frozen->counters[counter_index];
+		frozen_counter->first_state_index = (uint32_t)counter->first_state_index;
+		frozen_counter->states_len = (uint32_t)counter->states_len;
+		frozen_counter->last_state_index = (uint32_t)counter->last_state_index;
+		frozen_counter->exit_state_index = (uint32_t)counter->exit_state_index;
+		frozen_counter->min = (uint32_t)counter->min;
+		frozen_counter->unbounded = counter->max == C_NFA_COUNTER_UNBOUNDED;
+		frozen_counter->passes = (uint32_t)passes;
+	}
+	qsort(frozen->counters, frozen->counters_len, sizeof(nfa_frozen_counter), nfa_frozen_counters_compare);
+
+	// walking the bodies in order, the innermost body still open when another starts is its parent
+	uint32_t* open = malloc(frozen->counters_len * sizeof(uint32_t));
+	uint32_t open_len = 0;
+	for (uint32_t counter_index = 0; counter_index < frozen->counters_len; ++counter_index)
+	{
+		nfa_frozen_counter* counter = &frozen->counters[counter_index];
+		while (open_len > 0 && counter->first_state_index - frozen->counters[open[open_len - 1]].first_state_index >= frozen->counters[open[open_len - 1]].states_len)
+		{
+			--open_len;
+		}
+		counter->parent = open_len > 0 ? open[open_len - 1] : C_NFA_NO_COUNTER;
+		open[open_len++] = counter_index;
+	}
+	free(open);
+
+	frozen->graph_state_counters = malloc((size_t)frozen->graph_states_len * sizeof(uint32_t));
+	for (uint32_t graph_state = 0; graph_state < frozen->graph_states_len; ++graph_state)
+	{
+		frozen->graph_state_counters[graph_state] = nfa_frozen_counter_search(frozen, graph_state);
+	}
+
+	frozen->pass_offsets = malloc(((size_t)frozen->graph_states_len + 1) * sizeof(uint32_t));
+	C_NFA_STATS_ADD(allocations, 4);
+	// passes are at most C_NFA_FROZEN_STATES_MAX, so stopping the product once it's past the limit keeps it in 64 bits
+	uint64_t states_len = 0;
+	for (uint32_t graph_state = 0; graph_state < frozen->graph_states_len; ++graph_state)
+	{
+		frozen->pass_offsets[graph_state] = (uint32_t)states_len;
+		uint64_t states = 1;
+		for (uint32_t counter_index = frozen->graph_state_counters[graph_state]; counter_index != C_NFA_NO_COUNTER && states <= C_NFA_FROZEN_STATES_MAX; counter_index = frozen->counters[counter_index].parent)
+		{
+			states *= frozen->counters[counter_index].passes;
+		}
+		states_len += states;
+		if (states_len > C_NFA_FROZEN_STATES_MAX)
+		{
+			return 0;
+		}
+	}
+	frozen->pass_offsets[frozen->graph_states_len] = (uint32_t)states_len;
+	frozen->states_len = (uint32_t)states_len;
+	frozen->start_state_index = frozen->pass_offsets[frozen->start_state_index];
+	return 1;
+}
+
+nfa_frozen_machine* nfa_machine_freeze(const nfa_machine* machine)
+{
+	uint32_t states_len = (uint32_t)get_machine_max_state_index(machine) + 1;
+
+	nfa_frozen_machine* frozen = malloc(sizeof(nfa_frozen_machine));
+	frozen->graph_states_len = states_len;
+	frozen->start_state_index = (uint32_t)machine->start_state_index;
+	frozen->epsilon_offsets = calloc(states_len + 1, sizeof(uint32_t));
+	frozen->byte_offsets = calloc(states_len + 1, sizeof(uint32_t));
+	frozen->final_bitmap = calloc(C_NFA_BITSET_WORDS(states_len), sizeof(uint64_t));
+
+	nfa_frozen_count_edges(machine, frozen->epsilon_offsets, frozen->byte_offsets, states_len);
+	frozen->epsilon_targets = malloc(C_NFA_MAX(frozen->epsilon_offsets[states_len], 1) * sizeof(uint32_t));
+	frozen->byte_edges = malloc(C_NFA_MAX(frozen->byte_offsets[states_len], 1) * sizeof(nfa_frozen_edge));
+
+	// fill each row using a cursor per state, this keeps the original transition order within a row
+	uint32_t* epsilon_cursors = malloc(states_len * sizeof(uint32_t));
+	uint32_t* byte_cursors = malloc(states_len * sizeof(uint32_t));
+	C_NFA_STATS_ADD(allocations, 8);
+	memcpy(epsilon_cursors, frozen->epsilon_offsets, states_len * sizeof(uint32_t));
+	memcpy(byte_cursors, frozen->byte_offsets, states_len * sizeof(uint32_t));
+
+	for (size_t transition_index = 0; transition_index < machine->transitions_len; ++transition_index)
+	{
+		const nfa_transition* transition = &machine->transitions[transition_index];
+		if (transition->rule == C_NFA_EPSILON)
+		{
+			frozen->epsilon_targets[epsilon_cursors[transition->from_state_index]++] = (uint32_t)transition->to_state_index;
+		}
+		else
+		{
+			nfa_frozen_edge* edge = &frozen->byte_edges[byte_cursors[transition->from_state_index]++];
+			edge->to_state_index = (uint32_t)transition->to_state_index;
+			edge->rule = (unsigned char)transition->rule;
+			edge->rule_last = (unsigned char)transition->rule_last;
+		}
+	}
+
+	free(epsilon_cursors);
+	free(byte_cursors);
+
+	for (size_t final_state_index = 0; final_state_index < machine->final_state_len; ++final_state_index)
+	{
+		C_NFA_BITSET_SET(frozen->final_bitmap, (size_t)machine->final_states[final_state_index]);
+	}
+
+	frozen->closure_offsets = NULL;
+	frozen->closure_states = NULL;
+	frozen->prefilter = NULL;
+	frozen->prefilter_len = 0;
+	frozen->prefilter_is_prefix = 0;
+	frozen->borrowed = 0;
+	if (!nfa_frozen_build_counters(frozen, machine))
+	{
+		nfa_frozen_machine_free(frozen);
+		return NULL;
+	}
+	if (frozen->counters_len == 0)
+	{
+		nfa_frozen_build_closures(frozen);
+	}
+	nfa_frozen_build_byte_classes(frozen, machine);
+
+	return frozen;
+}
+
+void nfa_frozen_machine_free(nfa_frozen_machine* machine)
+{
+	if (machine->borrowed)
+	{
+		free(machine);
+		return;
+	}
+	free(machine->epsilon_offsets);
+	free(machine->epsilon_targets);
+	free(machine->byte_offsets);
+	free(machine->byte_edges);
+	free(machine->final_bitmap);
+	free(machine->closure_offsets);
+	free(machine->closure_states);
+	free(machine->counters);
+	free(machine->pass_offsets);
+	free(machine->graph_state_counters);
+	free(machine->prefilter);
+	free(machine);
+}
+
+int nfa_frozen_machine_is_final(const nfa_frozen_machine* machine, size_t state_index)
+{
+	return state_index < machine->states_len && C_NFA_BITSET_HAS(machine->final_bitmap, nfa_frozen_graph_state(machine, (uint32_t)state_index));
+}
+
+uint32_t nfa_frozen_counter_search(const nfa_frozen_machine* machine, uint32_t graph_state)
+{
+	// the innermost body holding graph_state is the last one starting at or before it, or one holding that one
+	uint32_t low = 0;
+	uint32_t high = machine->counters_len;
+	while (low < high)
+	{
+		uint32_t middle = low + (high - low) / 2;
+		if (machine->counters[middle].first_state_index <= graph_state)
+		{
+			low = middle + 1;
+		}
+		else
+		{
+			high = middle;
+		}
+	}
+
+	uint32_t counter_index = low == 0 ? C_NFA_NO_COUNTER : low - 1;
+	while (counter_index != C_NFA_NO_COUNTER && graph_state - machine->counters[counter_index].first_state_index >= machine->counters[counter_index].states_len)
+	{
+		counter_index = machine->counters[counter_index].parent;
+	}
+	return counter_index;
+}
+
+uint32_t nfa_frozen_graph_state(const nfa_frozen_machine* machine, uint32_t state)
+{
+	if (machine->pass_offsets == NULL)
+	{
+		return state;
+	}
+
+	uint32_t low = 0;
+	uint32_t high = machine->graph_states_len;
+	while (high - low > 1)
+	{
+		uint32_t middle = low + (high - low) / 2;
+		if (machine->pass_offsets[middle] <= state)
+		{
+			low = middle;
+		}
+		else
+		{
+			high = middle;
+		}
+	}
+	return low;
+}
+
+uint32_t nfa_frozen_state_target(const nfa_frozen_machine* machine, uint32_t state, uint32_t graph_state, uint32_t to_graph_state)
+{
+	if (machine->pass_offsets == NULL)
+	{
+		return to_graph_state;
+	}
+
+	// passes through bodies holding only the state left are dropped, bodies holding only the state reached
+	// start at pass 1, and bodies holding both keep their pass
+	uint32_t passes = state - machine->pass_offsets[graph_state];
+	uint32_t from_counter = machine->graph_state_counters[graph_state];
+	uint32_t to_counter = machine->graph_state_counters[to_graph_state];
+	uint32_t to_passes = 0;
+	uint32_t stride = 1;
+	while (from_counter != to_counter)
+	{
+		if (from_counter != C_NFA_NO_COUNTER && to_graph_state - machine->counters[from_counter].first_state_index >= machine->counters[from_counter].states_len)
+		{
+			passes /= machine->counters[from_counter].passes;
+			from_counter = machine->counters[from_counter].parent;
+		}
+		else
+		{
+			stride *= machine->counters[to_counter].passes;
+			to_counter = machine->counters[to_counter].parent;
+		}
+	}
+	for (; from_counter != C_NFA_NO_COUNTER; from_counter = machine->counters[from_counter].parent)
+	{
+		uint32_t counter_passes = machine->counters[from_counter].passes;
+		to_passes += passes % counter_passes * stride;
+		passes /= counter_passes;
+		stride *= counter_passes;
+	}
+	return machine->pass_offsets[to_graph_state] + to_passes;
+}
+
+// Returns the state starting the next pass through the body of counter_index from state, whose pass
+// through it is below the counter's passes
+uint32_t nfa_frozen_state_next_pass(const nfa_frozen_machine* machine, uint32_t state, uint32_t graph_state, uint32_t counter_index)
+{
+	uint32_t first_state_index = machine->counters[counter_index].first_state_index;
+	uint32_t stride = 1;
+	for (uint32_t inner = machine->graph_state_counters[first_state_index]; inner != counter_index; inner = machine->counters[inner].parent)
+	{
+		stride *= machine->counters[inner].passes;
+	}
+	return nfa_frozen_state_target(machine, state, graph_state, first_state_index) + stride;
+}
+
+uint32_t nfa_frozen_counter_targets(const nfa_frozen_machine* machine, uint32_t state, uint32_t graph_state, uint32_t counter_index, uint32_t pass, uint32_t* targets, uint32_t* target_graph_states)
+{
+	const nfa_frozen_counter* counter = &machine->counters[counter_index];
+	uint32_t targets_len = 0;
+	if (pass >= counter->min)
+	{
+		target_graph_states[targets_len] = counter->exit_state_index;
+		targets[targets_len++] = nfa_frozen_state_target(machine, state, graph_state, counter->exit_state_index);
+	}
+	if (pass < counter->passes)
+	{
+		target_graph_states[targets_len] = counter->first_state_index;
+		targets[targets_len++] = nfa_frozen_state_next_pass(machine, state, graph_state, counter_index);
+	}
+	else if (counter->unbounded)
+	{
+		// passes past min behave the same, so the last one loops onto itself
+		target_graph_states[targets_len] = counter->first_state_index;
+		targets[targets_len++] = nfa_frozen_state_target(machine, state, graph_state, counter->first_state_index);
+	}
+	return targets_len;
+}
+
+int nfa_frozen_state_set_has(const nfa_frozen_state_set* set, uint32_t state)
+{
+	uint32_t dense_index = set->sparse[state];
+	return dense_index < set->len && set->dense[dense_index] == state;
+}
+
+void nfa_frozen_state_set_insert(nfa_frozen_state_set* set, uint32_t state, uint32_t graph_state)
+{
+	set->sparse[state] = set->len;
+	set->dense[set->len] = state;
+	set->graph_states[set->len] = graph_state;
+	++set->len;
+}
+
+// Adds state to set and its slot in set to the stack of states whose e-transitions are still to be followed,
+// unless it's already in set
+void nfa_frozen_closure_push(nfa_frozen_state_set* set, uint32_t state, uint32_t graph_state, uint32_t* stack, uint32_t* stack_len)
+{
+	if (!nfa_frozen_state_set_has(set, state))
+	{
+		stack[(*stack_len)++] = set->len;
+		nfa_frozen_state_set_insert(set, state, graph_state);
+		C_NFA_STATS_ADD(epsilon_expansions, 1);
+		C_NFA_STATS_ADD(contexts_pushed, 1);
+	}
+	else
+	{
+		C_NFA_STATS_ADD(set_hits, 1);
+	}
+}
+
+// Adds state and every state reachable from it via e-transitions
+void nfa_frozen_state_set_add_closure(const nfa_frozen_machine* machine, nfa_frozen_state_set* set, uint32_t state, uint32_t graph_state, uint32_t* stack)
+{
+	if (machine->closure_offsets != NULL)
+	{
+		for (uint32_t index = machine->closure_offsets[state]; index < machine->closure_offsets[state + 1]; ++index)
+		{
+			uint32_t closure_state = machine->closure_states[index];
+			if (!nfa_frozen_state_set_has(set, closure_state))
+			{
+				// closures are only kept without counters, where every state is its own graph state
+				nfa_frozen_state_set_insert(set, closure_state, closure_state);
+				C_NFA_STATS_ADD(epsilon_expansions, closure_state != state);
+			}
+			else
+			{
+				C_NFA_STATS_ADD(set_hits, 1);
+			}
+		}
+		return;
+	}
+
+	if (nfa_frozen_state_set_has(set, state))
+	{
+		C_NFA_STATS_ADD(set_hits, 1);
+		return;
+	}
+
+	// the stack holds slots in set, each state is pushed at most once so the stack never outgrows states_len
+	uint32_t stack_len = 0;
+	stack[stack_len++] = set->len;
+	nfa_frozen_state_set_insert(set, state, graph_state);
+	C_NFA_STATS_ADD(contexts_pushed, 1);
+	while (stack_len > 0)
+	{
+		C_NFA_STATS_MAX(peak_stack_depth, stack_len);
+		uint32_t set_index = stack[--stack_len];
+		uint32_t top = set->dense[set_index];
+		uint32_t top_graph_state = set->graph_states[set_index];
+		C_NFA_STATS_ADD(contexts_popped, 1);
+		for (uint32_t index = machine->epsilon_offsets[top_graph_state]; index < machine->epsilon_offsets[top_graph_state + 1]; ++index)
+		{
+			uint32_t to_graph_state = machine->epsilon_targets[index];
+			uint32_t to_state = nfa_frozen_state_target(machine, top, top_graph_state, to_graph_state);
+			nfa_frozen_closure_push(set, to_state, to_graph_state, stack, &stack_len);
+		}
+
+		if (machine->counters_len == 0)
+		{
+			continue;
+		}
+
+		// the e-transitions of every counter whose body ends at top_graph_state, innermost first
+		uint32_t passes = top - machine->pass_offsets[top_graph_state];
+		for (uint32_t counter_index = machine->graph_state_counters[top_graph_state]; counter_index != C_NFA_NO_COUNTER; counter_index = machine->counters[counter_index].parent)
+		{
+			const nfa_frozen_counter* counter = &machine->counters[counter_index];
+			uint32_t pass = passes % counter->passes + 1;
+			passes /= counter->passes;
+			if (counter->last_state_index == top_graph_state)
+			{
+				uint32_t targets[2];
+				uint32_t target_graph_states[2];
+				uint32_t targets_len = nfa_frozen_counter_targets(machine, top, top_graph_state, counter_index, pass, targets, target_graph_states);
+				for (uint32_t target_index = 0; target_index < targets_len; ++target_index)
+				{
+					nfa_frozen_closure_push(set, targets[target_index], target_graph_states[target_index], stack, &stack_len);
+				}
+			}
+		}
+	}
+}
+
+void nfa_frozen_state_set_step(const nfa_frozen_machine* machine, const nfa_frozen_state_set* current, nfa_frozen_state_set* next, unsigned char c, uint32_t* stack)
+{
+	next->len = 0;
+	for (uint32_t set_index = 0; set_index < current->len; ++set_index)
+	{
+		uint32_t state = current->dense[set_index];
+		uint32_t graph_state = current->graph_states[set_index];
+		C_NFA_STATS_ADD(transitions_scanned, machine->byte_offsets[graph_state + 1] - machine->byte_offsets[graph_state]);
+		for (uint32_t index = machine->byte_offsets[graph_state]; index < machine->byte_offsets[graph_state + 1]; ++index)
+		{
+			const nfa_frozen_edge* edge = &machine->byte_edges[index];
+			if (c >= edge->rule && c <= edge->rule_last)
+			{
+				nfa_frozen_state_set_add_closure(machine, next, nfa_frozen_state_target(machine, state, graph_state, edge->to_state_index), edge->to_state_index, stack);
+			}
+		}
+	}
+}
+
+int nfa_frozen_state_set_is_accepting(const nfa_frozen_machine* machine, const nfa_frozen_state_set* set)
+{
+	for (uint32_t set_index = 0; set_index < set->len; ++set_index)
+	{
+		if (C_NFA_BITSET_HAS(machine->final_bitmap, set->graph_states[set_index]))
+		{
+			return 1;
+		}
+	}
+	return 0;
+}
+
+nfa_exec_scratch* nfa_exec_scratch_alloc(void)
+{
+	nfa_exec_scratch* scratch = malloc(sizeof(nfa_exec_scratch));
+	scratch->memory = NULL;
+	scratch->capacity = 0;
+	scratch->current = (nfa_frozen_state_set){ NULL, NULL, NULL, 0 };
+	scratch->next = (nfa_frozen_state_set){ NULL, NULL, NULL, 0 };
+	scratch->stack = NULL;
+	scratch->current_starts = NULL;
+	scratch->next_starts = NULL;
+	C_NFA_STATS_ADD(allocations, 1);
+	return scratch;
+}
+
+void nfa_exec_scratch_free(nfa_exec_scratch* scratch)
+{
+	free(scratch->memory);
+	free(scratch->current_starts);
+	free(scratch->next_starts);
+	free(scratch);
+}
+
+static C_NFA_THREAD_LOCAL nfa_exec_scratch* nfa_exec_scratch_current = NULL;
+
+// The thread local only makes lookups cheap, the scratch is also handed to a key whose destructor frees it
+#ifdef _WIN32
+static INIT_ONCE nfa_exec_scratch_once = INIT_ONCE_STATIC_INIT;
+static DWORD nfa_exec_scratch_key;
+
+void WINAPI nfa_exec_scratch_thread_exit(void* scratch)
+{
+	if (scratch != NULL)
+	{
+		nfa_exec_scratch_free(scratch);
+	}
+}
+
+BOOL CALLBACK nfa_exec_scratch_key_create(PINIT_ONCE once, void* parameter, void** context)
+{
+	(void)once;
+	(void)parameter;
+	(void)context;
+	nfa_exec_scratch_key = FlsAlloc(nfa_exec_scratch_thread_exit);
+	return TRUE;
+}
+#else
+static pthread_once_t nfa_exec_scratch_once = PTHREAD_ONCE_INIT;
+static pthread_key_t nfa_exec_scratch_key;
+
+void nfa_exec_scratch_thread_exit(void* scratch)
+{
+	nfa_exec_scratch_free(scratch);
+}
+
+void nfa_exec_scratch_key_create(void)
+{
+	pthread_key_create(&nfa_exec_scratch_key, nfa_exec_scratch_thread_exit);
+}
+#endif
+
+nfa_exec_scratch* nfa_exec_scratch_thread(void)
+{
+	if (nfa_exec_scratch_current == NULL)
+	{
+		nfa_exec_scratch_current = nfa_exec_scratch_alloc();
+#ifdef _WIN32
+		InitOnceExecuteOnce(&nfa_exec_scratch_once, nfa_exec_scratch_key_create, NULL, NULL);
+		FlsSetValue(nfa_exec_scratch_key, nfa_exec_scratch_current);
+#else
+		pthread_once(&nfa_exec_scratch_once, nfa_exec_scratch_key_create);
+		pthread_setspecific(nfa_exec_scratch_key, nfa_exec_scratch_current);
+#endif
+	}
+	return nfa_exec_scratch_current;
+}
+
+void nfa_exec_scratch_prepare(nfa_exec_scratch* scratch, uint32_t states_len)
+{
+	if (states_len > scratch->capacity)
+	{
+		uint32_t capacity = C_NFA_MAX(2 * scratch->capacity, states_len);
+
+		free(scratch->memory);
+		free(scratch->current_starts);
+		free(scratch->next_starts);
+		scratch->memory = calloc(7 * (size_t)capacity, sizeof(uint32_t));
+		scratch->current_starts = malloc(capacity * sizeof(size_t));
+		scratch->next_starts = malloc(capacity * sizeof(size_t));
+		C_NFA_STATS_ADD(allocations, 3);
+		scratch->capacity = capacity;
+		scratch->current.dense = scratch->memory;
+		scratch->current.sparse = scratch->memory + capacity;
+		scratch->current.graph_states = scratch->memory + 2 * (size_t)capacity;
+		scratch->next.dense = scratch->memory + 3 * (size_t)capacity;
+		scratch->next.sparse = scratch->memory + 4 * (size_t)capacity;
+		scratch->next.graph_states = scratch->memory + 5 * (size_t)capacity;
+		scratch->stack = scratch->memory + 6 * (size_t)capacity;
+	}
+
+	scratch->current.len = 0;
+	scratch->next.len = 0;
+}
+
+void nfa_exec_scratch_reserve(nfa_exec_scratch* scratch, const nfa_frozen_machine* machine)
+{
+	nfa_exec_scratch_prepare(scratch, machine->states_len);
+}
+
+// Steps every active state together one byte at a time, O(len * states)
+int nfa_frozen_machine_execute_n(const nfa_frozen_machine* machine, const uint8_t* data, size_t len, nfa_exec_scratch* scratch)
+{
+	if (scratch == NULL)
+	{
+		nfa_exec_scratch* call_scratch = nfa_exec_scratch_alloc();
+		int result = nfa_frozen_machine_execute_n(machine, data, len, call_scratch);
+		nfa_exec_scratch_free(call_scratch);
+		return result;
+	}
+
+	nfa_exec_scratch_prepare(scratch, machine->states_len);
+
+	nfa_frozen_state_set_add_closure(machine, &scratch->current, machine->start_state_index, nfa_frozen_graph_state(machine, machine->start_state_index), scratch->stack);
+
+	for (size_t data_index = 0; data_index < len && scratch->current.len > 0; ++data_index)
+	{
+		nfa_frozen_state_set_step(machine, &scratch->current, &scratch->next, data[data_index], scratch->stack);
+		C_NFA_STATS_ADD(bytes_consumed, 1);
+
+		nfa_frozen_state_set tmp = scratch->current;
+		scratch->current = scratch->next;
+		scratch->next = tmp;
+	}
+
+	return nfa_frozen_state_set_is_accepting(machine, &scratch->current);
+}
+
+int nfa_frozen_machine_execute_scratch(const nfa_frozen_machine* machine, const char* string, nfa_exec_scratch* scratch)
+{
+	return nfa_frozen_machine_execute_n(machine, (const uint8_t*)string, strlen(string), scratch);
+}
+
+int nfa_frozen_machine_execute(const nfa_frozen_machine* machine, const char* string)
+{
+	return nfa_frozen_machine_execute_n(machine, (const uint8_t*)string, strlen(string), NULL);
+}
+
+uint64_t nfa_frozen_states_hash(const uint32_t* states, uint32_t states_len)
+{
+	// FNV-1a
+	uint64_t hash = 14695981039346656037ull;
+	for (uint32_t index = 0; index < states_len; ++index)
+	{
+		hash ^= states[index];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+int nfa_frozen_states_compare(const void* a, const void* b)
+{
+	uint32_t state_a = *(const uint32_t*)a;
+	uint32_t state_b = *(const uint32_t*)b;
+	return (state_a > state_b) - (state_a < state_b);
+}
@@ -0,0 +1,279 @@
+#include <c_nfa/glushkov.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct
+{
+	int nullable;
+	uint64_t first; // positions a match can start with
+	uint64_t last; // positions a match can end with
+} nfa_glushkov_info;
+
+typedef struct
+{
+	const regex_t* regex;
+	size_t stage;
+} nfa_glushkov_frame;
+
+// Returns 1 if x{m,n} is x{0}, x{1}, x?, x* or x+, which take at most one set of positions for x. Other
+// bounds would need a set per pass, those patterns are left to the counters of the Thompson NFA
+int nfa_glushkov_repeat_is_single(const regex_t* node)
+{
+	uint32_t max = node->data.repeat.max;
+	return max <= 1 || (max == C_NFA_REGEX_REPEAT_UNBOUNDED && node->data.repeat.min <= 1);
+}
+
+// Returns the number of characters in regex, without recursing
+size_t nfa_glushkov_count_positions(const regex_t* regex)
+{
+	size_t positions_len = 0;
+	size_t stack_capacity = 64;
+	size_t stack_len = 0;
+	const regex_t** stack = malloc(stack_capacity * sizeof(regex_t*));
+	stack[stack_len++] = regex;
+
+	while (stack_len > 0 && positions_len <= C_NFA_GLUSHKOV_MAX_POSITIONS)
+	{
+		const regex_t* node = stack[--stack_len];
+		if (stack_len + 2 > stack_capacity)
+		{
+			stack_capacity *= 2;
+			stack = realloc(stack, stack_capacity * sizeof(regex_t*));
+		}
+
+		switch (node->type)
+		{
+		case CHAR:
+		case CLASS:
+			++positions_len;
+			break;
+		case UNION:
+		case CONCAT:
+			stack[stack_len++] = node->data.pair.second;
+			stack[stack_len++] = node->data.pair.first;
+			break;
+		case STAR:
+		case PLUS:
+		case OPTIONAL:
+			stack[stack_len++] = node->data.pair.first;
+			break;
+		case REPEAT:
+			if (!nfa_glushkov_repeat_is_single(node))
+			{
+				positions_len = C_NFA_GLUSHKOV_MAX_POSITIONS + 1;
+			}
+			else if (node->data.repeat.max > 0)
+			{
+				stack[stack_len++] = node->data.repeat.first;
+			}
+			break;
+		case BLANK:
+			break;
+		}
+	}
+
+	free(stack);
+	return positions_len;
+}
+
+// Adds follow to the follow set of every position in positions
+void nfa_glushkov_add_follow(uint64_t* follow, uint64_t positions, uint64_t targets)
+{
+	for (size_t position = 0; positions != 0; ++position, positions >>= 1)
+	{
+		if (positions & 1)
+		{
+			follow[position] |= targets;
+		}
+	}
+}
+
+// Combines a into a followed by b
+void nfa_glushkov_concat(uint64_t* follow, nfa_glushkov_info* a, const nfa_glushkov_info* b)
+{
+	nfa_glushkov_add_follow(follow, a->last, b->first);
+	a->first = a->nullable ? a->first | b->first : a->first;
+	a->last = b->nullable ? a->last | b->last : b->last;
+	a->nullable = a->nullable && b->nullable;
+}
+
+nfa_glushkov_machine* regex_to_glushkov(const regex_t* regex)
+{
+	if (nfa_glushkov_count_positions(regex) > C_NFA_GLUSHKOV_MAX_POSITIONS)
+	{
+		return NULL;
+	}
+
+	nfa_glushkov_machine* machine = calloc(1, sizeof(nfa_glushkov_machine));
+	uint64_t follow[64] = { 0 };
+	size_t positions_len = 1;
+
+	// post-order walk with explicit stacks, so deeply nested patterns don't grow the call stack
+	size_t frames_capacity = 64;
+	size_t frames_len = 0;
+	nfa_glushkov_frame* frames = malloc(frames_capacity * sizeof(nfa_glushkov_frame));
+	size_t infos_capacity = 64;
+	size_t infos_len = 0;
+	nfa_glushkov_info* infos = malloc(infos_capacity * sizeof(nfa_glushkov_info));
+
+	frames[frames_len].regex = regex;
+	frames[frames_len].stage = 0;
+	++frames_len;
+
+	while (frames_len > 0)
+	{
+		nfa_glushkov_frame* frame = &frames[frames_len - 1];
+		const regex_t* node = frame->regex;
+
+		size_t children_len = node->type == UNION || node->type == CONCAT ? 2 : (node->type == STAR || node->type == PLUS || node->type == OPTIONAL ? 1 : 0);
+		if (node->type == REPEAT)
+		{
+			children_len = node->data.repeat.max > 0;
+		}
+		if (frame->stage < children_len)
+		{
+			const regex_t* child = node->type == REPEAT ? node->data.repeat.first : (frame->stage == 0 ? node->data.pair.first : node->data.pair.second);
+			++frame->stage;
+			if (frames_len == frames_capacity)
+			{
+				frames_capacity *= 2;
+				frames = realloc(frames, frames_capacity * sizeof(nfa_glushkov_frame));
+			}
+			frames[frames_len].regex = child;
+			frames[frames_len].stage = 0;
+			++frames_len;
+			continue;
+		}
+
+		if (infos_len + 1 >= infos_capacity)
+		{
+			infos_capacity *= 2;
+			infos = realloc(infos, infos_capacity * sizeof(nfa_glushkov_info));
+		}
+
+		nfa_glushkov_info* a = infos_len >= 2 ? &infos[infos_len - 2] : NULL;
+		nfa_glushkov_info* b = infos_len >= 1 ? &infos[infos_len - 1] : NULL;
+		switch (node->type)
+		{
+		case BLANK:
+			infos[infos_len].nullable = 1;
+			infos[infos_len].first = 0;
+			infos[infos_len].last = 0;
+			++infos_len;
+			break;
+		case CHAR:
+		{
+			uint64_t position = (uint64_t)1 << positions_len++;
+			machine->byte_masks[(uint8_t)node->data.primitive] |= position;
+			infos[infos_len].nullable = 0;
+			infos[infos_len].first = position;
+			infos[infos_len].last = position;
+			++infos_len;
+			break;
+		}
+		case CLASS:
+		{
+			// a class is a single position entered on any of its bytes
+			uint64_t position = (uint64_t)1 << positions_len++;
+			for (size_t byte = 0; byte < 256; ++byte)
+			{
+				if ((node->data.bytes[byte / 64] >> (byte % 64)) & 1)
+				{
+					machine->byte_masks[byte] |= position;
+				}
+			}
+			infos[infos_len].nullable = 0;
+			infos[infos_len].first = position;
+			infos[infos_len].last = position;
+			++infos_len;
+			break;
+		}
+		case STAR:
+			// the end of the body can loop back to its start
+			nfa_glushkov_add_follow(follow, b->last, b->first);
+			b->nullable = 1;
+			break;
+		case PLUS:
+			nfa_glushkov_add_follow(follow, b->last, b->first);
+			break;
+		case OPTIONAL:
+			b->nullable = 1;
+			break;
+		case CONCAT:
+			nfa_glushkov_concat(follow, a, b);
+			--infos_len;
+			break;
+		case REPEAT:
+			// only the bounds nfa_glushkov_repeat_is_single lets through get here, x{0} matches like BLANK
+			if (node->data.repeat.max == 0)
+			{
+				infos[infos_len].nullable = 1;
+				infos[infos_len].first = 0;
+				infos[infos_len].last = 0;
+				++infos_len;
+				break;
+			}
+			if (node->data.repeat.max == C_NFA_REGEX_REPEAT_UNBOUNDED)
+			{
+				nfa_glushkov_add_follow(follow, b->last, b->first);
+			}
+			b->nullable = b->nullable || node->data.repeat.min == 0;
+			break;
+		case UNION:
+			a->first |= b->first;
+			a->last |= b->last;
+			a->nullable = a->nullable || b->nullable;
+			--infos_len;
+			break;
+		}
+		--frames_len;
+	}
+
+	// the initial state is followed by every position a match can start with
+	follow[0] = infos[0].first;
+	machine->final_mask = infos[0].last | (infos[0].nullable ? 1 : 0);
+
+	// each table entry adds one more follow set to an entry that was already filled in
+	for (size_t k = 0; k < 8; ++k)
+	{
+		for (size_t v = 1; v < 256; ++v)
+		{
+			size_t lowest_bit = 0;
+			while (!((v >> lowest_bit) & 1))
+			{
+				++lowest_bit;
+			}
+			machine->follow_tables[k][v] = machine->follow_tables[k][v & (v - 1)] | follow[8 * k + lowest_bit];
+		}
+	}
+
+	free(infos);
+	free(frames);
+	return machine;
+}
+
+void nfa_glushkov_machine_free(nfa_glushkov_machine* machine)
+{
+	free(machine);
+}
+
+int nfa_glushkov_machine_execute_n(const nfa_glushkov_machine* machine, const uint8_t* data, size_t len)
+{
+	uint64_t states = 1;
+	for (size_t data_index = 0; data_index < len && states != 0; ++data_index)
+	{
+		uint64_t next = 0;
+		for (size_t k = 0; k < 8; ++k)
+		{
+			next |= machine->follow_tables[k][(states >> (8 * k)) & 0xff];
+		}
+		states = next & machine->byte_masks[data[data_index]];
+	}
+	return (states & machine->final_mask) != 0;
+}
+
+int nfa_glushkov_machine_execute(const nfa_glushkov_machine* machine, const char* string)
+{
+	return nfa_glushkov_machine_execute_n(machine, (const uint8_t*)string, strlen(string));
+}
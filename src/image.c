@@ -0,0 +1,619 @@
+#include <c_nfa/image.h>
+
+#include "util.h"
+#include "state_set.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define C_NFA_IMAGE_BYTE_ORDER 0x01020304u
+#define C_NFA_IMAGE_SECTIONS 12
+#define C_NFA_IMAGE_FIELDS 8
+
+typedef enum
+{
+	NFA_IMAGE_KIND_FROZEN = 1,
+	NFA_IMAGE_KIND_DFA = 2
+} nfa_image_kind;
+
+// Sections are 8-byte aligned and located by their offset from the start of the image
+typedef struct
+{
+	char magic[4];
+	uint32_t version;
+	uint32_t kind;
+	uint32_t byte_order;
+	uint64_t size;
+	uint64_t checksum; // FNV-1a of every byte after the header
+	uint32_t fields[C_NFA_IMAGE_FIELDS]; // scalars of the machine, depends on the kind
+	uint64_t section_offsets[C_NFA_IMAGE_SECTIONS];
+	uint64_t section_lens[C_NFA_IMAGE_SECTIONS];
+} nfa_image_header;
+
+enum
+{
+	NFA_IMAGE_FROZEN_STATES_LEN,
+	NFA_IMAGE_FROZEN_START_STATE_INDEX,
+	NFA_IMAGE_FROZEN_CLASSES_LEN,
+	NFA_IMAGE_FROZEN_PREFILTER_LEN,
+	NFA_IMAGE_FROZEN_PREFILTER_IS_PREFIX,
+	NFA_IMAGE_FROZEN_HAS_CLOSURES,
+	NFA_IMAGE_FROZEN_EDGE_SIZE,
+	NFA_IMAGE_FROZEN_GRAPH_STATES_LEN
+};
+
+enum
+{
+	NFA_IMAGE_FROZEN_EPSILON_OFFSETS,
+	NFA_IMAGE_FROZEN_EPSILON_TARGETS,
+	NFA_IMAGE_FROZEN_BYTE_OFFSETS,
+	NFA_IMAGE_FROZEN_BYTE_EDGES,
+	NFA_IMAGE_FROZEN_FINAL_BITMAP,
+	NFA_IMAGE_FROZEN_BYTE_CLASSES,
+	NFA_IMAGE_FROZEN_CLOSURE_OFFSETS,
+	NFA_IMAGE_FROZEN_CLOSURE_STATES,
+	NFA_IMAGE_FROZEN_PREFILTER,
+	NFA_IMAGE_FROZEN_COUNTERS,
+	NFA_IMAGE_FROZEN_PASS_OFFSETS,
+	NFA_IMAGE_FROZEN_GRAPH_STATE_COUNTERS
+};
+
+enum
+{
+	NFA_IMAGE_DFA_STATES_LEN,
+	NFA_IMAGE_DFA_START_STATE_INDEX,
+	NFA_IMAGE_DFA_DEAD_STATE_INDEX,
+	NFA_IMAGE_DFA_CLASSES_LEN
+};
+
+enum
+{
+	NFA_IMAGE_DFA_TRANSITIONS,
+	NFA_IMAGE_DFA_FINAL_STATES,
+	NFA_IMAGE_DFA_BYTE_CLASSES
+};
+
+typedef struct
+{
+	uint8_t* buffer;
+	size_t len;
+	nfa_image_header header;
+} nfa_image_writer;
+
+uint64_t nfa_image_checksum(const uint8_t* data, size_t len)
+{
+	uint64_t hash = 14695981039346656037ULL;
+	for (size_t index = 0; index < len; ++index)
+	{
+		hash ^= data[index];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+// buffer is NULL while sizing the image, otherwise it has already been zeroed so padding doesn't
+// change the checksum
+void nfa_image_writer_begin(nfa_image_writer* writer, uint8_t* buffer, nfa_image_kind kind)
+{
+	writer->buffer = buffer;
+	writer->len = sizeof(nfa_image_header);
+	memset(&writer->header, 0, sizeof(nfa_image_header));
+	memcpy(writer->header.magic, "CNFA", 4);
+	writer->header.version = C_NFA_IMAGE_VERSION;
+	writer->header.kind = kind;
+	writer->header.byte_order = C_NFA_IMAGE_BYTE_ORDER;
+}
+
+// Returns where the next section goes, or NULL if the image is only being sized
+uint8_t* nfa_image_writer_section(nfa_image_writer* writer, size_t section, size_t len)
+{
+	size_t offset = (writer->len + 7) & ~(size_t)7;
+	writer->header.section_offsets[section] = offset;
+	writer->header.section_lens[section] = len;
+	writer->len = offset + len;
+	return writer->buffer != NULL ? writer->buffer + offset : NULL;
+}
+
+void nfa_image_writer_add(nfa_image_writer* writer, size_t section, const void* data, size_t len)
+{
+	uint8_t* destination = nfa_image_writer_section(writer, section, len);
+	if (destination != NULL && len > 0)
+	{
+		memcpy(destination, data, len);
+	}
+}
+
+size_t nfa_image_writer_end(nfa_image_writer* writer)
+{
+	size_t size = (writer->len + 7) & ~(size_t)7;
+	if (writer->buffer != NULL)
+	{
+		writer->header.size = size;
+		writer->header.checksum = nfa_image_checksum(writer->buffer + sizeof(nfa_image_header), size - sizeof(nfa_image_header));
+		memcpy(writer->buffer, &writer->header, sizeof(nfa_image_header));
+	}
+	return size;
+}
+
+size_t nfa_frozen_machine_write(const nfa_frozen_machine* machine, uint8_t* buffer)
+{
+	uint32_t states_len = machine->states_len;
+	uint32_t graph_states_len = machine->graph_states_len;
+	uint32_t epsilon_len = machine->epsilon_offsets[graph_states_len];
+	uint32_t edges_len = machine->byte_offsets[graph_states_len];
+
+	nfa_image_writer writer;
+	nfa_image_writer_begin(&writer, buffer, NFA_IMAGE_KIND_FROZEN);
+	writer.header.fields[NFA_IMAGE_FROZEN_STATES_LEN] = states_len;
+	writer.header.fields[NFA_IMAGE_FROZEN_START_STATE_INDEX] = machine->start_state_index;
+	writer.header.fields[NFA_IMAGE_FROZEN_CLASSES_LEN] = machine->classes_len;
+	writer.header.fields[NFA_IMAGE_FROZEN_PREFILTER_LEN] = machine->prefilter_len;
+	writer.header.fields[NFA_IMAGE_FROZEN_PREFILTER_IS_PREFIX] = machine->prefilter_is_prefix;
+	writer.header.fields[NFA_IMAGE_FROZEN_HAS_CLOSURES] = machine->closure_offsets != NULL;
+	writer.header.fields[NFA_IMAGE_FROZEN_EDGE_SIZE] = sizeof(nfa_frozen_edge);
+	writer.header.fields[NFA_IMAGE_FROZEN_GRAPH_STATES_LEN] = graph_states_len;
+
+	nfa_image_writer_add(&writer, NFA_IMAGE_FROZEN_EPSILON_OFFSETS, machine->epsilon_offsets, ((size_t)graph_states_len + 1) * sizeof(uint32_t));
+	nfa_image_writer_add(&writer, NFA_IMAGE_FROZEN_EPSILON_TARGETS, machine->epsilon_targets, epsilon_len * sizeof(uint32_t));
+	nfa_image_writer_add(&writer, NFA_IMAGE_FROZEN_BYTE_OFFSETS, machine->byte_offsets, ((size_t)graph_states_len + 1) * sizeof(uint32_t));
+
+	// edges are copied field by field, leaving their padding zeroed
+	nfa_frozen_edge* edges = (nfa_frozen_edge*)nfa_image_writer_section(&writer, NFA_IMAGE_FROZEN_BYTE_EDGES, edges_len * sizeof(nfa_frozen_edge));
+	for (uint32_t index = 0; edges != NULL && index < edges_len; ++index)
+	{
+		edges[index].to_state_index = machine->byte_edges[index].to_state_index;
+		edges[index].rule = machine->byte_edges[index].rule;
+		edges[index].rule_last = machine->byte_edges[index].rule_last;
+	}
+
+	nfa_image_writer_add(&writer, NFA_IMAGE_FROZEN_FINAL_BITMAP, machine->final_bitmap, C_NFA_BITSET_WORDS(graph_states_len) * sizeof(uint64_t));
+	nfa_image_writer_add(&writer, NFA_IMAGE_FROZEN_BYTE_CLASSES, machine->byte_classes, sizeof(machine->byte_classes));
+	if (machine->closure_offsets != NULL)
+	{
+		nfa_image_writer_add(&writer, NFA_IMAGE_FROZEN_CLOSURE_OFFSETS, machine->closure_offsets, ((size_t)states_len + 1) * sizeof(uint32_t));
+		nfa_image_writer_add(&writer, NFA_IMAGE_FROZEN_CLOSURE_STATES, machine->closure_states, machine->closure_offsets[states_len] * sizeof(uint32_t));
+	}
+	nfa_image_writer_add(&writer, NFA_IMAGE_FROZEN_PREFILTER, machine->prefilter, machine->prefilter_len);
+	nfa_image_writer_add(&writer, NFA_IMAGE_FROZEN_COUNTERS, machine->counters, machine->counters_len * sizeof(nfa_frozen_counter));
+	if (machine->pass_offsets != NULL)
+	{
+		nfa_image_writer_add(&writer, NFA_IMAGE_FROZEN_PASS_OFFSETS, machine->pass_offsets, ((size_t)graph_states_len + 1) * sizeof(uint32_t));
+		nfa_image_writer_add(&writer, NFA_IMAGE_FROZEN_GRAPH_STATE_COUNTERS, machine->graph_state_counters, (size_t)graph_states_len * sizeof(uint32_t));
+	}
+
+	return nfa_image_writer_end(&writer);
+}
+
+size_t nfa_frozen_machine_serialize(const nfa_frozen_machine* machine, void* buffer, size_t capacity)
+{
+	size_t size = nfa_frozen_machine_write(machine, NULL);
+	if (buffer != NULL && size <= capacity)
+	{
+		memset(buffer, 0, size);
+		nfa_frozen_machine_write(machine, buffer);
+	}
+	return size;
+}
+
+size_t dfa_machine_write(const dfa_machine* machine, uint8_t* buffer)
+{
+	nfa_image_writer writer;
+	nfa_image_writer_begin(&writer, buffer, NFA_IMAGE_KIND_DFA);
+	writer.header.fields[NFA_IMAGE_DFA_STATES_LEN] = machine->states_len;
+	writer.header.fields[NFA_IMAGE_DFA_START_STATE_INDEX] = machine->start_state_index;
+	writer.header.fields[NFA_IMAGE_DFA_DEAD_STATE_INDEX] = machine->dead_state_index;
+	writer.header.fields[NFA_IMAGE_DFA_CLASSES_LEN] = machine->classes_len;
+
+	nfa_image_writer_add(&writer, NFA_IMAGE_DFA_TRANSITIONS, machine->transitions, (size_t)machine->states_len * machine->classes_len * sizeof(uint32_t));
+	nfa_image_writer_add(&writer, NFA_IMAGE_DFA_FINAL_STATES, machine->final_states, machine->states_len);
+	nfa_image_writer_add(&writer, NFA_IMAGE_DFA_BYTE_CLASSES, machine->byte_classes, sizeof(machine->byte_classes));
+
+	return nfa_image_writer_end(&writer);
+}
+
+size_t dfa_machine_serialize(const dfa_machine* machine, void* buffer, size_t capacity)
+{
+	size_t size = dfa_machine_write(machine, NULL);
+	if (buffer != NULL && size <= capacity)
+	{
+		memset(buffer, 0, size);
+		dfa_machine_write(machine, buffer);
+	}
+	return size;
+}
+
+// Returns the header if image is a well formed image of the given kind, with every section inside it
+const nfa_image_header* nfa_image_check(const void* image, size_t size, nfa_image_kind kind, int verify_checksum)
+{
+	if (image == NULL || ((uintptr_t)image & 7) != 0 || size < sizeof(nfa_image_header))
+	{
+		return NULL;
+	}
+
+	const nfa_image_header* header = image;
+	if (memcmp(header->magic, "CNFA", 4) != 0 || header->version != C_NFA_IMAGE_VERSION || header->byte_order != C_NFA_IMAGE_BYTE_ORDER ||
+		header->kind != (uint32_t)kind || header->size != size)
+	{
+		return NULL;
+	}
+
+	for (size_t section = 0; section < C_NFA_IMAGE_SECTIONS; ++section)
+	{
+		uint64_t offset = header->section_offsets[section];
+		uint64_t len = header->section_lens[section];
+		if ((offset & 7) != 0 || offset > size || len > size - offset)
+		{
+			return NULL;
+		}
+	}
+
+	if (verify_checksum && header->checksum != nfa_image_checksum((const uint8_t*)image + sizeof(nfa_image_header), size - sizeof(nfa_image_header)))
+	{
+		return NULL;
+	}
+	return header;
+}
+
+const void* nfa_image_section(const void* image, const nfa_image_header* header, size_t section)
+{
+	return (const uint8_t*)image + header->section_offsets[section];
+}
+
+// Returns 1 if the states_len + 1 offsets start at 0 and never decrease
+int nfa_image_offsets_valid(const uint32_t* offsets, uint32_t states_len)
+{
+	if (offsets[0] != 0)
+	{
+		return 0;
+	}
+	for (uint32_t state_index = 0; state_index < states_len; ++state_index)
+	{
+		if (offsets[state_index + 1] < offsets[state_index])
+		{
+			return 0;
+		}
+	}
+	return 1;
+}
+
+// Returns 1 if every one of the len state indices is below states_len
+int nfa_image_states_valid(const uint32_t* states, size_t len, uint32_t states_len)
+{
+	for (size_t index = 0; index < len; ++index)
+	{
+		if (states[index] >= states_len)
+		{
+			return 0;
+		}
+	}
+	return 1;
+}
+
+// Returns 1 if every byte maps to a class below classes_len
+int nfa_image_byte_classes_valid(const uint8_t* byte_classes, uint32_t classes_len)
+{
+	for (size_t byte = 0; byte < 256; ++byte)
+	{
+		if (byte_classes[byte] >= classes_len)
+		{
+			return 0;
+		}
+	}
+	return 1;
+}
+
+// Returns 1 if the counters are sorted, each body lies inside the graph and inside its parent, the states they
+// name are in the graph, and graph_state_counters and pass_offsets hold what freezing would have put there
+int nfa_image_counters_valid(const nfa_frozen_machine* machine)
+{
+	for (uint32_t counter_index = 0; counter_index < machine->counters_len; ++counter_index)
+	{
+		const nfa_frozen_counter* counter = &machine->counters[counter_index];
+		if (counter->first_state_index >= machine->graph_states_len || counter->states_len == 0 ||
+			counter->states_len > machine->graph_states_len - counter->first_state_index ||
+			counter->last_state_index - counter->first_state_index >= counter->states_len || counter->exit_state_index >= machine->graph_states_len ||
+			counter->passes == 0 || counter->passes > C_NFA_FROZEN_STATES_MAX || counter->min > counter->passes || counter->unbounded > 1)
+		{
+			return 0;
+		}
+		if (counter_index > 0 && nfa_frozen_counters_compare(&machine->counters[counter_index - 1], counter) >= 0)
+		{
+			return 0;
+		}
+
+		// the parent must be the innermost earlier body still holding this one, which also keeps bodies from overlapping
+		uint32_t parent = counter_index > 0 ? counter_index - 1 : C_NFA_NO_COUNTER;
+		while (parent != C_NFA_NO_COUNTER && counter->first_state_index - machine->counters[parent].first_state_index >= machine->counters[parent].states_len)
+		{
+			parent = machine->counters[parent].parent;
+		}
+		if (counter->parent != parent || (parent != C_NFA_NO_COUNTER &&
+			counter->first_state_index + counter->states_len > machine->counters[parent].first_state_index + machine->counters[parent].states_len))
+		{
+			return 0;
+		}
+	}
+
+	uint64_t states_len = 0;
+	for (uint32_t graph_state = 0; graph_state < machine->graph_states_len; ++graph_state)
+	{
+		if (machine->pass_offsets[graph_state] != states_len || machine->graph_state_counters[graph_state] != nfa_frozen_counter_search(machine, graph_state))
+		{
+			return 0;
+		}
+		uint64_t states = 1;
+		for (uint32_t counter_index = machine->graph_state_counters[graph_state]; counter_index != C_NFA_NO_COUNTER && states <= C_NFA_FROZEN_STATES_MAX; counter_index = machine->counters[counter_index].parent)
+		{
+			states *= machine->counters[counter_index].passes;
+		}
+		states_len += states;
+		if (states_len > C_NFA_FROZEN_STATES_MAX)
+		{
+			return 0;
+		}
+	}
+	return machine->pass_offsets[machine->graph_states_len] == states_len && states_len == machine->states_len;
+}
+
+// Execution indexes the tables without bounds checks, so every offset, state index, and byte class in
+// the image is checked once here rather than trusting whoever wrote it
+nfa_frozen_machine* nfa_frozen_machine_load(const void* image, size_t size, int verify_checksum)
+{
+	const nfa_image_header* header = nfa_image_check(image, size, NFA_IMAGE_KIND_FROZEN, verify_checksum);
+	if (header == NULL || header->fields[NFA_IMAGE_FROZEN_EDGE_SIZE] != sizeof(nfa_frozen_edge))
+	{
+		return NULL;
+	}
+
+	uint32_t states_len = header->fields[NFA_IMAGE_FROZEN_STATES_LEN];
+	uint32_t graph_states_len = header->fields[NFA_IMAGE_FROZEN_GRAPH_STATES_LEN];
+	uint32_t classes_len = header->fields[NFA_IMAGE_FROZEN_CLASSES_LEN];
+	int has_closures = header->fields[NFA_IMAGE_FROZEN_HAS_CLOSURES] != 0;
+	const uint64_t* lens = header->section_lens;
+	uint32_t counters_len = (uint32_t)(lens[NFA_IMAGE_FROZEN_COUNTERS] / sizeof(nfa_frozen_counter));
+	size_t offsets_len = ((size_t)graph_states_len + 1) * sizeof(uint32_t);
+	if (graph_states_len == 0 || states_len < graph_states_len || header->fields[NFA_IMAGE_FROZEN_START_STATE_INDEX] >= states_len ||
+		classes_len == 0 || classes_len > 256 ||
+		lens[NFA_IMAGE_FROZEN_EPSILON_OFFSETS] != offsets_len || lens[NFA_IMAGE_FROZEN_BYTE_OFFSETS] != offsets_len ||
+		lens[NFA_IMAGE_FROZEN_COUNTERS] != (uint64_t)counters_len * sizeof(nfa_frozen_counter) ||
+		lens[NFA_IMAGE_FROZEN_PASS_OFFSETS] != (counters_len > 0 ? offsets_len : 0) ||
+		lens[NFA_IMAGE_FROZEN_GRAPH_STATE_COUNTERS] != (counters_len > 0 ? (uint64_t)graph_states_len * sizeof(uint32_t) : 0) ||
+		(counters_len == 0 && states_len != graph_states_len) || (has_closures && counters_len > 0) ||
+		(has_closures && lens[NFA_IMAGE_FROZEN_CLOSURE_OFFSETS] != offsets_len) ||
+		lens[NFA_IMAGE_FROZEN_FINAL_BITMAP] != C_NFA_BITSET_WORDS(graph_states_len) * sizeof(uint64_t) ||
+		lens[NFA_IMAGE_FROZEN_BYTE_CLASSES] != 256 || lens[NFA_IMAGE_FROZEN_PREFILTER] != header->fields[NFA_IMAGE_FROZEN_PREFILTER_LEN])
+	{
+		return NULL;
+	}
+
+	const uint32_t* epsilon_offsets = nfa_image_section(image, header, NFA_IMAGE_FROZEN_EPSILON_OFFSETS);
+	const uint32_t* epsilon_targets = nfa_image_section(image, header, NFA_IMAGE_FROZEN_EPSILON_TARGETS);
+	const uint32_t* byte_offsets = nfa_image_section(image, header, NFA_IMAGE_FROZEN_BYTE_OFFSETS);
+	const nfa_frozen_edge* byte_edges = nfa_image_section(image, header, NFA_IMAGE_FROZEN_BYTE_EDGES);
+	const uint32_t* closure_offsets = has_closures ? nfa_image_section(image, header, NFA_IMAGE_FROZEN_CLOSURE_OFFSETS) : NULL;
+	const uint32_t* closure_states = has_closures ? nfa_image_section(image, header, NFA_IMAGE_FROZEN_CLOSURE_STATES) : NULL;
+
+	// the array lengths are stored in the offset tables, so they can only be checked once those are located
+	if (!nfa_image_offsets_valid(epsilon_offsets, graph_states_len) || !nfa_image_offsets_valid(byte_offsets, graph_states_len) ||
+		(has_closures && !nfa_image_offsets_valid(closure_offsets, graph_states_len)) ||
+		lens[NFA_IMAGE_FROZEN_EPSILON_TARGETS] != (uint64_t)epsilon_offsets[graph_states_len] * sizeof(uint32_t) ||
+		lens[NFA_IMAGE_FROZEN_BYTE_EDGES] != (uint64_t)byte_offsets[graph_states_len] * sizeof(nfa_frozen_edge) ||
+		(has_closures && lens[NFA_IMAGE_FROZEN_CLOSURE_STATES] != (uint64_t)closure_offsets[graph_states_len] * sizeof(uint32_t)))
+	{
+		return NULL;
+	}
+
+	if (!nfa_image_states_valid(epsilon_targets, epsilon_offsets[graph_states_len], graph_states_len) ||
+		(has_closures && !nfa_image_states_valid(closure_states, closure_offsets[graph_states_len], graph_states_len)) ||
+		!nfa_image_byte_classes_valid(nfa_image_section(image, header, NFA_IMAGE_FROZEN_BYTE_CLASSES), classes_len))
+	{
+		return NULL;
+	}
+	for (uint32_t edge_index = 0; edge_index < byte_offsets[graph_states_len]; ++edge_index)
+	{
+		if (byte_edges[edge_index].to_state_index >= graph_states_len)
+		{
+			return NULL;
+		}
+	}
+
+	nfa_frozen_machine* machine = malloc(sizeof(nfa_frozen_machine));
+	machine->states_len = states_len;
+	machine->start_state_index = header->fields[NFA_IMAGE_FROZEN_START_STATE_INDEX];
+	machine->graph_states_len = graph_states_len;
+	machine->epsilon_offsets = (uint32_t*)epsilon_offsets;
+	machine->epsilon_targets = (uint32_t*)epsilon_targets;
+	machine->byte_offsets = (uint32_t*)byte_offsets;
+	machine->byte_edges = (nfa_frozen_edge*)byte_edges;
+	machine->final_bitmap = (uint64_t*)nfa_image_section(image, header, NFA_IMAGE_FROZEN_FINAL_BITMAP);
+	machine->counters = counters_len > 0 ? (nfa_frozen_counter*)nfa_image_section(image, header, NFA_IMAGE_FROZEN_COUNTERS) : NULL;
+	machine->counters_len = counters_len;
+	machine->pass_offsets = counters_len > 0 ? (uint32_t*)nfa_image_section(image, header, NFA_IMAGE_FROZEN_PASS_OFFSETS) : NULL;
+	machine->graph_state_counters = counters_len > 0 ? (uint32_t*)nfa_image_section(image, header, NFA_IMAGE_FROZEN_GRAPH_STATE_COUNTERS) : NULL;
+	memcpy(machine->byte_classes, nfa_image_section(image, header, NFA_IMAGE_FROZEN_BYTE_CLASSES), 256);
+	machine->classes_len = classes_len;
+	machine->closure_offsets = (uint32_t*)closure_offsets;
+	machine->closure_states = (uint32_t*)closure_states;
+	machine->prefilter = header->fields[NFA_IMAGE_FROZEN_PREFILTER_LEN] > 0 ? (uint8_t*)nfa_image_section(image, header, NFA_IMAGE_FROZEN_PREFILTER) : NULL;
+	machine->prefilter_len = header->fields[NFA_IMAGE_FROZEN_PREFILTER_LEN];
+	machine->prefilter_is_prefix = header->fields[NFA_IMAGE_FROZEN_PREFILTER_IS_PREFIX];
+	machine->borrowed = 1;
+	if (counters_len > 0 && !nfa_image_counters_valid(machine))
+	{
+		free(machine);
+		return NULL;
+	}
+	return machine;
+}
+
+dfa_machine* dfa_machine_load(const void* image, size_t size, int verify_checksum)
+{
+	const nfa_image_header* header = nfa_image_check(image, size, NFA_IMAGE_KIND_DFA, verify_checksum);
+	if (header == NULL)
+	{
+		return NULL;
+	}
+
+	uint32_t states_len = header->fields[NFA_IMAGE_DFA_STATES_LEN];
+	uint32_t classes_len = header->fields[NFA_IMAGE_DFA_CLASSES_LEN];
+	uint32_t dead_state_index = header->fields[NFA_IMAGE_DFA_DEAD_STATE_INDEX];
+	const uint64_t* lens = header->section_lens;
+	if (states_len == 0 || header->fields[NFA_IMAGE_DFA_START_STATE_INDEX] >= states_len || classes_len == 0 || classes_len > 256 ||
+		(dead_state_index != DFA_NO_DEAD_STATE && dead_state_index >= states_len) ||
+		lens[NFA_IMAGE_DFA_TRANSITIONS] != (uint64_t)states_len * classes_len * sizeof(uint32_t) ||
+		lens[NFA_IMAGE_DFA_FINAL_STATES] != states_len || lens[NFA_IMAGE_DFA_BYTE_CLASSES] != 256)
+	{
+		return NULL;
+	}
+
+	const uint32_t* transitions = nfa_image_section(image, header, NFA_IMAGE_DFA_TRANSITIONS);
+	if (!nfa_image_states_valid(transitions, (size_t)states_len * classes_len, states_len) ||
+		!nfa_image_byte_classes_valid(nfa_image_section(image, header, NFA_IMAGE_DFA_BYTE_CLASSES), classes_len))
+	{
+		return NULL;
+	}
+
+	dfa_machine* machine = malloc(sizeof(dfa_machine));
+	machine->states_len = states_len;
+	machine->start_state_index = header->fields[NFA_IMAGE_DFA_START_STATE_INDEX];
+	machine->dead_state_index = dead_state_index;
+	machine->classes_len = classes_len;
+	memcpy(machine->byte_classes, nfa_image_section(image, header, NFA_IMAGE_DFA_BYTE_CLASSES), 256);
+	machine->transitions = (uint32_t*)transitions;
+	machine->final_states = (unsigned char*)nfa_image_section(image, header, NFA_IMAGE_DFA_FINAL_STATES);
+	machine->borrowed = 1;
+	return machine;
+}
+
+int nfa_image_write_file(const char* path, const void* image, size_t size)
+{
+	FILE* file = fopen(path, "wb");
+	if (file == NULL)
+	{
+		return 0;
+	}
+	int written = fwrite(image, 1, size, file) == size;
+	return fclose(file) == 0 && written;
+}
+
+int nfa_frozen_machine_save(const nfa_frozen_machine* machine, const char* path)
+{
+	size_t size = nfa_frozen_machine_serialize(machine, NULL, 0);
+	void* image = malloc(size);
+	nfa_frozen_machine_serialize(machine, image, size);
+	int result = nfa_image_write_file(path, image, size);
+	free(image);
+	return result;
+}
+
+int dfa_machine_save(const dfa_machine* machine, const char* path)
+{
+	size_t size = dfa_machine_serialize(machine, NULL, 0);
+	void* image = malloc(size);
+	dfa_machine_serialize(machine, image, size);
+	int result = nfa_image_write_file(path, image, size);
+	free(image);
+	return result;
+}
+
+struct nfa_image_file
+{
+	const void* data;
+	size_t size;
+#ifdef _WIN32
+	HANDLE file;
+	HANDLE mapping;
+#endif
+};
+
+nfa_image_file* nfa_image_file_map(const char* path)
+{
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		return NULL;
+	}
+	LARGE_INTEGER size;
+	HANDLE mapping = NULL;
+	const void* data = NULL;
+	if (GetFileSizeEx(file, &size) && size.QuadPart > 0)
+	{
+		mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	}
+	if (mapping != NULL)
+	{
+		data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	}
+	if (data == NULL)
+	{
+		if (mapping != NULL)
+		{
+			CloseHandle(mapping);
+		}
+		CloseHandle(file);
+		return NULL;
+	}
+
+	nfa_image_file* image_file = malloc(sizeof(nfa_image_file));
+	image_file->data = data;
+	image_file->size = (size_t)size.QuadPart;
+	image_file->file = file;
+	image_file->mapping = mapping;
+	return image_file;
+#else
+	int descriptor = open(path, O_RDONLY);
+	if (descriptor < 0)
+	{
+		return NULL;
+	}
+	struct stat status;
+	void* data = MAP_FAILED;
+	if (fstat(descriptor, &status) == 0 && status.st_size > 0)
+	{
+		data = mmap(NULL, (size_t)status.st_size, PROT_READ, MAP_SHARED, descriptor, 0);
+	}
+	// the mapping stays valid once the descriptor is closed
+	close(descriptor);
+	if (data == MAP_FAILED)
+	{
+		return NULL;
+	}
+
+	nfa_image_file* image_file = malloc(sizeof(nfa_image_file));
+	image_file->data = data;
+	image_file->size = (size_t)status.st_size;
+	return image_file;
+#endif
+}
+
+const void* nfa_image_file_data(const nfa_image_file* file)
+{
+	return file->data;
+}
+
+size_t nfa_image_file_size(const nfa_image_file* file)
+{
+	return file->size;
+}
+
+void nfa_image_file_unmap(nfa_image_file* file)
+{
+#ifdef _WIN32
+	UnmapViewOfFile(file->data);
+	CloseHandle(file->mapping);
+	CloseHandle(file->file);
+#else
+	munmap((void*)file->data, file->size);
+#endif
+	free(file);
+}
@@ -0,0 +1,343 @@
+#include <c_nfa/lazy_dfa.h>
+
+#include "util.h"
+#include "state_set.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define C_NFA_LAZY_DFA_UNKNOWN -1
+#define C_NFA_LAZY_DFA_DEAD 0
+
+struct nfa_lazy_dfa
+{
+	const nfa_frozen_machine* machine;
+	size_t memory_budget; // compared against the capacity of every array below, not just the part in use
+	size_t flush_count;
+	int32_t start_state;
+
+	// DFA states, state s owns transitions[s * classes_len, (s + 1) * classes_len) and set_pool[set_offsets[s], set_offsets[s] + set_lens[s])
+	uint32_t classes_len;
+	uint32_t states_len;
+	uint32_t states_capacity;
+	int32_t* transitions;
+	uint32_t* set_offsets;
+	uint32_t* set_lens;
+	unsigned char* accepting;
+	uint32_t* set_pool;
+	size_t set_pool_len;
+	size_t set_pool_capacity;
+
+	// open addressing table from NFA state set to DFA state, slots hold state + 1 and 0 when empty
+	uint32_t* table;
+	size_t table_capacity;
+
+	// scratch for stepping the NFA when a transition isn't cached yet
+	nfa_exec_scratch* scratch;
+};
+
+// Bytes held by the cache with room for states_capacity DFA states, set_pool_capacity NFA states and table_capacity slots
+size_t nfa_lazy_dfa_memory(const nfa_lazy_dfa* dfa, size_t states_capacity, size_t set_pool_capacity, size_t table_capacity)
+{
+	size_t state_size = dfa->classes_len * sizeof(int32_t) + 2 * sizeof(uint32_t) + sizeof(unsigned char);
+	return states_capacity * state_size + set_pool_capacity * sizeof(uint32_t) + table_capacity * sizeof(uint32_t);
+}
+
+int nfa_lazy_dfa_set_equals(const nfa_lazy_dfa* dfa, uint32_t dfa_state, const uint32_t* states, uint32_t states_len)
+{
+	return dfa->set_lens[dfa_state] == states_len && memcmp(dfa->set_pool + dfa->set_offsets[dfa_state], states, states_len * sizeof(uint32_t)) == 0;
+}
+
+void nfa_lazy_dfa_table_insert(nfa_lazy_dfa* dfa, uint32_t dfa_state)
+{
+	size_t mask = dfa->table_capacity - 1;
+	size_t slot = nfa_frozen_states_hash(dfa->set_pool + dfa->set_offsets[dfa_state], dfa->set_lens[dfa_state]) & mask;
+	while (dfa->table[slot] != 0)
+	{
+		slot = (slot + 1) & mask;
+	}
+	dfa->table[slot] = dfa_state + 1;
+}
+
+// Returns the DFA state for a sorted set of NFA states, adding it if needed, or
+// C_NFA_LAZY_DFA_UNKNOWN if adding it would go over the memory budget
+int32_t nfa_lazy_dfa_find_or_add(nfa_lazy_dfa* dfa, const uint32_t* states, uint32_t states_len)
+{
+	size_t mask = dfa->table_capacity - 1;
+	size_t slot = nfa_frozen_states_hash(states, states_len) & mask;
+	while (dfa->table[slot] != 0)
+	{
+		uint32_t dfa_state = dfa->table[slot] - 1;
+		if (nfa_lazy_dfa_set_equals(dfa, dfa_state, states, states_len))
+		{
+			return (int32_t)dfa_state;
+		}
+		slot = (slot + 1) & mask;
+	}
+
+	// storage is only ever grown, a flush keeps it around for the states built afterwards. Arrays grow
+	// geometrically, or by just what this state needs when that would go over the budget
+	size_t states_capacity = dfa->states_capacity;
+	size_t set_pool_capacity = dfa->set_pool_capacity;
+	size_t table_capacity = dfa->table_capacity;
+	if (dfa->states_len == states_capacity)
+	{
+		states_capacity = C_NFA_MAX(states_capacity * 2, 16);
+	}
+	if (dfa->set_pool_len + states_len > set_pool_capacity)
+	{
+		set_pool_capacity = C_NFA_MAX(C_NFA_MAX(set_pool_capacity * 2, dfa->set_pool_len + states_len), 64);
+	}
+	if (2 * ((size_t)dfa->states_len + 1) > table_capacity)
+	{
+		// keep the table at most half full
+		table_capacity *= 2;
+	}
+	if (nfa_lazy_dfa_memory(dfa, states_capacity, set_pool_capacity, table_capacity) > dfa->memory_budget)
+	{
+		states_capacity = C_NFA_MAX(dfa->states_capacity, (size_t)dfa->states_len + 1);
+		set_pool_capacity = C_NFA_MAX(dfa->set_pool_capacity, dfa->set_pool_len + states_len);
+		// the dead state is always kept, whatever the budget
+		if (dfa->states_len > 0 && nfa_lazy_dfa_memory(dfa, states_capacity, set_pool_capacity, table_capacity) > dfa->memory_budget)
+		{
+			return C_NFA_LAZY_DFA_UNKNOWN;
+		}
+	}
+
+	if (states_capacity != dfa->states_capacity)
+	{
+		dfa->states_capacity = (uint32_t)states_capacity;
+		dfa->transitions = realloc(dfa->transitions, states_capacity * dfa->classes_len * sizeof(int32_t));
+		dfa->set_offsets = realloc(dfa->set_offsets, states_capacity * sizeof(uint32_t));
+		dfa->set_lens = realloc(dfa->set_lens, states_capacity * sizeof(uint32_t));
+		dfa->accepting = realloc(dfa->accepting, states_capacity * sizeof(unsigned char));
+		C_NFA_STATS_ADD(allocations, 4);
+	}
+	if (set_pool_capacity != dfa->set_pool_capacity)
+	{
+		dfa->set_pool_capacity = set_pool_capacity;
+		dfa->set_pool = realloc(dfa->set_pool, set_pool_capacity * sizeof(uint32_t));
+		C_NFA_STATS_ADD(allocations, 1);
+	}
+
+	uint32_t dfa_state = dfa->states_len++;
+	if (states_len > 0)
+	{
+		memcpy(dfa->set_pool + dfa->set_pool_len, states, states_len * sizeof(uint32_t));
+	}
+	dfa->set_offsets[dfa_state] = (uint32_t)dfa->set_pool_len;
+	dfa->set_lens[dfa_state] = states_len;
+	dfa->set_pool_len += states_len;
+
+	int32_t* row = dfa->transitions + (size_t)dfa_state * dfa->classes_len;
+	for (size_t class_index = 0; class_index < dfa->classes_len; ++class_index)
+	{
+		row[class_index] = states_len == 0 ? C_NFA_LAZY_DFA_DEAD : C_NFA_LAZY_DFA_UNKNOWN;
+	}
+
+	dfa->accepting[dfa_state] = 0;
+	for (uint32_t index = 0; index < states_len; ++index)
+	{
+		if (C_NFA_BITSET_HAS(dfa->machine->final_bitmap, nfa_frozen_graph_state(dfa->machine, states[index])))
+		{
+			dfa->accepting[dfa_state] = 1;
+			break;
+		}
+	}
+
+	if (table_capacity != dfa->table_capacity)
+	{
+		dfa->table_capacity = table_capacity;
+		dfa->table = realloc(dfa->table, dfa->table_capacity * sizeof(uint32_t));
+		C_NFA_STATS_ADD(allocations, 1);
+		memset(dfa->table, 0, dfa->table_capacity * sizeof(uint32_t));
+		for (uint32_t index = 0; index < dfa->states_len; ++index)
+		{
+			nfa_lazy_dfa_table_insert(dfa, index);
+		}
+	}
+	else
+	{
+		nfa_lazy_dfa_table_insert(dfa, dfa_state);
+	}
+
+	return (int32_t)dfa_state;
+}
+
+// Drop every cached state, only the dead state (the empty set) is rebuilt
+void nfa_lazy_dfa_flush(nfa_lazy_dfa* dfa)
+{
+	dfa->states_len = 0;
+	dfa->set_pool_len = 0;
+	dfa->start_state = C_NFA_LAZY_DFA_UNKNOWN;
+	memset(dfa->table, 0, dfa->table_capacity * sizeof(uint32_t));
+
+	nfa_lazy_dfa_find_or_add(dfa, dfa->scratch->next.dense, 0);
+}
+
+// Looks up the set held in dfa->scratch->next, flushing the cache once if it is full. Returns
+// C_NFA_LAZY_DFA_UNKNOWN when the DFA should be abandoned for this execution
+int32_t nfa_lazy_dfa_resolve_next(nfa_lazy_dfa* dfa, size_t* flushes, int* flushed)
+{
+	qsort(dfa->scratch->next.dense, dfa->scratch->next.len, sizeof(uint32_t), nfa_frozen_states_compare);
+
+	*flushed = 0;
+	int32_t dfa_state = nfa_lazy_dfa_find_or_add(dfa, dfa->scratch->next.dense, dfa->scratch->next.len);
+	if (dfa_state == C_NFA_LAZY_DFA_UNKNOWN)
+	{
+		if (*flushes == C_NFA_LAZY_DFA_MAX_FLUSHES)
+		{
+			return C_NFA_LAZY_DFA_UNKNOWN;
+		}
+
+		nfa_lazy_dfa_flush(dfa);
+		++dfa->flush_count;
+		++*flushes;
+		*flushed = 1;
+
+		// still doesn't fit when the cache is empty, the budget is too small for this machine
+		dfa_state = nfa_lazy_dfa_find_or_add(dfa, dfa->scratch->next.dense, dfa->scratch->next.len);
+	}
+	return dfa_state;
+}
+
+nfa_lazy_dfa* nfa_lazy_dfa_alloc(const nfa_frozen_machine* machine, size_t memory_budget)
+{
+	nfa_lazy_dfa* dfa = malloc(sizeof(nfa_lazy_dfa));
+	dfa->machine = machine;
+	dfa->memory_budget = memory_budget;
+	dfa->flush_count = 0;
+
+	dfa->classes_len = machine->classes_len;
+	dfa->states_len = 0;
+	dfa->states_capacity = 0;
+	dfa->transitions = NULL;
+	dfa->set_offsets = NULL;
+	dfa->set_lens = NULL;
+	dfa->accepting = NULL;
+	dfa->set_pool = NULL;
+	dfa->set_pool_len = 0;
+	dfa->set_pool_capacity = 0;
+
+	dfa->table_capacity = 4;
+	dfa->table = malloc(dfa->table_capacity * sizeof(uint32_t));
+	C_NFA_STATS_ADD(allocations, 2);
+
+	dfa->scratch = nfa_exec_scratch_alloc();
+	nfa_exec_scratch_prepare(dfa->scratch, machine->states_len);
+
+	nfa_lazy_dfa_flush(dfa);
+
+	return dfa;
+}
+
+void nfa_lazy_dfa_free(nfa_lazy_dfa* dfa)
+{
+	free(dfa->transitions);
+	free(dfa->set_offsets);
+	free(dfa->set_lens);
+	free(dfa->accepting);
+	free(dfa->set_pool);
+	free(dfa->table);
+	nfa_exec_scratch_free(dfa->scratch);
+	free(dfa);
+}
+
+// Finish the input with the NFA simulation, starting from the set held in dfa->scratch->next
+int nfa_lazy_dfa_execute_fallback(nfa_lazy_dfa* dfa, const uint8_t* data, size_t len)
+{
+	const nfa_frozen_machine* machine = dfa->machine;
+
+	dfa->scratch->current.len = 0;
+	for (uint32_t index = 0; index < dfa->scratch->next.len; ++index)
+	{
+		uint32_t state = dfa->scratch->next.dense[index];
+		nfa_frozen_state_set_insert(&dfa->scratch->current, state, nfa_frozen_graph_state(machine, state));
+	}
+
+	for (size_t data_index = 0; data_index < len && dfa->scratch->current.len > 0; ++data_index)
+	{
+		nfa_frozen_state_set_step(machine, &dfa->scratch->current, &dfa->scratch->next, data[data_index], dfa->scratch->stack);
+		C_NFA_STATS_ADD(bytes_consumed, 1);
+
+		nfa_frozen_state_set tmp = dfa->scratch->current;
+		dfa->scratch->current = dfa->scratch->next;
+		dfa->scratch->next = tmp;
+	}
+
+	return nfa_frozen_state_set_is_accepting(machine, &dfa->scratch->current);
+}
+
+int nfa_lazy_dfa_execute_n(nfa_lazy_dfa* dfa, const uint8_t* data, size_t len)
+{
+	const nfa_frozen_machine* machine = dfa->machine;
+	size_t flushes = 0;
+	int flushed;
+
+	if (dfa->start_state == C_NFA_LAZY_DFA_UNKNOWN)
+	{
+		dfa->scratch->next.len = 0;
+		nfa_frozen_state_set_add_closure(machine, &dfa->scratch->next, machine->start_state_index, nfa_frozen_graph_state(machine, machine->start_state_index), dfa->scratch->stack);
+		int32_t start_state = nfa_lazy_dfa_resolve_next(dfa, &flushes, &flushed);
+		if (start_state == C_NFA_LAZY_DFA_UNKNOWN)
+		{
+			return nfa_lazy_dfa_execute_fallback(dfa, data, len);
+		}
+		dfa->start_state = start_state;
+	}
+
+	int32_t dfa_state = dfa->start_state;
+	for (size_t data_index = 0; data_index < len; ++data_index)
+	{
+		uint8_t c = data[data_index];
+		uint8_t class_index = machine->byte_classes[c];
+		C_NFA_STATS_ADD(bytes_consumed, 1);
+
+		// hot path, one table lookup per character
+		int32_t next_state = dfa->transitions[(size_t)dfa_state * dfa->classes_len + class_index];
+		if (next_state == C_NFA_LAZY_DFA_UNKNOWN)
+		{
+			dfa->scratch->current.len = 0;
+			const uint32_t* states = dfa->set_pool + dfa->set_offsets[dfa_state];
+			for (uint32_t index = 0; index < dfa->set_lens[dfa_state]; ++index)
+			{
+				nfa_frozen_state_set_insert(&dfa->scratch->current, states[index], nfa_frozen_graph_state(machine, states[index]));
+			}
+			nfa_frozen_state_set_step(machine, &dfa->scratch->current, &dfa->scratch->next, c, dfa->scratch->stack);
+
+			next_state = nfa_lazy_dfa_resolve_next(dfa, &flushes, &flushed);
+			if (next_state == C_NFA_LAZY_DFA_UNKNOWN)
+			{
+				return nfa_lazy_dfa_execute_fallback(dfa, data + data_index + 1, len - data_index - 1);
+			}
+
+			// dfa_state no longer exists after a flush so the transition can't be cached
+			if (!flushed)
+			{
+				dfa->transitions[(size_t)dfa_state * dfa->classes_len + class_index] = next_state;
+			}
+		}
+
+		if (next_state == C_NFA_LAZY_DFA_DEAD)
+		{
+			return 0;
+		}
+		dfa_state = next_state;
+	}
+
+	return dfa->accepting[dfa_state];
+}
+
+int nfa_lazy_dfa_execute(nfa_lazy_dfa* dfa, const char* string)
+{
+	return nfa_lazy_dfa_execute_n(dfa, (const uint8_t*)string, strlen(string));
+}
+
+size_t nfa_lazy_dfa_states_len(const nfa_lazy_dfa* dfa)
+{
+	return dfa->states_len;
+}
+
+size_t nfa_lazy_dfa_flush_count(const nfa_lazy_dfa* dfa)
+{
+	return dfa->flush_count;
+}
@@ -0,0 +1,276 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include <c_nfa/regex.h>
+
+// What is known about the literals in the language of a node. Literals are cut to C_NFA_LITERAL_MAX bytes,
+// which keeps them valid since any part of a required prefix, suffix or factor is still required
+typedef struct
+{
+    uint8_t prefix[C_NFA_LITERAL_MAX];
+    size_t prefix_len;
+    uint8_t suffix[C_NFA_LITERAL_MAX];
+    size_t suffix_len;
+    uint8_t factor[C_NFA_LITERAL_MAX];
+    size_t factor_len;
+    int exact; // the language is the single string in prefix, which is then also suffix and factor
+} regex_literal_info;
+
+typedef struct
+{
+    const regex_t* regex;
+    int stage;
+} regex_literal_frame;
+
+// Writes the first C_NFA_LITERAL_MAX bytes of a followed by b to out, returns the length written
+size_t regex_literal_join_head(uint8_t* out, const uint8_t* a, size_t a_len, const uint8_t* b, size_t b_len)
+{
+    size_t b_kept_len = a_len + b_len > C_NFA_LITERAL_MAX ? C_NFA_LITERAL_MAX - a_len : b_len;
+    memmove(out, a, a_len);
+    memmove(out + a_len, b, b_kept_len);
+    return a_len + b_kept_len;
+}
+
+// Writes the last C_NFA_LITERAL_MAX bytes of a followed by b to out, returns the length written
+size_t regex_literal_join_tail(uint8_t* out, const uint8_t* a, size_t a_len, const uint8_t* b, size_t b_len)
+{
+    uint8_t joined[2 * C_NFA_LITERAL_MAX];
+    memcpy(joined, a, a_len);
+    memcpy(joined + a_len, b, b_len);
+    size_t joined_len = a_len + b_len;
+    size_t kept_len = joined_len > C_NFA_LITERAL_MAX ? C_NFA_LITERAL_MAX : joined_len;
+    memcpy(out, joined + joined_len - kept_len, kept_len);
+    return kept_len;
+}
+
+void regex_literal_exact(regex_literal_info* info, const uint8_t* bytes, size_t len)
+{
+    memmove(info->prefix, bytes, len);
+    memcpy(info->suffix, info->prefix, len);
+    memcpy(info->factor, info->prefix, len);
+    info->prefix_len = info->suffix_len = info->factor_len = len;
+    info->exact = 1;
+}
+
+void regex_literal_keep_longer_factor(regex_literal_info* info, const uint8_t* bytes, size_t len)
+{
+    if (len > info->factor_len)
+    {
+        memcpy(info->factor, bytes, len);
+        info->factor_len = len;
+    }
+}
+
+void regex_literal_concat(regex_literal_info* out, const regex_literal_info* a, const regex_literal_info* b)
+{
+    if (a->exact && b->exact && a->prefix_len + b->prefix_len <= C_NFA_LITERAL_MAX)
+    {
+        uint8_t joined[C_NFA_LITERAL_MAX];
+        size_t joined_len = regex_literal_join_head(joined, a->prefix, a->prefix_len, b->prefix, b->prefix_len);
+        regex_literal_exact(out, joined, joined_len);
+        return;
+    }
+
+    regex_literal_info result;
+    result.exact = 0;
+
+    if (a->exact)
+    {
+        result.prefix_len = regex_literal_join_head(result.prefix, a->prefix, a->prefix_len, b->prefix, b->prefix_len);
+    }
+    else
+    {
+        memcpy(result.prefix, a->prefix, a->prefix_len);
+        result.prefix_len = a->prefix_len;
+    }
+
+    if (b->exact)
+    {
+        result.suffix_len = regex_literal_join_tail(result.suffix, a->suffix, a->suffix_len, b->suffix, b->suffix_len);
+    }
+    else
+    {
+        memcpy(result.suffix, b->suffix, b->suffix_len);
+        result.suffix_len = b->suffix_len;
+    }
+
+    // a required factor is in a, in b, or straddles the two
+    result.factor_len = 0;
+    regex_literal_keep_longer_factor(&result, a->factor, a->factor_len);
+    regex_literal_keep_longer_factor(&result, b->factor, b->factor_len);
+    uint8_t straddle[C_NFA_LITERAL_MAX];
+    size_t straddle_len = regex_literal_join_head(straddle, a->suffix, a->suffix_len, b->prefix, b->prefix_len);
+    regex_literal_keep_longer_factor(&result, straddle, straddle_len);
+    regex_literal_keep_longer_factor(&result, result.prefix, result.prefix_len);
+    regex_literal_keep_longer_factor(&result, result.suffix, result.suffix_len);
+
+    *out = result;
+}
+
+void regex_literal_union(regex_literal_info* out, const regex_literal_info* a, const regex_literal_info* b)
+{
+    if (a->exact && b->exact && a->prefix_len == b->prefix_len && memcmp(a->prefix, b->prefix, a->prefix_len) == 0)
+    {
+        *out = *a;
+        return;
+    }
+
+    regex_literal_info result;
+    result.exact = 0;
+
+    // a literal is only required if both branches require it, so keep the common parts
+    result.prefix_len = 0;
+    while (result.prefix_len < a->prefix_len && result.prefix_len < b->prefix_len && a->prefix[result.prefix_len] == b->prefix[result.prefix_len])
+    {
+        result.prefix[result.prefix_len] = a->prefix[result.prefix_len];
+        ++result.prefix_len;
+    }
+
+    result.suffix_len = 0;
+    while (result.suffix_len < a->suffix_len && result.suffix_len < b->suffix_len && a->suffix[a->suffix_len - 1 - result.suffix_len] == b->suffix[b->suffix_len - 1 - result.suffix_len])
+    {
+        ++result.suffix_len;
+    }
+    memcpy(result.suffix, a->suffix + a->suffix_len - result.suffix_len, result.suffix_len);
+
+    result.factor_len = 0;
+    if (a->factor_len == b->factor_len && memcmp(a->factor, b->factor, a->factor_len) == 0)
+    {
+        regex_literal_keep_longer_factor(&result, a->factor, a->factor_len);
+    }
+    regex_literal_keep_longer_factor(&result, result.prefix, result.prefix_len);
+    regex_literal_keep_longer_factor(&result, result.suffix, result.suffix_len);
+
+    *out = result;
+}
+
+regex_literal regex_required_literal(const regex_t* regex)
+{
+    // post-order walk with explicit stacks, so deeply nested patterns don't grow the call stack
+    size_t frames_capacity = 64;
+    size_t frames_len = 0;
+    regex_literal_frame* frames = malloc(frames_capacity * sizeof(regex_literal_frame));
+    size_t infos_capacity = 64;
+    size_t infos_len = 0;
+    regex_literal_info* infos = malloc(infos_capacity * sizeof(regex_literal_info));
+
+    frames[frames_len].regex = regex;
+    frames[frames_len].stage = 0;
+    ++frames_len;
+
+    while (frames_len > 0)
+    {
+        regex_literal_frame* frame = &frames[frames_len - 1];
+        const regex_t* node = frame->regex;
+
+        if (infos_len + 1 >= infos_capacity)
+        {
+            infos_capacity *= 2;
+            infos = realloc(infos, infos_capacity * sizeof(regex_literal_info));
+        }
+
+        int is_pair = node->type == UNION || node->type == CONCAT;
+        int children_len = is_pair ? 2 : (node->type == STAR || node->type == PLUS || node->type == OPTIONAL || node->type == REPEAT ? 1 : 0);
+        if (frame->stage < children_len)
+        {
+            const regex_t* child = frame->stage == 0 ? node->data.pair.first : node->data.pair.second;
+            ++frame->stage;
+            if (frames_len == frames_capacity)
+            {
+                frames_capacity *= 2;
+                frames = realloc(frames, frames_capacity * sizeof(regex_literal_frame));
+            }
+            frames[frames_len].regex = child;
+            frames[frames_len].stage = 0;
+            ++frames_len;
+            continue;
+        }
+
+        switch (node->type)
+        {
+        case BLANK:
+            regex_literal_exact(&infos[infos_len++], (const uint8_t*)"", 0);
+            break;
+        case CHAR:
+        {
+            uint8_t byte = (uint8_t)node->data.primitive;
+            regex_literal_exact(&infos[infos_len++], &byte, 1);
+            break;
+        }
+        case CLASS:
+        {
+            // only a class of one byte is a literal, otherwise nothing is required
+            int byte = -1;
+            size_t bytes_len = 0;
+            for (size_t index = 0; index < 256 && bytes_len < 2; ++index)
+            {
+                if ((node->data.bytes[index / 64] >> (index % 64)) & 1)
+                {
+                    byte = (int)index;
+                    ++bytes_len;
+                }
+            }
+            if (bytes_len == 1)
+            {
+                uint8_t literal_byte = (uint8_t)byte;
+                regex_literal_exact(&infos[infos_len++], &literal_byte, 1);
+            }
+            else
+            {
+                memset(&infos[infos_len++], 0, sizeof(regex_literal_info));
+            }
+            break;
+        }
+        case STAR:
+        case OPTIONAL:
+            // the body can be skipped, so nothing is required
+            memset(&infos[infos_len - 1], 0, sizeof(regex_literal_info));
+            break;
+        case PLUS:
+            // every match starts and ends with a match of the body, but may repeat it
+            infos[infos_len - 1].exact = 0;
+            break;
+        case REPEAT:
+        {
+            // x{m,n} is m copies of x followed by whatever the optional copies match
+            regex_literal_info body = infos[infos_len - 1];
+            regex_literal_info* info = &infos[infos_len - 1];
+            if (node->data.repeat.min == 0)
+            {
+                memset(info, 0, sizeof(regex_literal_info));
+            }
+            for (uint32_t copy = 1; copy < node->data.repeat.min; ++copy)
+            {
+                regex_literal_concat(info, info, &body);
+            }
+            if (node->data.repeat.min != 0 && node->data.repeat.max != node->data.repeat.min)
+            {
+                regex_literal_info unknown;
+                memset(&unknown, 0, sizeof(regex_literal_info));
+                regex_literal_concat(info, info, &unknown);
+            }
+            break;
+        }
+        case CONCAT:
+            regex_literal_concat(&infos[infos_len - 2], &infos[infos_len - 2], &infos[infos_len - 1]);
+            --infos_len;
+            break;
+        case UNION:
+            regex_literal_union(&infos[infos_len - 2], &infos[infos_len - 2], &infos[infos_len - 1]);
+            --infos_len;
+            break;
+        }
+        --frames_len;
+    }
+
+    // a prefix lets search jump straight to candidates, so it wins unless it is much shorter than the factor
+    const regex_literal_info* info = &infos[0];
+    regex_literal literal;
+    literal.is_prefix = info->prefix_len > 0 && (info->prefix_len >= 3 || info->prefix_len >= info->factor_len);
+    literal.len = literal.is_prefix ? info->prefix_len : info->factor_len;
+    memcpy(literal.bytes, literal.is_prefix ? info->prefix : info->factor, literal.len);
+
+    free(infos);
+    free(frames);
+    return literal;
+}
@@ -0,0 +1,33 @@
+#ifndef C_NFA_MUTEX_H
+#define C_NFA_MUTEX_H
+
+// Smallest mutex that can be statically initialised on every platform the library builds on. Mutexes
+// that aren't static are set up with c_nfa_mutex_init and torn down with c_nfa_mutex_destroy
+#ifdef _WIN32
+#include <windows.h>
+typedef SRWLOCK c_nfa_mutex;
+#define C_NFA_MUTEX_INIT SRWLOCK_INIT
+#define c_nfa_mutex_init(mutex) InitializeSRWLock(mutex)
+#define c_nfa_mutex_destroy(mutex) ((void)(mutex))
+#define c_nfa_mutex_lock(mutex) AcquireSRWLockExclusive(mutex)
+#define c_nfa_mutex_unlock(mutex) ReleaseSRWLockExclusive(mutex)
+
+// Pointers published by one thread and read by others, a load sees everything written before the pointer was published
+#define c_nfa_atomic_load_pointer(pointer) InterlockedCompareExchangePointer((void* volatile*)(pointer), NULL, NULL)
+#define c_nfa_atomic_compare_exchange_pointer(pointer, expected, desired) \
+	(InterlockedCompareExchangePointer((void* volatile*)(pointer), (desired), (expected)) == (void*)(expected))
+#else
+#include <pthread.h>
+typedef pthread_mutex_t c_nfa_mutex;
+#define C_NFA_MUTEX_INIT PTHREAD_MUTEX_INITIALIZER
+#define c_nfa_mutex_init(mutex) pthread_mutex_init((mutex), NULL)
+#define c_nfa_mutex_destroy(mutex) pthread_mutex_destroy(mutex)
+#define c_nfa_mutex_lock(mutex) pthread_mutex_lock(mutex)
+#define c_nfa_mutex_unlock(mutex) pthread_mutex_unlock(mutex)
+
+// Pointers published by one thread and read by others, a load sees everything written before the pointer was published
+#define c_nfa_atomic_load_pointer(pointer) __atomic_load_n((pointer), __ATOMIC_ACQUIRE)
+#define c_nfa_atomic_compare_exchange_pointer(pointer, expected, desired) __sync_bool_compare_and_swap((pointer), (expected), (desired))
+#endif
+
+#endif
@@ -1,8 +1,13 @@
 #include <c_nfa/nfa.h>
+#include <c_nfa/frozen.h>
+#include <c_nfa/lazy_dfa.h>
 
 #include "util.h"
+#include "mutex.h"
+#include "state_set.h"
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 
 typedef struct {
@@ -13,14 +18,28 @@ typedef struct {
 typedef struct {
 	nfa_machine_execution_context* context;
 	size_t context_len;
+	size_t context_capacity;
 } nfa_machine_execution_stack;
 
 typedef struct
 {
 	nfa_machine_execution_context* contexts;
 	size_t contexts_len;
+	size_t contexts_capacity;
 } nfa_machine_SET_entry;
 
+// Compiled form of a machine kept between executions. frozen is built on first use and published with an
+// atomic pointer, so executions read it without locking. Lazy DFAs update their cache while executing, so
+// each execution takes one that no other holds from idle_lazy_dfas, under the mutex, and gives it back after
+typedef struct nfa_machine_compiled
+{
+	nfa_frozen_machine* frozen;
+	c_nfa_mutex mutex;
+	nfa_lazy_dfa** idle_lazy_dfas; // built over frozen, so their caches outlive a single execution
+	size_t idle_lazy_dfas_len;
+	size_t idle_lazy_dfas_capacity;
+} nfa_machine_compiled;
+
 nfa_machine* nfa_machine_alloc()
 {
 	nfa_machine* machine = malloc(sizeof(nfa_machine));
@@ -29,45 +48,178 @@ nfa_machine* nfa_machine_alloc()
 	machine->final_state_len = 0;
 	machine->transitions = NULL;
 	machine->transitions_len = 0;
+	machine->transitions_capacity = 0;
+	machine->counters = NULL;
+	machine->counters_len = 0;
+	machine->counters_capacity = 0;
+#ifdef C_NFA_STATS_ENABLED
+	machine->stats = calloc(1, sizeof(nfa_machine_stats));
+#else
+	machine->stats = NULL;
+#endif
+
+	machine->compiled = malloc(sizeof(nfa_machine_compiled));
+	machine->compiled->frozen = NULL;
+	c_nfa_mutex_init(&machine->compiled->mutex);
+	machine->compiled->idle_lazy_dfas = NULL;
+	machine->compiled->idle_lazy_dfas_len = 0;
+	machine->compiled->idle_lazy_dfas_capacity = 0;
 
 	return machine;
 }
 
+void nfa_machine_invalidate(nfa_machine* machine)
+{
+	for (size_t index = 0; index < machine->compiled->idle_lazy_dfas_len; ++index)
+	{
+		nfa_lazy_dfa_free(machine->compiled->idle_lazy_dfas[index]);
+	}
+	machine->compiled->idle_lazy_dfas_len = 0;
+	if (machine->compiled->frozen != NULL)
+	{
+		nfa_frozen_machine_free(machine->compiled->frozen);
+		machine->compiled->frozen = NULL;
+	}
+}
+
 void nfa_machine_free(nfa_machine* machine)
 {
+	nfa_machine_invalidate(machine);
+	free(machine->compiled->idle_lazy_dfas);
+	c_nfa_mutex_destroy(&machine->compiled->mutex);
+	free(machine->compiled);
 	free(machine->final_states);
 	free(machine->transitions);
+	free(machine->counters);
+	free(machine->stats);
 	free(machine);
 }
 
-void nfa_machine_add_transition(nfa_machine* machine, const size_t from_state_index, const size_t to_state_index, const char rule)
+// Returns the compiled form of machine, freezing it on first use, or NULL if it can't be frozen. Threads
+// that race to compile it each freeze it, and all but the one that publishes first drop theirs
+const nfa_frozen_machine* nfa_machine_compiled_frozen(const nfa_machine* machine)
+{
+	nfa_machine_compiled* compiled = machine->compiled;
+	nfa_frozen_machine* frozen = c_nfa_atomic_load_pointer(&compiled->frozen);
+	if (frozen != NULL)
+	{
+		return frozen;
+	}
+
+	frozen = nfa_machine_freeze(machine);
+	if (frozen != NULL && !c_nfa_atomic_compare_exchange_pointer(&compiled->frozen, NULL, frozen))
+	{
+		nfa_frozen_machine_free(frozen);
+		frozen = c_nfa_atomic_load_pointer(&compiled->frozen);
+	}
+	return frozen;
+}
+
+// Returns a lazy DFA over frozen that no other execution holds, warm if an earlier execution gave one back
+nfa_lazy_dfa* nfa_machine_compiled_take_lazy_dfa(const nfa_machine* machine, const nfa_frozen_machine* frozen)
+{
+	nfa_machine_compiled* compiled = machine->compiled;
+	nfa_lazy_dfa* dfa = NULL;
+	c_nfa_mutex_lock(&compiled->mutex);
+	if (compiled->idle_lazy_dfas_len > 0)
+	{
+		dfa = compiled->idle_lazy_dfas[--compiled->idle_lazy_dfas_len];
+	}
+	c_nfa_mutex_unlock(&compiled->mutex);
+
+	return dfa != NULL ? dfa : nfa_lazy_dfa_alloc(frozen, C_NFA_LAZY_DFA_DEFAULT_BUDGET);
+}
+
+// Keeps dfa for later executions, there are never more than the most executions that ran at once
+void nfa_machine_compiled_give_lazy_dfa(const nfa_machine* machine, nfa_lazy_dfa* dfa)
+{
+	nfa_machine_compiled* compiled = machine->compiled;
+	c_nfa_mutex_lock(&compiled->mutex);
+	if (compiled->idle_lazy_dfas_len == compiled->idle_lazy_dfas_capacity)
+	{
+		compiled->idle_lazy_dfas_capacity = compiled->idle_lazy_dfas_capacity == 0 ? 4 : 2 * compiled->idle_lazy_dfas_capacity;
+		compiled->idle_lazy_dfas = realloc(compiled->idle_lazy_dfas, compiled->idle_lazy_dfas_capacity * sizeof(nfa_lazy_dfa*));
+	}
+	compiled->idle_lazy_dfas[compiled->idle_lazy_dfas_len++] = dfa;
+	c_nfa_mutex_unlock(&compiled->mutex);
+}
+
+void nfa_machine_reserve(nfa_machine* machine, const size_t transitions_capacity)
 {
-	if (machine->transitions_len == 0)
+	if (transitions_capacity > machine->transitions_capacity)
 	{
-		machine->transitions = malloc(sizeof(nfa_transition));
+		machine->transitions = realloc(machine->transitions, sizeof(nfa_transition) * transitions_capacity);
+		machine->transitions_capacity = transitions_capacity;
 	}
-	else
+}
+
+void nfa_machine_add_transition(nfa_machine* machine, const size_t from_state_index, const size_t to_state_index, const int rule)
+{
+	nfa_machine_add_range_transition(machine, from_state_index, to_state_index, rule, rule);
+}
+
+void nfa_machine_add_range_transition(nfa_machine* machine, const size_t from_state_index, const size_t to_state_index, const int first, const int last)
+{
+	// transitions_len can be past transitions_capacity if transitions were assigned by hand
+	if (machine->transitions_len >= machine->transitions_capacity)
 	{
-		machine->transitions = realloc(machine->transitions, sizeof(nfa_transition) * (machine->transitions_len + 1));
+		nfa_machine_reserve(machine, C_NFA_MAX(2 * machine->transitions_capacity, C_NFA_MAX(machine->transitions_len + 1, 8)));
 	}
 
+	nfa_machine_invalidate(machine);
+
 	nfa_transition* new_transition = machine->transitions + machine->transitions_len;
 	new_transition->from_state_index = from_state_index;
 	new_transition->to_state_index = to_state_index;
-	new_transition->rule = rule;
+	// a plain char may be signed, keep every byte in [0, 255] so it can't be confused with C_NFA_EPSILON
+	new_transition->rule = first == C_NFA_EPSILON ? C_NFA_EPSILON : (unsigned char)first;
+	new_transition->rule_last = first == C_NFA_EPSILON ? C_NFA_EPSILON : (unsigned char)last;
 
 	++machine->transitions_len;
 }
 
+void nfa_machine_add_counter(nfa_machine* machine, const nfa_counter* counter)
+{
+	if (machine->counters_len == machine->counters_capacity)
+	{
+		machine->counters_capacity = machine->counters_capacity == 0 ? 4 : 2 * machine->counters_capacity;
+		machine->counters = realloc(machine->counters, machine->counters_capacity * sizeof(nfa_counter));
+	}
+
+	nfa_machine_invalidate(machine);
+	machine->counters[machine->counters_len++] = *counter;
+}
+
+// Adds every counter of source with its states moved by state_index_offset
+void nfa_machine_add_counters(nfa_machine* machine, const nfa_machine* source, size_t state_index_offset)
+{
+	for (size_t counter_index = 0; counter_index < source->counters_len; ++counter_index)
+	{
+		nfa_counter counter = source->counters[counter_index];
+		counter.first_state_index += state_index_offset;
+		counter.last_state_index += state_index_offset;
+		counter.exit_state_index += state_index_offset;
+		nfa_machine_add_counter(machine, &counter);
+	}
+}
+
 nfa_machine_execution_stack* nfa_machine_execution_stack_alloc()
 {
 	nfa_machine_execution_stack* stack = malloc(sizeof(nfa_machine_execution_stack));
 	stack->context = NULL;
 	stack->context_len = 0;
+	stack->context_capacity = 0;
+	C_NFA_STATS_ADD(allocations, 1);
 
 	return stack;
 }
 
+void nfa_machine_execution_stack_free(nfa_machine_execution_stack* stack)
+{
+	free(stack->context);
+	free(stack);
+}
+
 void debug_print_stack(nfa_machine_execution_stack* stack)
 {
 	printf("[ ");
@@ -80,14 +232,11 @@ void debug_print_stack(nfa_machine_execution_stack* stack)
 
 void nfa_machine_execution_stack_push(nfa_machine_execution_stack* stack, size_t current_state, size_t current_string_index)
 {
-	if (stack->context_len == 0)
-	{
-		stack->context = malloc(sizeof(nfa_machine_execution_context));
-	}
-	else
+	if (stack->context_len == stack->context_capacity)
 	{
-		C_NFA_ASSERT(stack->context != NULL);
-		stack->context = realloc(stack->context, sizeof(nfa_machine_execution_context) * (stack->context_len + 1));
+		stack->context_capacity = stack->context_capacity == 0 ? 16 : 2 * stack->context_capacity;
+		stack->context = realloc(stack->context, sizeof(nfa_machine_execution_context) * stack->context_capacity);
+		C_NFA_STATS_ADD(allocations, 1);
 	}
 
 	//nfa_machine_execution_context* top = stack->context + stack->context_len;
@@ -96,6 +245,8 @@ void nfa_machine_execution_stack_push(nfa_machine_execution_stack* stack, size_t
 	top->current_string_index = current_string_index;
 
 	++stack->context_len;
+	C_NFA_STATS_ADD(contexts_pushed, 1);
+	C_NFA_STATS_MAX(peak_stack_depth, stack->context_len);
 	//printf("Pushed (%llu, %llu), size = %llu\n", current_state, current_string_index, stack->context_len);
 	//debug_print_stack(stack);
 }
@@ -112,32 +263,34 @@ int nfa_machine_execution_stack_pop(nfa_machine_execution_stack* stack, nfa_mach
 	top->current_state = tmp.current_state;
 	top->current_string_index = tmp.current_string_index;
 
-	C_NFA_ASSERT(stack->context != NULL);
-	stack->context = realloc(stack->context, sizeof(nfa_machine_execution_context) * (stack->context_len - 1));
+	// the capacity is kept for the next push
 	--stack->context_len;
+	C_NFA_STATS_ADD(contexts_popped, 1);
 
 	//printf("Popped (%llu, %llu), size = %llu\n", top->current_state, top->current_string_index, stack->context_len);
 	//debug_print_stack(stack);
 	return 1;
 }
 
-// SET = seen epsilon transitions
-nfa_machine_SET_entry* nfa_machine_execution_SET_alloc(const nfa_machine* machine)
+// SET = seen epsilon transitions, one entry per transition and two per counter for the e-transitions it adds
+nfa_machine_SET_entry* nfa_machine_execution_SET_alloc(size_t entries_len)
 {
-	nfa_machine_SET_entry* transition_to_seen = malloc(machine->transitions_len * sizeof(nfa_machine_SET_entry));
+	nfa_machine_SET_entry* transition_to_seen = malloc(C_NFA_MAX(entries_len, 1) * sizeof(nfa_machine_SET_entry));
 
-	for (size_t transition_index = 0; transition_index < machine->transitions_len; ++transition_index)
+	for (size_t transition_index = 0; transition_index < entries_len; ++transition_index)
 	{
 		transition_to_seen[transition_index].contexts = NULL;
 		transition_to_seen[transition_index].contexts_len = 0;
+		transition_to_seen[transition_index].contexts_capacity = 0;
 	}
+	C_NFA_STATS_ADD(allocations, 1);
 
 	return transition_to_seen;
 }
 
-nfa_machine_SET_entry* nfa_machine_execution_SET_free(const nfa_machine* machine, const nfa_machine_SET_entry* SET_table)
+void nfa_machine_execution_SET_free(nfa_machine_SET_entry* SET_table, size_t entries_len)
 {
-	for (size_t transition_index = 0; transition_index < machine->transitions_len; ++transition_index)
+	for (size_t transition_index = 0; transition_index < entries_len; ++transition_index)
 	{
 		free(SET_table[transition_index].contexts);
 	}
@@ -163,14 +316,11 @@ void nfa_machine_execution_SET_add(const nfa_machine* machine, nfa_machine_SET_e
 {
 	nfa_machine_SET_entry* entry = &SET_table[transition_index];
 
-	if (entry->contexts_len == 0)
-	{
-		entry->contexts = malloc(sizeof(nfa_machine_execution_context));
-	}
-	else
+	if (entry->contexts_len == entry->contexts_capacity)
 	{
-		C_NFA_ASSERT(entry->contexts != NULL);
-		entry->contexts = realloc(entry->contexts, sizeof(nfa_machine_execution_context) * (entry->contexts_len + 1));
+		entry->contexts_capacity = entry->contexts_capacity == 0 ? 4 : 2 * entry->contexts_capacity;
+		entry->contexts = realloc(entry->contexts, sizeof(nfa_machine_execution_context) * entry->contexts_capacity);
+		C_NFA_STATS_ADD(allocations, 1);
 	}
 
 	nfa_machine_execution_context* top = &entry->contexts[entry->contexts_len];
@@ -198,25 +348,29 @@ void debug_print_SET_table(const nfa_machine* machine, const nfa_machine_SET_ent
 }
 
 // need to handle infinite epsilons being added
-int nfa_machine_execute(const nfa_machine* machine, const char* string)
+// Contexts hold the states of the frozen machine, which tell apart the passes through counter bodies, while
+// transitions are still taken from machine
+int nfa_machine_execute_backtrack(const nfa_machine* machine, const nfa_frozen_machine* frozen, const uint8_t* data, size_t len)
 {
 	nfa_machine_execution_stack* stack = nfa_machine_execution_stack_alloc();
-	nfa_machine_execution_stack_push(stack, machine->start_state_index, 0);
+	nfa_machine_execution_stack_push(stack, frozen->start_state_index, 0);
 
-	nfa_machine_SET_entry* SET_table = nfa_machine_execution_SET_alloc(machine);
+	size_t SET_len = machine->transitions_len + 2 * (size_t)frozen->counters_len;
+	nfa_machine_SET_entry* SET_table = nfa_machine_execution_SET_alloc(SET_len);
 
 	nfa_machine_execution_context top;
 	while (nfa_machine_execution_stack_pop(stack, &top))
 	{
 		//printf("Context: (%llu, %llu)\n", top.current_state, top.current_string_index);
 		//debug_print_SET_table(machine, SET_table);
+		uint32_t graph_state = nfa_frozen_graph_state(frozen, (uint32_t)top.current_state);
 
 		// add all outgoing epsilon transitions
 		for (size_t transition_index = 0; transition_index < machine->transitions_len; ++transition_index)
 		{
 			const nfa_transition* transition = &machine->transitions[transition_index];
 
-			if (transition->from_state_index == top.current_state)
+			if (transition->from_state_index == graph_state)
 			{
 				if (transition->rule == C_NFA_EPSILON)
 				{
@@ -224,28 +378,61 @@ int nfa_machine_execute(const nfa_machine* machine, const char* string)
 					{
 						// we can take this transition
 						//printf("Taking EPSILON transition(%d) (%llu -> %llu)\n", transition_index, transition->from_state_index, transition->to_state_index);
-						nfa_machine_execution_stack_push(stack, transition->to_state_index, top.current_string_index);
+						nfa_machine_execution_stack_push(stack, nfa_frozen_state_target(frozen, (uint32_t)top.current_state, graph_state, (uint32_t)transition->to_state_index), top.current_string_index);
 						nfa_machine_execution_SET_add(machine, SET_table, transition_index, top);
+						C_NFA_STATS_ADD(epsilon_expansions, 1);
 					}
 					else
 					{
+						C_NFA_STATS_ADD(set_hits, 1);
 						//printf("Seen EPSILON transition(%d) before (%llu -> %llu)\n", transition_index, transition->from_state_index, transition->to_state_index);
 					}
 				}
 			}
 		}
 
+		// and the e-transitions of every counter whose body ends here, innermost first
+		uint32_t passes = frozen->counters_len > 0 ? (uint32_t)top.current_state - frozen->pass_offsets[graph_state] : 0;
+		for (uint32_t counter_index = frozen->counters_len > 0 ? frozen->graph_state_counters[graph_state] : C_NFA_NO_COUNTER; counter_index != C_NFA_NO_COUNTER; counter_index = frozen->counters[counter_index].parent)
+		{
+			uint32_t counter_passes = frozen->counters[counter_index].passes;
+			uint32_t pass = passes % counter_passes + 1;
+			passes /= counter_passes;
+			if (frozen->counters[counter_index].last_state_index != graph_state)
+			{
+				continue;
+			}
+
+			uint32_t targets[2];
+			uint32_t target_graph_states[2];
+			uint32_t targets_len = nfa_frozen_counter_targets(frozen, (uint32_t)top.current_state, graph_state, counter_index, pass, targets, target_graph_states);
+			for (uint32_t target_index = 0; target_index < targets_len; ++target_index)
+			{
+				size_t SET_index = machine->transitions_len + 2 * (size_t)counter_index + target_index;
+				if (!nfa_machine_execution_SET_has(machine, SET_table, SET_index, top))
+				{
+					nfa_machine_execution_stack_push(stack, targets[target_index], top.current_string_index);
+					nfa_machine_execution_SET_add(machine, SET_table, SET_index, top);
+					C_NFA_STATS_ADD(epsilon_expansions, 1);
+				}
+				else
+				{
+					C_NFA_STATS_ADD(set_hits, 1);
+				}
+			}
+		}
+
 		// are we at the end of the string?
-		if (string[top.current_string_index] == '\0')
+		if (top.current_string_index == len)
 		{
 			// if so, return true if we're in a final state, otherwise false
 			for (size_t final_state_index = 0; final_state_index < machine->final_state_len; ++final_state_index)
 			{
-				if (machine->final_states[final_state_index] == top.current_state)
+				if (machine->final_states[final_state_index] == graph_state)
 				{
 					// we're at the end of the string and in a final state
-					nfa_machine_execution_SET_free(machine, SET_table);
-					free(stack);
+					nfa_machine_execution_SET_free(SET_table, SET_len);
+					nfa_machine_execution_stack_free(stack);
 					return 1;
 				}
 			}
@@ -254,17 +441,19 @@ int nfa_machine_execute(const nfa_machine* machine, const char* string)
 		else
 		{
 			// otherwise try all transitions and add them to the stack
+			C_NFA_STATS_ADD(bytes_consumed, 1);
 			for (size_t transition_index = 0; transition_index < machine->transitions_len; ++transition_index)
 			{
 				const nfa_transition* transition = &machine->transitions[transition_index];
 
-				if (transition->from_state_index == top.current_state)
+				if (transition->from_state_index == graph_state && transition->rule != C_NFA_EPSILON)
 				{
-					if (transition->rule == string[top.current_string_index])
+					C_NFA_STATS_ADD(transitions_scanned, 1);
+					if (data[top.current_string_index] >= transition->rule && data[top.current_string_index] <= transition->rule_last)
 					{
 						// we can take this transition
 						//printf("Taking '%c' transition(%d) (%llu -> %llu)\n", transition->rule, transition_index, transition->from_state_index, transition->to_state_index);
-						nfa_machine_execution_stack_push(stack, transition->to_state_index, top.current_string_index + 1);
+						nfa_machine_execution_stack_push(stack, nfa_frozen_state_target(frozen, (uint32_t)top.current_state, graph_state, (uint32_t)transition->to_state_index), top.current_string_index + 1);
 					}
 				}
 			}
@@ -272,11 +461,63 @@ int nfa_machine_execute(const nfa_machine* machine, const char* string)
 	}
 
 	// we've exhausted all routes, the string doesn't pass
-	nfa_machine_execution_SET_free(machine, SET_table);
-	free(stack);
+	nfa_machine_execution_SET_free(SET_table, SET_len);
+	nfa_machine_execution_stack_free(stack);
 	return 0;
 }
 
+// Runs the chosen engine, nfa_machine_execute_stats_n wraps it to collect counters
+int nfa_machine_execute_engine_n(const nfa_machine* machine, const uint8_t* data, size_t len, nfa_execution_mode mode)
+{
+	// every engine needs the frozen machine, if its counters expand it too far nothing passes
+	const nfa_frozen_machine* frozen = nfa_machine_compiled_frozen(machine);
+	if (frozen == NULL)
+	{
+		return 0;
+	}
+
+	switch (mode)
+	{
+		case NFA_EXECUTION_MODE_BACKTRACK:
+			return nfa_machine_execute_backtrack(machine, frozen, data, len);
+		case NFA_EXECUTION_MODE_LAZY_DFA:
+		{
+			// states cached by earlier executions are reused, a concurrent execution gets a lazy DFA of its own
+			nfa_lazy_dfa* dfa = nfa_machine_compiled_take_lazy_dfa(machine, frozen);
+			int result = nfa_lazy_dfa_execute_n(dfa, data, len);
+			nfa_machine_compiled_give_lazy_dfa(machine, dfa);
+			return result;
+		}
+		case NFA_EXECUTION_MODE_STATE_SET:
+		default:
+			return nfa_frozen_machine_execute_n(frozen, data, len, nfa_exec_scratch_thread());
+	}
+}
+
+int nfa_machine_execute_mode_n(const nfa_machine* machine, const uint8_t* data, size_t len, nfa_execution_mode mode)
+{
+#ifdef C_NFA_STATS_ENABLED
+	return nfa_machine_execute_stats_n(machine, data, len, mode, NULL);
+#else
+	return nfa_machine_execute_engine_n(machine, data, len, mode);
+#endif
+}
+
+int nfa_machine_execute_mode(const nfa_machine* machine, const char* string, nfa_execution_mode mode)
+{
+	return nfa_machine_execute_mode_n(machine, (const uint8_t*)string, strlen(string), mode);
+}
+
+int nfa_machine_execute_n(const nfa_machine* machine, const uint8_t* data, size_t len)
+{
+	return nfa_machine_execute_mode_n(machine, data, len, NFA_EXECUTION_MODE_STATE_SET);
+}
+
+int nfa_machine_execute(const nfa_machine* machine, const char* string)
+{
+	return nfa_machine_execute_n(machine, (const uint8_t*)string, strlen(string));
+}
+
 size_t get_machine_max_state_index(const nfa_machine* machine)
 {
 	size_t machine_max_state_index = machine->start_state_index;
@@ -293,6 +534,14 @@ size_t get_machine_max_state_index(const nfa_machine* machine)
 		machine_max_state_index = C_NFA_MAX(machine_max_state_index, machine->final_states[final_state_index]);
 	}
 
+	for (size_t counter_index = 0; counter_index < machine->counters_len; ++counter_index)
+	{
+		const nfa_counter* counter = &machine->counters[counter_index];
+		machine_max_state_index = C_NFA_MAX(machine_max_state_index, counter->first_state_index + counter->states_len - 1);
+		machine_max_state_index = C_NFA_MAX(machine_max_state_index, counter->last_state_index);
+		machine_max_state_index = C_NFA_MAX(machine_max_state_index, counter->exit_state_index);
+	}
+
 	return machine_max_state_index;
 }
 
@@ -330,6 +579,7 @@ nfa_machine* nfa_machine_union(const nfa_machine* machine_a, const nfa_machine*
 
 	// Copy over all transitions
 	{
+		nfa_machine_reserve(machine_union, 2 + machine_a->transitions_len + machine_b->transitions_len);
 		nfa_machine_add_transition(machine_union, 0, machine_a->start_state_index + machine_a_state_index_offset, C_NFA_EPSILON);
 		nfa_machine_add_transition(machine_union, 0, machine_b->start_state_index + machine_b_state_index_offset, C_NFA_EPSILON);
 
@@ -337,16 +587,70 @@ nfa_machine* nfa_machine_union(const nfa_machine* machine_a, const nfa_machine*
 		for (size_t transition_index = 0; transition_index < machine_a->transitions_len; ++transition_index)
 		{
 			const nfa_transition* transition = &machine_a->transitions[transition_index];
-			nfa_machine_add_transition(machine_union, transition->from_state_index + machine_a_state_index_offset, transition->to_state_index + machine_a_state_index_offset, transition->rule);
+			nfa_machine_add_range_transition(machine_union, transition->from_state_index + machine_a_state_index_offset, transition->to_state_index + machine_a_state_index_offset, transition->rule, transition->rule_last);
 		}
 
 		// machine_b
 		for (size_t transition_index = 0; transition_index < machine_b->transitions_len; ++transition_index)
 		{
 			const nfa_transition* transition = &machine_b->transitions[transition_index];
-			nfa_machine_add_transition(machine_union, transition->from_state_index + machine_b_state_index_offset, transition->to_state_index + machine_b_state_index_offset, transition->rule);
+			nfa_machine_add_range_transition(machine_union, transition->from_state_index + machine_b_state_index_offset, transition->to_state_index + machine_b_state_index_offset, transition->rule, transition->rule_last);
 		}
 	}
+	nfa_machine_add_counters(machine_union, machine_a, machine_a_state_index_offset);
+	nfa_machine_add_counters(machine_union, machine_b, machine_b_state_index_offset);
+
+	return machine_union;
+}
+
+nfa_machine* nfa_machine_union_n(const nfa_machine* const* machines, size_t machines_len, size_t** final_tags)
+{
+	nfa_machine* machine_union = nfa_machine_alloc();
+	machine_union->start_state_index = 0;
+
+	size_t final_state_len = 0;
+	size_t transitions_len = machines_len;
+	for (size_t machine_index = 0; machine_index < machines_len; ++machine_index)
+	{
+		final_state_len += machines[machine_index]->final_state_len;
+		transitions_len += machines[machine_index]->transitions_len;
+	}
+
+	machine_union->final_state_len = final_state_len;
+	machine_union->final_states = malloc(C_NFA_MAX(final_state_len, 1) * sizeof(int));
+	if (final_tags != NULL)
+	{
+		*final_tags = malloc(C_NFA_MAX(final_state_len, 1) * sizeof(size_t));
+	}
+	nfa_machine_reserve(machine_union, transitions_len);
+
+	// each machine is offset past the previous one, state 0 is the new initial state
+	size_t state_index_offset = 1;
+	size_t final_state_index = 0;
+	for (size_t machine_index = 0; machine_index < machines_len; ++machine_index)
+	{
+		const nfa_machine* machine = machines[machine_index];
+		nfa_machine_add_transition(machine_union, 0, machine->start_state_index + state_index_offset, C_NFA_EPSILON);
+
+		for (size_t transition_index = 0; transition_index < machine->transitions_len; ++transition_index)
+		{
+			const nfa_transition* transition = &machine->transitions[transition_index];
+			nfa_machine_add_range_transition(machine_union, transition->from_state_index + state_index_offset, transition->to_state_index + state_index_offset, transition->rule, transition->rule_last);
+		}
+		nfa_machine_add_counters(machine_union, machine, state_index_offset);
+
+		for (size_t index = 0; index < machine->final_state_len; ++index)
+		{
+			machine_union->final_states[final_state_index] = (int)(machine->final_states[index] + state_index_offset);
+			if (final_tags != NULL)
+			{
+				(*final_tags)[final_state_index] = machine_index;
+			}
+			++final_state_index;
+		}
+
+		state_index_offset += get_machine_max_state_index(machine) + 1;
+	}
 
 	return machine_union;
 }
@@ -372,17 +676,19 @@ nfa_machine* nfa_machine_concat(const nfa_machine* machine_a, const nfa_machine*
 	// Copy transitions
 	{
 		// machine_a
-		machine_concat->transitions_len = machine_a->transitions_len;
-		machine_concat->transitions = malloc(machine_concat->transitions_len * sizeof(nfa_transition));
+		nfa_machine_reserve(machine_concat, machine_a->transitions_len + machine_b->transitions_len + machine_a->final_state_len);
 		memcpy(machine_concat->transitions, machine_a->transitions, machine_a->transitions_len * sizeof(nfa_transition));
+		machine_concat->transitions_len = machine_a->transitions_len;
 
 		// machine_b
 		for (size_t transition_index = 0; transition_index < machine_b->transitions_len; ++transition_index)
 		{
 			const nfa_transition* transition = &machine_b->transitions[transition_index];
-			nfa_machine_add_transition(machine_concat, transition->from_state_index + machine_b_state_index_offset, transition->to_state_index + machine_b_state_index_offset, transition->rule);
+			nfa_machine_add_range_transition(machine_concat, transition->from_state_index + machine_b_state_index_offset, transition->to_state_index + machine_b_state_index_offset, transition->rule, transition->rule_last);
 		}
 	}
+	nfa_machine_add_counters(machine_concat, machine_a, 0);
+	nfa_machine_add_counters(machine_concat, machine_b, machine_b_state_index_offset);
 
 	// Add final transition from final states of machine_a to start state of machine_b
 	for (size_t state_index = 0; state_index < machine_a->final_state_len; ++state_index)
@@ -397,9 +703,10 @@ nfa_machine* nfa_machine_kleene_star(const nfa_machine* machine)
 {
 	// 1. Copy transitions from machine
 	nfa_machine* machine_star = nfa_machine_alloc();
-	machine_star->transitions_len = machine->transitions_len;
-	machine_star->transitions = malloc(machine->transitions_len * sizeof(nfa_transition));
+	nfa_machine_reserve(machine_star, machine->transitions_len + 2 + 2 * machine->final_state_len);
 	memcpy(machine_star->transitions, machine->transitions, machine->transitions_len * sizeof(nfa_transition));
+	machine_star->transitions_len = machine->transitions_len;
+	nfa_machine_add_counters(machine_star, machine, 0);
 
 	// 2. Set the start state to a new state Q
 	size_t machine_max_state_index = get_machine_max_state_index(machine);
@@ -453,8 +760,34 @@ void nfa_machine_dump(const nfa_machine* machine)
 	for (size_t index = 0; index < machine->transitions_len; ++index)
 	{
 		const nfa_transition* transition = &machine->transitions[index];
-		printf("\t\t%llu -- %c --> %llu\n", transition->from_state_index, transition->rule ? transition->rule : ' ', transition->to_state_index);
+		if (transition->rule != transition->rule_last)
+		{
+			printf("\t\t%llu -- [\\x%02x-\\x%02x] --> %llu\n", transition->from_state_index, transition->rule, transition->rule_last, transition->to_state_index);
+		}
+		else if (transition->rule == C_NFA_EPSILON || (transition->rule >= ' ' && transition->rule <= '~'))
+		{
+			printf("\t\t%llu -- %c --> %llu\n", transition->from_state_index, transition->rule != C_NFA_EPSILON ? transition->rule : ' ', transition->to_state_index);
+		}
+		else
+		{
+			printf("\t\t%llu -- \\x%02x --> %llu\n", transition->from_state_index, transition->rule, transition->to_state_index);
+		}
 	}
 	printf("\t]\n");
+	if (machine->counters_len > 0)
+	{
+		printf("\tCounters: [\n");
+		for (size_t index = 0; index < machine->counters_len; ++index)
+		{
+			const nfa_counter* counter = &machine->counters[index];
+			printf("\t\t[%zu, %zu) %zu -> %zu {%zu,", counter->first_state_index, counter->first_state_index + counter->states_len, counter->last_state_index, counter->exit_state_index, counter->min);
+			if (counter->max != C_NFA_COUNTER_UNBOUNDED)
+			{
+				printf("%zu", counter->max);
+			}
+			printf("}\n");
+		}
+		printf("\t]\n");
+	}
 	printf("]\n");
 }
\ No newline at end of file
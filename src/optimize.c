@@ -0,0 +1,378 @@
+#include <c_nfa/nfa.h>
+#include <c_nfa/frozen.h>
+
+#include "util.h"
+#include "state_set.h"
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct
+{
+	uint32_t from_state_index;
+	uint32_t to_state_index;
+	unsigned char rule;
+	unsigned char rule_last;
+} nfa_optimize_edge;
+
+int nfa_optimize_edge_compare(const void* a, const void* b)
+{
+	const nfa_optimize_edge* edge_a = a;
+	const nfa_optimize_edge* edge_b = b;
+	if (edge_a->from_state_index != edge_b->from_state_index)
+	{
+		return edge_a->from_state_index < edge_b->from_state_index ? -1 : 1;
+	}
+	if (edge_a->rule != edge_b->rule)
+	{
+		return edge_a->rule < edge_b->rule ? -1 : 1;
+	}
+	if (edge_a->rule_last != edge_b->rule_last)
+	{
+		return edge_a->rule_last < edge_b->rule_last ? -1 : 1;
+	}
+	return (edge_a->to_state_index > edge_b->to_state_index) - (edge_a->to_state_index < edge_b->to_state_index);
+}
+
+// Sorts edges and removes duplicates, returns the new length
+size_t nfa_optimize_edges_unique(nfa_optimize_edge* edges, size_t edges_len)
+{
+	if (edges_len == 0)
+	{
+		return 0;
+	}
+	qsort(edges, edges_len, sizeof(nfa_optimize_edge), nfa_optimize_edge_compare);
+
+	size_t unique_len = 1;
+	for (size_t index = 1; index < edges_len; ++index)
+	{
+		if (nfa_optimize_edge_compare(&edges[unique_len - 1], &edges[index]) != 0)
+		{
+			edges[unique_len++] = edges[index];
+		}
+	}
+	return unique_len;
+}
+
+// Outgoing signature of a state while merging, [final, block, (rule and rule_last, target block)...]
+typedef struct
+{
+	uint32_t* values;
+	size_t* offsets; // states_len + 1 entries
+} nfa_optimize_signatures;
+
+int nfa_optimize_signature_equals(const nfa_optimize_signatures* signatures, uint32_t state_a, uint32_t state_b)
+{
+	size_t len_a = signatures->offsets[state_a + 1] - signatures->offsets[state_a];
+	size_t len_b = signatures->offsets[state_b + 1] - signatures->offsets[state_b];
+	return len_a == len_b && memcmp(signatures->values + signatures->offsets[state_a], signatures->values + signatures->offsets[state_b], len_a * sizeof(uint32_t)) == 0;
+}
+
+// Splits blocks until every state in a block has the same finality and the same transitions into
+// the same blocks, such states accept the same language so each block can become a single state
+uint32_t nfa_optimize_merge(const nfa_optimize_edge* edges, size_t edges_len, const unsigned char* is_final, uint32_t states_len, uint32_t* block_of)
+{
+	// edges are sorted by from_state_index, so each state's edges are contiguous
+	size_t* edge_offsets = calloc((size_t)states_len + 1, sizeof(size_t));
+	for (size_t index = 0; index < edges_len; ++index)
+	{
+		++edge_offsets[edges[index].from_state_index + 1];
+	}
+	for (uint32_t state = 0; state < states_len; ++state)
+	{
+		edge_offsets[state + 1] += edge_offsets[state];
+	}
+
+	nfa_optimize_signatures signatures;
+	signatures.values = malloc((2 * (size_t)states_len + 2 * edges_len) * sizeof(uint32_t));
+	signatures.offsets = malloc(((size_t)states_len + 1) * sizeof(size_t));
+	nfa_optimize_edge* scratch_edges = malloc(C_NFA_MAX(edges_len, 1) * sizeof(nfa_optimize_edge));
+	uint32_t* new_block_of = malloc(states_len * sizeof(uint32_t));
+
+	size_t table_capacity = 16;
+	while (table_capacity < 2 * (size_t)states_len)
+	{
+		table_capacity *= 2;
+	}
+	uint32_t* table = malloc(table_capacity * sizeof(uint32_t)); // slots hold state + 1 and 0 when empty
+
+	// every state starts in one block, the first round splits it by finality since that is part of the signature
+	uint32_t blocks_len = 0;
+	memset(block_of, 0, states_len * sizeof(uint32_t));
+
+	for (;;)
+	{
+		size_t values_len = 0;
+		for (uint32_t state = 0; state < states_len; ++state)
+		{
+			signatures.offsets[state] = values_len;
+			signatures.values[values_len++] = is_final[state];
+			signatures.values[values_len++] = block_of[state];
+
+			size_t state_edges_len = edge_offsets[state + 1] - edge_offsets[state];
+			for (size_t index = 0; index < state_edges_len; ++index)
+			{
+				scratch_edges[index] = edges[edge_offsets[state] + index];
+				scratch_edges[index].to_state_index = block_of[scratch_edges[index].to_state_index];
+			}
+			state_edges_len = nfa_optimize_edges_unique(scratch_edges, state_edges_len);
+			for (size_t index = 0; index < state_edges_len; ++index)
+			{
+				signatures.values[values_len++] = scratch_edges[index].rule | (uint32_t)scratch_edges[index].rule_last << 8;
+				signatures.values[values_len++] = scratch_edges[index].to_state_index;
+			}
+		}
+		signatures.offsets[states_len] = values_len;
+
+		memset(table, 0, table_capacity * sizeof(uint32_t));
+		uint32_t new_blocks_len = 0;
+		for (uint32_t state = 0; state < states_len; ++state)
+		{
+			size_t signature_len = signatures.offsets[state + 1] - signatures.offsets[state];
+			size_t slot = nfa_frozen_states_hash(signatures.values + signatures.offsets[state], (uint32_t)signature_len) & (table_capacity - 1);
+			while (table[slot] != 0 && !nfa_optimize_signature_equals(&signatures, table[slot] - 1, state))
+			{
+				slot = (slot + 1) & (table_capacity - 1);
+			}
+			if (table[slot] == 0)
+			{
+				table[slot] = state + 1;
+				new_block_of[state] = new_blocks_len++;
+			}
+			else
+			{
+				new_block_of[state] = new_block_of[table[slot] - 1];
+			}
+		}
+
+		memcpy(block_of, new_block_of, states_len * sizeof(uint32_t));
+
+		// the signature includes the old block so blocks are only ever split, no new blocks means we're done
+		if (new_blocks_len == blocks_len)
+		{
+			break;
+		}
+		blocks_len = new_blocks_len;
+	}
+
+	free(edge_offsets);
+	free(signatures.values);
+	free(signatures.offsets);
+	free(scratch_edges);
+	free(new_block_of);
+	free(table);
+
+	return blocks_len;
+}
+
+nfa_machine* nfa_machine_optimize(const nfa_machine* machine)
+{
+	nfa_frozen_machine* frozen = nfa_machine_freeze(machine);
+	if (frozen == NULL)
+	{
+		return NULL;
+	}
+	uint32_t frozen_states_len = frozen->states_len;
+
+	// 1. Remove e-transitions, a state takes every character transition of its e-closure and is final
+	// if its e-closure contains a final state. Only states reachable from the start state are visited
+	uint32_t* new_index = malloc(frozen_states_len * sizeof(uint32_t));
+	for (uint32_t state = 0; state < frozen_states_len; ++state)
+	{
+		new_index[state] = UINT32_MAX;
+	}
+	uint32_t* queue = malloc(frozen_states_len * sizeof(uint32_t));
+	uint32_t queue_len = 0;
+	unsigned char* is_final = calloc(frozen_states_len, sizeof(unsigned char));
+
+	uint32_t* scratch = calloc(4 * (size_t)frozen_states_len, sizeof(uint32_t));
+	nfa_frozen_state_set closure = { .dense = scratch, .sparse = scratch + frozen_states_len, .graph_states = scratch + 2 * (size_t)frozen_states_len, .len = 0 };
+	uint32_t* stack = scratch + 3 * (size_t)frozen_states_len;
+
+	size_t edges_capacity = C_NFA_MAX(machine->transitions_len, 16);
+	size_t edges_len = 0;
+	nfa_optimize_edge* edges = malloc(edges_capacity * sizeof(nfa_optimize_edge));
+
+	new_index[frozen->start_state_index] = queue_len;
+	queue[queue_len++] = frozen->start_state_index;
+	for (uint32_t queue_index = 0; queue_index < queue_len; ++queue_index)
+	{
+		uint32_t state = queue[queue_index];
+
+		closure.len = 0;
+		nfa_frozen_state_set_add_closure(frozen, &closure, state, nfa_frozen_graph_state(frozen, state), stack);
+		for (uint32_t set_index = 0; set_index < closure.len; ++set_index)
+		{
+			uint32_t closure_state = closure.dense[set_index];
+			uint32_t graph_state = closure.graph_states[set_index];
+			if (C_NFA_BITSET_HAS(frozen->final_bitmap, graph_state))
+			{
+				is_final[queue_index] = 1;
+			}
+
+			for (uint32_t edge_index = frozen->byte_offsets[graph_state]; edge_index < frozen->byte_offsets[graph_state + 1]; ++edge_index)
+			{
+				const nfa_frozen_edge* frozen_edge = &frozen->byte_edges[edge_index];
+				uint32_t to_state = nfa_frozen_state_target(frozen, closure_state, graph_state, frozen_edge->to_state_index);
+				if (new_index[to_state] == UINT32_MAX)
+				{
+					new_index[to_state] = queue_len;
+					queue[queue_len++] = to_state;
+				}
+
+				if (edges_len == edges_capacity)
+				{
+					edges_capacity *= 2;
+					edges = realloc(edges, edges_capacity * sizeof(nfa_optimize_edge));
+				}
+				nfa_optimize_edge* edge = &edges[edges_len++];
+				edge->from_state_index = queue_index;
+				edge->to_state_index = new_index[to_state];
+				edge->rule = frozen_edge->rule;
+				edge->rule_last = frozen_edge->rule_last;
+			}
+		}
+	}
+	uint32_t states_len = queue_len;
+	edges_len = nfa_optimize_edges_unique(edges, edges_len);
+
+	free(scratch);
+	free(queue);
+	free(new_index);
+	nfa_frozen_machine_free(frozen);
+
+	// 2. Drop dead states, i.e. states from which no final state can be reached
+	unsigned char* is_live = calloc(states_len, sizeof(unsigned char));
+	{
+		uint32_t* reverse_offsets = calloc((size_t)states_len + 1, sizeof(uint32_t));
+		uint32_t* reverse_states = malloc(C_NFA_MAX(edges_len, 1) * sizeof(uint32_t));
+		for (size_t index = 0; index < edges_len; ++index)
+		{
+			++reverse_offsets[edges[index].to_state_index + 1];
+		}
+		for (uint32_t state = 0; state < states_len; ++state)
+		{
+			reverse_offsets[state + 1] += reverse_offsets[state];
+		}
+		uint32_t* cursors = malloc(states_len * sizeof(uint32_t));
+		memcpy(cursors, reverse_offsets, states_len * sizeof(uint32_t));
+		for (size_t index = 0; index < edges_len; ++index)
+		{
+			reverse_states[cursors[edges[index].to_state_index]++] = edges[index].from_state_index;
+		}
+
+		uint32_t* live_stack = cursors;
+		uint32_t live_stack_len = 0;
+		for (uint32_t state = 0; state < states_len; ++state)
+		{
+			if (is_final[state])
+			{
+				is_live[state] = 1;
+				live_stack[live_stack_len++] = state;
+			}
+		}
+		while (live_stack_len > 0)
+		{
+			uint32_t state = live_stack[--live_stack_len];
+			for (uint32_t index = reverse_offsets[state]; index < reverse_offsets[state + 1]; ++index)
+			{
+				uint32_t from_state = reverse_states[index];
+				if (!is_live[from_state])
+				{
+					is_live[from_state] = 1;
+					live_stack[live_stack_len++] = from_state;
+				}
+			}
+		}
+
+		free(reverse_offsets);
+		free(reverse_states);
+		free(cursors);
+	}
+
+	// the start state is kept even if it is dead, so a machine matching nothing still has one. States are
+	// renumbered in order so the edges stay sorted and the start state stays 0
+	is_live[0] = 1;
+	uint32_t* live_index = malloc(states_len * sizeof(uint32_t));
+	uint32_t live_states_len = 0;
+	for (uint32_t state = 0; state < states_len; ++state)
+	{
+		if (is_live[state])
+		{
+			is_final[live_states_len] = is_final[state];
+			live_index[state] = live_states_len++;
+		}
+	}
+
+	// every target of a dead state is dead too, so this drops the edges out of dead states as well
+	size_t live_edges_len = 0;
+	for (size_t index = 0; index < edges_len; ++index)
+	{
+		if (is_live[edges[index].to_state_index])
+		{
+			nfa_optimize_edge* edge = &edges[live_edges_len++];
+			*edge = edges[index];
+			edge->from_state_index = live_index[edge->from_state_index];
+			edge->to_state_index = live_index[edge->to_state_index];
+		}
+	}
+	edges_len = live_edges_len;
+	states_len = live_states_len;
+	free(live_index);
+
+	// 3. Merge states with equivalent behaviour
+	uint32_t* block_of = malloc(C_NFA_MAX(states_len, 1) * sizeof(uint32_t));
+	uint32_t blocks_len = nfa_optimize_merge(edges, edges_len, is_final, states_len, block_of);
+
+	nfa_machine* optimized = nfa_machine_alloc();
+	optimized->start_state_index = block_of[0];
+
+	for (size_t index = 0; index < edges_len; ++index)
+	{
+		edges[index].from_state_index = block_of[edges[index].from_state_index];
+		edges[index].to_state_index = block_of[edges[index].to_state_index];
+	}
+	edges_len = nfa_optimize_edges_unique(edges, edges_len);
+
+	if (edges_len > 0)
+	{
+		nfa_machine_reserve(optimized, edges_len);
+		optimized->transitions_len = edges_len;
+		for (size_t index = 0; index < edges_len; ++index)
+		{
+			optimized->transitions[index].from_state_index = edges[index].from_state_index;
+			optimized->transitions[index].to_state_index = edges[index].to_state_index;
+			optimized->transitions[index].rule = edges[index].rule;
+			optimized->transitions[index].rule_last = edges[index].rule_last;
+		}
+	}
+
+	unsigned char* is_block_final = calloc(C_NFA_MAX(blocks_len, 1), sizeof(unsigned char));
+	for (uint32_t state = 0; state < states_len; ++state)
+	{
+		if (is_final[state] && !is_block_final[block_of[state]])
+		{
+			is_block_final[block_of[state]] = 1;
+			++optimized->final_state_len;
+		}
+	}
+	if (optimized->final_state_len > 0)
+	{
+		optimized->final_states = malloc(optimized->final_state_len * sizeof(int));
+		size_t final_state_index = 0;
+		for (uint32_t block = 0; block < blocks_len; ++block)
+		{
+			if (is_block_final[block])
+			{
+				optimized->final_states[final_state_index++] = (int)block;
+			}
+		}
+	}
+
+	free(is_block_final);
+	free(block_of);
+	free(is_live);
+	free(is_final);
+	free(edges);
+
+	return optimized;
+}
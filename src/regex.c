@@ -1,138 +1,449 @@
 #include <stdlib.h>
 #include <stdio.h>
-#include <assert.h>
 #include <string.h>
 
 #include <c_nfa/regex.h>
 
+// All nodes of a parsed regex live in one block that is freed in one go by regex_free. A counted
+// repetition points at its body once rather than copying it, so every input character adds at most
+// two nodes, plus two for the final alternative, and slot 0 is kept for the root so the block can be
+// freed through the root node
 typedef struct
 {
-    const char* input;
-    size_t input_len;
-    size_t cursor;
-} regex_parse_context;
+    regex_t* nodes;
+    size_t* sizes; // nodes the subtree of each node would have with counted repetitions copied out, capped past C_NFA_REGEX_EXPANDED_MAX
+    size_t nodes_len;
+} regex_arena;
 
-regex_t* regex_parse_regex(regex_parse_context* context);
-regex_t* regex_parse_term(regex_parse_context* context);
-regex_t* regex_parse_factor(regex_parse_context* context);
-regex_t* regex_parse_base(regex_parse_context* context);
+// One frame per open parenthesis, the whole pattern is the bottom frame
+typedef struct
+{
+    regex_t* alternation; // union of the alternatives finished so far, NULL if there are none
+    regex_t* term; // concatenation of the current alternative, NULL if it is empty
+    size_t open_position; // cursor of the '(' that opened the frame
+} regex_parse_frame;
 
-char regex_parser_peek(const regex_parse_context* context)
+regex_t* regex_arena_node(regex_arena* arena, regex_type type)
 {
-    return context->input[context->cursor];
+    arena->sizes[arena->nodes_len] = 1;
+    regex_t* node = &arena->nodes[arena->nodes_len++];
+    node->type = type;
+    return node;
 }
 
-void regex_parser_eat(regex_parse_context* context, char c)
+// Sizes are filled in as nodes are made, children always come first, so no node is measured twice
+size_t regex_arena_size(const regex_arena* arena, const regex_t* node)
 {
-    if (regex_parser_peek(context) == c)
-    {
-        ++context->cursor; // TODO: Bounds check
-        return;
-    }
-    fprintf(stderr, "Expected '%c', got '%c'\n", c, regex_parser_peek(context));
-    assert(0);
+    return node != NULL ? arena->sizes[node - arena->nodes] : 0;
 }
 
-char regex_parser_next(regex_parse_context* context)
+regex_t* regex_arena_pair(regex_arena* arena, regex_type type, regex_t* first, regex_t* second)
 {
-    assert(regex_parser_more(context));
-
-    char c = regex_parser_peek(context);
-    regex_parser_eat(context, c);
-    return c;
+    regex_t* node = regex_arena_node(arena, type);
+    node->data.pair.first = first;
+    node->data.pair.second = second;
+    size_t size = 1 + regex_arena_size(arena, first) + regex_arena_size(arena, second);
+    arena->sizes[node - arena->nodes] = size <= C_NFA_REGEX_EXPANDED_MAX ? size : C_NFA_REGEX_EXPANDED_MAX + 1;
+    return node;
 }
 
-int regex_parser_more(regex_parse_context* context)
+// x{m,n} counts as its body copied n times, or max(m, 1) times for x{m,}, which is how many passes
+// through it execution tells apart
+regex_t* regex_arena_repeat(regex_arena* arena, regex_t* first, uint32_t min, uint32_t max)
 {
-    return context->cursor < context->input_len;
+    regex_t* node = regex_arena_node(arena, REPEAT);
+    node->data.repeat.first = first;
+    node->data.repeat.min = min;
+    node->data.repeat.max = max;
+    size_t copies = max != C_NFA_REGEX_REPEAT_UNBOUNDED ? max : (min > 1 ? min : 1);
+    size_t size = 1 + regex_arena_size(arena, first) * copies;
+    arena->sizes[node - arena->nodes] = size <= C_NFA_REGEX_EXPANDED_MAX ? size : C_NFA_REGEX_EXPANDED_MAX + 1;
+    return node;
 }
 
-// Parsers
+// Returns the union of every alternative in the frame, an empty alternative is a BLANK
+regex_t* regex_parse_frame_finish(regex_arena* arena, const regex_parse_frame* frame)
+{
+    regex_t* term = frame->term != NULL ? frame->term : regex_arena_node(arena, BLANK);
+    return frame->alternation != NULL ? regex_arena_pair(arena, UNION, frame->alternation, term) : term;
+}
 
-regex_t* regex_parse_regex(regex_parse_context* context)
+// Returns the value of a hex digit, or -1 if c isn't one
+int regex_hex_digit(char c)
 {
-    regex_t* term = regex_parse_term(context);
+    if (c >= '0' && c <= '9')
+    {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f')
+    {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F')
+    {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+#define REGEX_CLASS_HAS(bytes, byte) (((bytes)[(byte) / 64] >> ((byte) % 64)) & 1)
+#define REGEX_CLASS_SET(bytes, byte) ((bytes)[(byte) / 64] |= (uint64_t)1 << ((byte) % 64))
 
-    if (regex_parser_more(context) && regex_parser_peek(context) == '|')
+// Reads the byte at *cursor, which may be escaped, and moves *cursor past it. On error *cursor is left alone
+regex_error regex_parse_byte(const char* input, size_t input_len, size_t* cursor, uint8_t* byte)
+{
+    if (input[*cursor] != '\\')
     {
-        regex_parser_eat(context, '|');
-        regex_t* regex = regex_parse_regex(context);
-        regex_t* res = malloc(sizeof(regex_t));
-        res->type = UNION;
-        res->data.pair.first = term;
-        res->data.pair.second = regex;
-        return res;
+        *byte = (uint8_t)input[*cursor];
+        *cursor += 1;
+        return REGEX_OK;
     }
-    else
+    if (*cursor + 1 == input_len)
     {
-        return term;
+        return REGEX_ERROR_TRAILING_ESCAPE;
+    }
+    if (input[*cursor + 1] == 'x')
+    {
+        // \xHH matches the byte with hex value HH, which is the only way to match '\0'
+        int high = *cursor + 2 < input_len ? regex_hex_digit(input[*cursor + 2]) : -1;
+        int low = *cursor + 3 < input_len ? regex_hex_digit(input[*cursor + 3]) : -1;
+        if (high < 0 || low < 0)
+        {
+            return REGEX_ERROR_INVALID_ESCAPE;
+        }
+        *byte = (uint8_t)(high * 16 + low);
+        *cursor += 4;
+        return REGEX_OK;
     }
+    // \n, \t and \r are the control characters, any other escaped byte stands for itself
+    switch (input[*cursor + 1])
+    {
+        case 'n':
+            *byte = '\n';
+            break;
+        case 't':
+            *byte = '\t';
+            break;
+        case 'r':
+            *byte = '\r';
+            break;
+        default:
+            *byte = (uint8_t)input[*cursor + 1];
+            break;
+    }
+    *cursor += 2;
+    return REGEX_OK;
 }
 
-regex_t* regex_parse_term(regex_parse_context* context)
+// Parses the class [...] or [^...] that opens at *cursor into bytes and moves *cursor past the ']'. A ']' straight
+// after the opening bracket and a '-' at either end are literals. On error *cursor is set to where the error is
+regex_error regex_parse_class(const char* input, size_t input_len, size_t* cursor, uint64_t* bytes)
 {
-    regex_t* factor = malloc(sizeof(regex_t));
-    factor->type = BLANK;
+    size_t position = *cursor + 1;
+    int negated = position < input_len && input[position] == '^';
+    position += negated;
+    memset(bytes, 0, 4 * sizeof(uint64_t));
 
-    while (regex_parser_more(context) && regex_parser_peek(context) != ')' && regex_parser_peek(context) != '|')
+    size_t items_start = position;
+    while (position < input_len && (input[position] != ']' || position == items_start))
     {
-        regex_t* next_factor = regex_parse_factor(context);
-        regex_t* new_factor = malloc(sizeof(regex_t));
-        new_factor->type = CONCAT;
-        new_factor->data.pair.first = factor;
-        new_factor->data.pair.second = next_factor;
-        factor = new_factor;
+        size_t range_position = position;
+        uint8_t first;
+        uint8_t last;
+        regex_error error = regex_parse_byte(input, input_len, &position, &first);
+        last = first;
+        if (error == REGEX_OK && position + 1 < input_len && input[position] == '-' && input[position + 1] != ']')
+        {
+            ++position;
+            error = regex_parse_byte(input, input_len, &position, &last);
+            if (error == REGEX_OK && last < first)
+            {
+                error = REGEX_ERROR_INVALID_RANGE;
+                position = range_position;
+            }
+        }
+        if (error != REGEX_OK)
+        {
+            *cursor = position;
+            return error;
+        }
+
+        for (size_t byte = first; byte <= last; ++byte)
+        {
+            REGEX_CLASS_SET(bytes, byte);
+        }
     }
 
-    return factor;
+    if (position == input_len)
+    {
+        return REGEX_ERROR_UNMATCHED_OPEN_BRACKET;
+    }
+    if (negated)
+    {
+        for (size_t word = 0; word < 4; ++word)
+        {
+            bytes[word] = ~bytes[word];
+        }
+    }
+    *cursor = position + 1;
+    return REGEX_OK;
 }
 
-regex_t* regex_parse_factor(regex_parse_context* context)
+// Parses the bound {m}, {m,} or {m,n} that opens at *cursor and moves *cursor past the '}'. Returns 0 and leaves
+// *cursor alone if the '{' doesn't start a bound, it is then a literal
+int regex_parse_repeat(const char* input, size_t input_len, size_t* cursor, uint32_t* min, uint32_t* max, regex_error* error)
 {
-    regex_t* base = regex_parse_base(context);
-
-    while (regex_parser_more(context) && regex_parser_peek(context) == '*')
+    size_t position = *cursor + 1;
+    uint64_t bounds[2] = { 0, 0 };
+    size_t bounds_len = 0;
+    int has_comma = 0;
+    for (;;)
     {
-        regex_parser_eat(context, '*');
-        regex_t* new_base = malloc(sizeof(regex_t));
-        new_base->type = STAR;
-        new_base->data.pair.first = base;
-        new_base->data.pair.second = NULL;
-        base = new_base;
+        size_t digits_start = position;
+        uint64_t value = 0;
+        while (position < input_len && input[position] >= '0' && input[position] <= '9')
+        {
+            // keep counting digits past the limit without overflowing, it is reported below
+            value = value > C_NFA_REGEX_REPEAT_MAX ? value : value * 10 + (uint64_t)(input[position] - '0');
+            ++position;
+        }
+        if (position == digits_start && !(has_comma && position < input_len && input[position] == '}'))
+        {
+            return 0;
+        }
+        bounds[bounds_len++] = position == digits_start ? C_NFA_REGEX_REPEAT_UNBOUNDED : value;
+
+        if (position < input_len && input[position] == ',' && !has_comma)
+        {
+            has_comma = 1;
+            ++position;
+            continue;
+        }
+        if (position < input_len && input[position] == '}')
+        {
+            break;
+        }
+        return 0;
     }
 
-    return base;
+    *min = (uint32_t)bounds[0];
+    *max = has_comma ? (uint32_t)bounds[1] : (uint32_t)bounds[0];
+    if (*min > C_NFA_REGEX_REPEAT_MAX || (*max > C_NFA_REGEX_REPEAT_MAX && *max != C_NFA_REGEX_REPEAT_UNBOUNDED))
+    {
+        *error = REGEX_ERROR_REPEAT_TOO_LARGE;
+        return 1;
+    }
+    if (*max < *min)
+    {
+        *error = REGEX_ERROR_INVALID_REPEAT;
+        return 1;
+    }
+    *cursor = position + 1;
+    return 1;
 }
 
-regex_t* regex_parse_base(regex_parse_context* context)
+regex_error regex_try_parse(const char* input, regex_t** regex, size_t* error_position)
 {
-    switch (regex_parser_peek(context))
-    {
-    case '(':
+    size_t input_len = strlen(input);
+
+    regex_arena arena;
+    arena.nodes = malloc((2 * input_len + 3) * sizeof(regex_t));
+    arena.sizes = malloc((2 * input_len + 3) * sizeof(size_t));
+    arena.nodes_len = 1;
+
+    regex_parse_frame* frames = malloc((input_len + 1) * sizeof(regex_parse_frame));
+    size_t frames_len = 1;
+    frames[0].alternation = NULL;
+    frames[0].term = NULL;
+    frames[0].open_position = 0;
+
+    regex_error error = REGEX_OK;
+    size_t cursor = 0;
+    while (cursor < input_len && error == REGEX_OK)
     {
-        regex_parser_eat(context, '(');
-        regex_t* r = regex_parse_regex(context);
-        regex_parser_eat(context, ')');
-        return r;
+        regex_parse_frame* frame = &frames[frames_len - 1];
+        regex_t* atom = NULL;
+
+        switch (input[cursor])
+        {
+            case '(':
+            {
+                regex_parse_frame* group = &frames[frames_len++];
+                group->alternation = NULL;
+                group->term = NULL;
+                group->open_position = cursor;
+                ++cursor;
+                break;
+            }
+            case ')':
+            {
+                if (frames_len == 1)
+                {
+                    error = REGEX_ERROR_UNMATCHED_CLOSE_PAREN;
+                    break;
+                }
+                atom = regex_parse_frame_finish(&arena, frame);
+                --frames_len;
+                ++cursor;
+                break;
+            }
+            case '|':
+            {
+                regex_t* term = frame->term != NULL ? frame->term : regex_arena_node(&arena, BLANK);
+                frame->alternation = frame->alternation != NULL ? regex_arena_pair(&arena, UNION, frame->alternation, term) : term;
+                frame->term = NULL;
+                ++cursor;
+                break;
+            }
+            case '{':
+            {
+                uint32_t min;
+                uint32_t max;
+                size_t repeat_cursor = cursor;
+                if (!regex_parse_repeat(input, input_len, &repeat_cursor, &min, &max, &error))
+                {
+                    atom = regex_arena_node(&arena, CHAR);
+                    atom->data.primitive = '{';
+                    ++cursor;
+                    break;
+                }
+                error = REGEX_ERROR_NOTHING_TO_REPEAT;
+                break;
+            }
+            case '*':
+            case '+':
+            case '?':
+            {
+                // a repetition that follows something is consumed along with it below
+                error = REGEX_ERROR_NOTHING_TO_REPEAT;
+                break;
+            }
+            case '\\':
+            {
+                uint8_t byte;
+                error = regex_parse_byte(input, input_len, &cursor, &byte);
+                if (error == REGEX_OK)
+                {
+                    atom = regex_arena_node(&arena, CHAR);
+                    atom->data.primitive = (char)byte;
+                }
+                break;
+            }
+            case '[':
+            {
+                uint64_t bytes[4];
+                error = regex_parse_class(input, input_len, &cursor, bytes);
+                if (error == REGEX_OK)
+                {
+                    atom = regex_arena_node(&arena, CLASS);
+                    memcpy(atom->data.bytes, bytes, sizeof(bytes));
+                }
+                break;
+            }
+            case '.':
+            {
+                // every byte except a newline
+                atom = regex_arena_node(&arena, CLASS);
+                memset(atom->data.bytes, 0xff, sizeof(atom->data.bytes));
+                atom->data.bytes['\n' / 64] &= ~((uint64_t)1 << ('\n' % 64));
+                ++cursor;
+                break;
+            }
+            default:
+            {
+                atom = regex_arena_node(&arena, CHAR);
+                atom->data.primitive = input[cursor];
+                ++cursor;
+                break;
+            }
+        }
+
+        if (atom != NULL)
+        {
+            while (cursor < input_len && error == REGEX_OK)
+            {
+                if (input[cursor] == '*' || input[cursor] == '+' || input[cursor] == '?')
+                {
+                    regex_type type = input[cursor] == '*' ? STAR : (input[cursor] == '+' ? PLUS : OPTIONAL);
+                    atom = regex_arena_pair(&arena, type, atom, NULL);
+                    ++cursor;
+                    continue;
+                }
+
+                uint32_t min;
+                uint32_t max;
+                size_t repeat_position = cursor;
+                if (input[cursor] != '{' || !regex_parse_repeat(input, input_len, &cursor, &min, &max, &error) || error != REGEX_OK)
+                {
+                    break;
+                }
+                atom = regex_arena_repeat(&arena, atom, min, max);
+                if (regex_arena_size(&arena, atom) > C_NFA_REGEX_EXPANDED_MAX)
+                {
+                    error = REGEX_ERROR_REPEAT_TOO_LARGE;
+                    cursor = repeat_position;
+                }
+            }
+
+            frame = &frames[frames_len - 1];
+            frame->term = frame->term != NULL ? regex_arena_pair(&arena, CONCAT, frame->term, atom) : atom;
+        }
     }
-    case '\\':
+
+    if (error == REGEX_OK && frames_len > 1)
     {
-        regex_parser_eat(context, '\\');
-        char esc = regex_parser_next(context);
-        regex_t* r = malloc(sizeof(regex_t));
-        r->type = CHAR;
-        r->data.primitive = esc;
-        return r;
+        error = REGEX_ERROR_UNMATCHED_OPEN_PAREN;
+        cursor = frames[frames_len - 1].open_position;
     }
-    default:
+
+    if (error != REGEX_OK)
     {
-        char next = regex_parser_next(context);
-        regex_t* r = malloc(sizeof(regex_t));
-        r->type = CHAR;
-        r->data.primitive = next;
-        return r;
+        free(frames);
+        free(arena.nodes);
+        free(arena.sizes);
+        if (error_position != NULL)
+        {
+            *error_position = cursor;
+        }
+        *regex = NULL;
+        return error;
     }
+
+    // nothing points at the root so it can be moved into slot 0
+    arena.nodes[0] = *regex_parse_frame_finish(&arena, &frames[0]);
+    free(frames);
+    free(arena.sizes);
+
+    *regex = &arena.nodes[0];
+    return REGEX_OK;
+}
+
+const char* regex_error_string(regex_error error)
+{
+    switch (error)
+    {
+        case REGEX_OK:
+            return "no error";
+        case REGEX_ERROR_UNMATCHED_OPEN_PAREN:
+            return "unmatched '('";
+        case REGEX_ERROR_UNMATCHED_CLOSE_PAREN:
+            return "unmatched ')'";
+        case REGEX_ERROR_NOTHING_TO_REPEAT:
+            return "'*', '+', '?' or '{m,n}' does not follow anything to repeat";
+        case REGEX_ERROR_TRAILING_ESCAPE:
+            return "'\\' at the end of the pattern";
+        case REGEX_ERROR_INVALID_ESCAPE:
+            return "'\\x' is not followed by two hex digits";
+        case REGEX_ERROR_UNMATCHED_OPEN_BRACKET:
+            return "unmatched '['";
+        case REGEX_ERROR_INVALID_RANGE:
+            return "range in a class ends before it starts";
+        case REGEX_ERROR_INVALID_REPEAT:
+            return "'{m,n}' has n smaller than m";
+        case REGEX_ERROR_REPEAT_TOO_LARGE:
+            return "'{m,n}' repeats too many times";
     }
+    return "unknown error";
 }
 
 void dump_regex_internal(const regex_t* regex)
@@ -177,10 +488,44 @@ void dump_regex_internal(const regex_t* regex)
             break;
         }
         case STAR:
+        case PLUS:
+        case OPTIONAL:
         {
             printf("(");
             dump_regex_internal(regex->data.pair.first);
-            printf(")*");
+            printf(")%c", regex->type == STAR ? '*' : (regex->type == PLUS ? '+' : '?'));
+            break;
+        }
+        case REPEAT:
+        {
+            printf("(");
+            dump_regex_internal(regex->data.repeat.first);
+            if (regex->data.repeat.max == C_NFA_REGEX_REPEAT_UNBOUNDED)
+            {
+                printf("){%u,}", regex->data.repeat.min);
+            }
+            else
+            {
+                printf("){%u,%u}", regex->data.repeat.min, regex->data.repeat.max);
+            }
+            break;
+        }
+        case CLASS:
+        {
+            printf("[");
+            for (size_t byte = 0; byte < 256; ++byte)
+            {
+                if (REGEX_CLASS_HAS(regex->data.bytes, byte) && (byte == 0 || !REGEX_CLASS_HAS(regex->data.bytes, byte - 1)))
+                {
+                    size_t last = byte;
+                    while (last < 255 && REGEX_CLASS_HAS(regex->data.bytes, last + 1))
+                    {
+                        ++last;
+                    }
+                    printf(last == byte ? "\\x%02zx" : "\\x%02zx-\\x%02zx", byte, last);
+                }
+            }
+            printf("]");
             break;
         }
     }
@@ -194,31 +539,13 @@ void dump_regex(const regex_t* regex)
 
 regex_t* regex_parse(const char* input)
 {
-    regex_parse_context context = {
-        .input = input,
-        .input_len = strlen(input),
-        .cursor = 0
-    };
-
-    return regex_parse_regex(&context);
+    regex_t* regex;
+    regex_try_parse(input, &regex, NULL);
+    return regex;
 }
 
 void regex_free(regex_t* regex)
 {
-    switch (regex->type)
-    {
-        case UNION:
-        case CONCAT:
-        {
-            regex_free(regex->data.pair.first);
-            regex_free(regex->data.pair.second);
-            break;
-        }
-        case STAR:
-        {
-            regex_free(regex->data.pair.first);
-            break;
-        }
-    }
+    // the root node is the start of the block holding every node
     free(regex);
-}
\ No newline at end of file
+}
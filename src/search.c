@@ -0,0 +1,222 @@
+#include <c_nfa/search.h>
+
+#include "util.h"
+#include "state_set.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define C_NFA_SEARCH_SSE2
+#include <emmintrin.h>
+#endif
+
+// Returns the offset of the first occurrence of the machine's prefilter in data at or after from, SIZE_MAX if there is none
+size_t nfa_search_find_prefilter(const nfa_frozen_machine* machine, const uint8_t* data, size_t len, size_t from)
+{
+	const uint8_t* literal = machine->prefilter;
+	size_t literal_len = machine->prefilter_len;
+	if (len < literal_len)
+	{
+		return SIZE_MAX;
+	}
+	size_t last = len - literal_len; // last offset the literal fits at
+	size_t offset = from;
+
+#ifdef C_NFA_SEARCH_SSE2
+	// check 16 offsets at once for the first and last byte of the literal, only comparing the rest where both are there
+	__m128i first = _mm_set1_epi8((char)literal[0]);
+	__m128i final = _mm_set1_epi8((char)literal[literal_len - 1]);
+	for (; offset + 16 <= last + 1; offset += 16)
+	{
+		__m128i head = _mm_loadu_si128((const __m128i*)(data + offset));
+		__m128i tail = _mm_loadu_si128((const __m128i*)(data + offset + literal_len - 1));
+		unsigned mask = (unsigned)_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(head, first), _mm_cmpeq_epi8(tail, final)));
+		for (size_t bit = 0; mask != 0; ++bit, mask >>= 1)
+		{
+			if ((mask & 1) && memcmp(data + offset + bit, literal, literal_len) == 0)
+			{
+				return offset + bit;
+			}
+		}
+	}
+#endif
+
+	while (offset <= last)
+	{
+		const uint8_t* found = memchr(data + offset, literal[0], last + 1 - offset);
+		if (found == NULL)
+		{
+			return SIZE_MAX;
+		}
+		offset = (size_t)(found - data);
+		if (memcmp(found, literal, literal_len) == 0)
+		{
+			return offset;
+		}
+		++offset;
+	}
+	return SIZE_MAX;
+}
+
+// Adds the e-closure of state to set, recording thread_start for every state that wasn't already in it
+void nfa_search_add_thread(const nfa_frozen_machine* machine, nfa_frozen_state_set* set, size_t* starts, uint32_t state, uint32_t graph_state, size_t thread_start, uint32_t* stack)
+{
+	uint32_t old_len = set->len;
+	nfa_frozen_state_set_add_closure(machine, set, state, graph_state, stack);
+	for (uint32_t index = old_len; index < set->len; ++index)
+	{
+		starts[index] = thread_start;
+	}
+}
+
+// Same as an anchored execution except a new thread is started from the start state at every offset, as if
+// the start state had a self-loop on every byte. Threads are kept in the order they started, so when a state
+// is reached by several threads it keeps the earliest start, and the first final state in the set belongs to
+// the leftmost match. If the machine has a prefilter, threads are only started where the literal can still be
+// found, and input where no thread is running is skipped to the next occurrence of the literal
+int nfa_frozen_machine_search_from(const nfa_frozen_machine* machine, const uint8_t* data, size_t len, size_t from, nfa_match* match, nfa_exec_scratch* scratch)
+{
+	if (scratch == NULL)
+	{
+		nfa_exec_scratch* call_scratch = nfa_exec_scratch_alloc();
+		int result = nfa_frozen_machine_search_from(machine, data, len, from, match, call_scratch);
+		nfa_exec_scratch_free(call_scratch);
+		return result;
+	}
+
+	nfa_exec_scratch_prepare(scratch, machine->states_len);
+	uint32_t start_graph_state = nfa_frozen_graph_state(machine, machine->start_state_index);
+
+	int found = 0;
+	nfa_match best = { 0, 0 };
+
+	int use_prefilter = machine->prefilter_len > 0;
+	size_t candidate = use_prefilter ? nfa_search_find_prefilter(machine, data, len, from) : 0; // next offset the literal is at
+
+	for (size_t position = from; position <= len; ++position)
+	{
+		int can_start = 1;
+		if (use_prefilter)
+		{
+			if (candidate != SIZE_MAX && candidate < position)
+			{
+				candidate = nfa_search_find_prefilter(machine, data, len, position);
+			}
+			if (candidate == SIZE_MAX && scratch->current.len == 0)
+			{
+				break;
+			}
+			if (machine->prefilter_is_prefix)
+			{
+				if (!found && scratch->current.len == 0)
+				{
+					position = candidate;
+				}
+				can_start = position == candidate;
+			}
+			else
+			{
+				can_start = candidate != SIZE_MAX;
+			}
+		}
+
+		// once something has matched, any thread starting later can't be leftmost
+		if (!found && can_start)
+		{
+			nfa_search_add_thread(machine, &scratch->current, scratch->current_starts, machine->start_state_index, start_graph_state, position, scratch->stack);
+		}
+
+		for (uint32_t set_index = 0; set_index < scratch->current.len; ++set_index)
+		{
+			if (C_NFA_BITSET_HAS(machine->final_bitmap, scratch->current.graph_states[set_index]))
+			{
+				size_t start = scratch->current_starts[set_index];
+				if (!found || start < best.start || (start == best.start && position > best.end))
+				{
+					found = 1;
+					best.start = start;
+					best.end = position;
+				}
+				break;
+			}
+		}
+
+		if (found)
+		{
+			// drop the threads that started after the best match, they are all at the end of the set
+			uint32_t kept_len = 0;
+			while (kept_len < scratch->current.len && scratch->current_starts[kept_len] <= best.start)
+			{
+				++kept_len;
+			}
+			scratch->current.len = kept_len;
+		}
+
+		if (position == len || (found && scratch->current.len == 0))
+		{
+			break;
+		}
+
+		uint8_t c = data[position];
+		scratch->next.len = 0;
+		for (uint32_t set_index = 0; set_index < scratch->current.len; ++set_index)
+		{
+			uint32_t state = scratch->current.dense[set_index];
+			uint32_t graph_state = scratch->current.graph_states[set_index];
+			size_t thread_start = scratch->current_starts[set_index];
+			for (uint32_t index = machine->byte_offsets[graph_state]; index < machine->byte_offsets[graph_state + 1]; ++index)
+			{
+				const nfa_frozen_edge* edge = &machine->byte_edges[index];
+				if (c >= edge->rule && c <= edge->rule_last)
+				{
+					uint32_t to_state = nfa_frozen_state_target(machine, state, graph_state, edge->to_state_index);
+					nfa_search_add_thread(machine, &scratch->next, scratch->next_starts, to_state, edge->to_state_index, thread_start, scratch->stack);
+				}
+			}
+		}
+
+		nfa_frozen_state_set tmp = scratch->current;
+		scratch->current = scratch->next;
+		scratch->next = tmp;
+		size_t* tmp_starts = scratch->current_starts;
+		scratch->current_starts = scratch->next_starts;
+		scratch->next_starts = tmp_starts;
+	}
+
+	if (found)
+	{
+		*match = best;
+	}
+	return found;
+}
+
+int nfa_frozen_machine_search(const nfa_frozen_machine* machine, const uint8_t* data, size_t len, nfa_match* match, nfa_exec_scratch* scratch)
+{
+	return nfa_frozen_machine_search_from(machine, data, len, 0, match, scratch);
+}
+
+void nfa_match_iterator_init(nfa_match_iterator* iterator, const nfa_frozen_machine* machine, const uint8_t* data, size_t len, nfa_exec_scratch* scratch)
+{
+	iterator->machine = machine;
+	iterator->data = data;
+	iterator->len = len;
+	iterator->position = 0;
+	iterator->scratch = scratch;
+}
+
+int nfa_match_iterator_next(nfa_match_iterator* iterator, nfa_match* match)
+{
+	if (iterator->position > iterator->len)
+	{
+		return 0;
+	}
+
+	if (!nfa_frozen_machine_search_from(iterator->machine, iterator->data, iterator->len, iterator->position, match, iterator->scratch))
+	{
+		iterator->position = iterator->len + 1;
+		return 0;
+	}
+
+	iterator->position = match->end > match->start ? match->end : match->end + 1;
+	return 1;
+}
@@ -0,0 +1,152 @@
+#include <c_nfa/set.h>
+#include <c_nfa/core.h>
+
+#include "util.h"
+#include "state_set.h"
+#include <stdlib.h>
+#include <string.h>
+
+struct nfa_regex_set
+{
+	nfa_frozen_machine* machine;
+	size_t patterns_len;
+
+	// patterns that accept in each state, pattern_offsets has states_len + 1 entries
+	uint32_t* pattern_offsets;
+	uint32_t* patterns;
+};
+
+nfa_regex_set* nfa_regex_set_compile(const char* const* patterns, size_t patterns_len, size_t* error_index)
+{
+	nfa_machine** machines = calloc(C_NFA_MAX(patterns_len, 1), sizeof(nfa_machine*));
+	for (size_t pattern_index = 0; pattern_index < patterns_len; ++pattern_index)
+	{
+		machines[pattern_index] = (nfa_machine*)regex_to_nfa(patterns[pattern_index]);
+		if (machines[pattern_index] == NULL)
+		{
+			if (error_index != NULL)
+			{
+				*error_index = pattern_index;
+			}
+			for (size_t index = 0; index < pattern_index; ++index)
+			{
+				nfa_machine_free(machines[index]);
+			}
+			free(machines);
+			return NULL;
+		}
+	}
+
+	size_t* final_tags;
+	nfa_machine* machine = nfa_machine_union_n((const nfa_machine* const*)machines, patterns_len, &final_tags);
+	for (size_t pattern_index = 0; pattern_index < patterns_len; ++pattern_index)
+	{
+		nfa_machine_free(machines[pattern_index]);
+	}
+	free(machines);
+
+	nfa_frozen_machine* frozen = nfa_machine_freeze(machine);
+	if (frozen == NULL)
+	{
+		if (error_index != NULL)
+		{
+			*error_index = patterns_len;
+		}
+		free(final_tags);
+		nfa_machine_free(machine);
+		return NULL;
+	}
+
+	nfa_regex_set* set = malloc(sizeof(nfa_regex_set));
+	set->machine = frozen;
+	set->patterns_len = patterns_len;
+
+	// the frozen machine keeps the state indexes as graph states, so the tags can be grouped by final state
+	uint32_t states_len = set->machine->graph_states_len;
+	set->pattern_offsets = calloc((size_t)states_len + 1, sizeof(uint32_t));
+	set->patterns = malloc(C_NFA_MAX(machine->final_state_len, 1) * sizeof(uint32_t));
+	for (size_t index = 0; index < machine->final_state_len; ++index)
+	{
+		++set->pattern_offsets[machine->final_states[index] + 1];
+	}
+	for (uint32_t state = 0; state < states_len; ++state)
+	{
+		set->pattern_offsets[state + 1] += set->pattern_offsets[state];
+	}
+	uint32_t* cursor = malloc((size_t)states_len * sizeof(uint32_t));
+	memcpy(cursor, set->pattern_offsets, (size_t)states_len * sizeof(uint32_t));
+	for (size_t index = 0; index < machine->final_state_len; ++index)
+	{
+		set->patterns[cursor[machine->final_states[index]]++] = (uint32_t)final_tags[index];
+	}
+	free(cursor);
+
+	free(final_tags);
+	nfa_machine_free(machine);
+	return set;
+}
+
+void nfa_regex_set_free(nfa_regex_set* set)
+{
+	nfa_frozen_machine_free(set->machine);
+	free(set->pattern_offsets);
+	free(set->patterns);
+	free(set);
+}
+
+size_t nfa_regex_set_patterns_len(const nfa_regex_set* set)
+{
+	return set->patterns_len;
+}
+
+size_t nfa_regex_set_mask_words(const nfa_regex_set* set)
+{
+	return C_NFA_BITSET_WORDS(set->patterns_len);
+}
+
+size_t nfa_regex_set_execute_n(const nfa_regex_set* set, const uint8_t* data, size_t len, uint64_t* matched, nfa_exec_scratch* scratch)
+{
+	if (scratch == NULL)
+	{
+		nfa_exec_scratch* call_scratch = nfa_exec_scratch_alloc();
+		size_t result = nfa_regex_set_execute_n(set, data, len, matched, call_scratch);
+		nfa_exec_scratch_free(call_scratch);
+		return result;
+	}
+
+	const nfa_frozen_machine* machine = set->machine;
+	memset(matched, 0, nfa_regex_set_mask_words(set) * sizeof(uint64_t));
+
+	nfa_exec_scratch_prepare(scratch, machine->states_len);
+	nfa_frozen_state_set_add_closure(machine, &scratch->current, machine->start_state_index, nfa_frozen_graph_state(machine, machine->start_state_index), scratch->stack);
+
+	for (size_t data_index = 0; data_index < len && scratch->current.len > 0; ++data_index)
+	{
+		nfa_frozen_state_set_step(machine, &scratch->current, &scratch->next, data[data_index], scratch->stack);
+
+		nfa_frozen_state_set tmp = scratch->current;
+		scratch->current = scratch->next;
+		scratch->next = tmp;
+	}
+
+	size_t matched_len = 0;
+	for (uint32_t set_index = 0; set_index < scratch->current.len; ++set_index)
+	{
+		uint32_t graph_state = scratch->current.graph_states[set_index];
+		for (uint32_t index = set->pattern_offsets[graph_state]; index < set->pattern_offsets[graph_state + 1]; ++index)
+		{
+			uint32_t pattern = set->patterns[index];
+			if (!C_NFA_BITSET_HAS(matched, pattern))
+			{
+				C_NFA_BITSET_SET(matched, pattern);
+				++matched_len;
+			}
+		}
+	}
+	return matched_len;
+}
+
+size_t nfa_regex_set_execute(const nfa_regex_set* set, const char* string, uint64_t* matched, nfa_exec_scratch* scratch)
+{
+	return nfa_regex_set_execute_n(set, (const uint8_t*)string, strlen(string), matched, scratch);
+}
@@ -0,0 +1,78 @@
+#ifndef C_NFA_STATE_SET_H
+#define C_NFA_STATE_SET_H
+
+#include <c_nfa/frozen.h>
+
+#include <stdint.h>
+
+// Sparse set of active states, dense holds the members in insertion order, graph_states the graph state of
+// each of them, and sparse maps a state back to its slot in dense, all hold states_len entries
+typedef struct
+{
+	uint32_t* dense;
+	uint32_t* sparse;
+	uint32_t* graph_states;
+	uint32_t len;
+} nfa_frozen_state_set;
+
+int nfa_frozen_state_set_has(const nfa_frozen_state_set* set, uint32_t state);
+
+void nfa_frozen_state_set_insert(nfa_frozen_state_set* set, uint32_t state, uint32_t graph_state);
+
+// Adds state, whose graph state is graph_state, and every state reachable from it via e-transitions, stack must
+// hold states_len entries
+void nfa_frozen_state_set_add_closure(const nfa_frozen_machine* machine, nfa_frozen_state_set* set, uint32_t state, uint32_t graph_state, uint32_t* stack);
+
+// Consumes one character, next is cleared then filled with every state reachable from current
+void nfa_frozen_state_set_step(const nfa_frozen_machine* machine, const nfa_frozen_state_set* current, nfa_frozen_state_set* next, unsigned char c, uint32_t* stack);
+
+// Returns 1 if any state in the set is a final state, 0 otherwise
+int nfa_frozen_state_set_is_accepting(const nfa_frozen_machine* machine, const nfa_frozen_state_set* set);
+
+// qsort comparator ordering counters by where their bodies start, a body holding another comes first
+int nfa_frozen_counters_compare(const void* a, const void* b);
+
+// Innermost counter whose body holds graph_state, C_NFA_NO_COUNTER if there is none, found from the counters
+// alone so it can fill or check graph_state_counters
+uint32_t nfa_frozen_counter_search(const nfa_frozen_machine* machine, uint32_t graph_state);
+
+// Graph state whose edges state follows, a binary search over pass_offsets so execution keeps the graph state
+// of every active state instead, see nfa_frozen_state_set
+uint32_t nfa_frozen_graph_state(const nfa_frozen_machine* machine, uint32_t state);
+
+// State reached by an edge from state, whose graph state is graph_state, to to_graph_state
+uint32_t nfa_frozen_state_target(const nfa_frozen_machine* machine, uint32_t state, uint32_t graph_state, uint32_t to_graph_state);
+
+// Fills targets with the states reached by the e-transitions of counter_index from state, whose graph state is
+// the counter's last state and whose pass through its body is pass, and target_graph_states with their graph
+// states. Returns how many there are, at most 2
+uint32_t nfa_frozen_counter_targets(const nfa_frozen_machine* machine, uint32_t state, uint32_t graph_state, uint32_t counter_index, uint32_t pass, uint32_t* targets, uint32_t* target_graph_states);
+
+// Buffers for stepping a frozen machine, sized for capacity states and only ever grown
+struct nfa_exec_scratch
+{
+	uint32_t* memory;
+	uint32_t capacity;
+	nfa_frozen_state_set current;
+	nfa_frozen_state_set next;
+	uint32_t* stack;
+
+	// offset where the thread in each slot of current.dense and next.dense started, only used when searching
+	size_t* current_starts;
+	size_t* next_starts;
+};
+
+// Grows the buffers to hold states_len states if needed and empties both sets
+void nfa_exec_scratch_prepare(nfa_exec_scratch* scratch, uint32_t states_len);
+
+// Scratch of the calling thread, allocated on first use and freed when the thread exits. Only one execution
+// at a time can use it, so it's for executions that don't call back into the library
+nfa_exec_scratch* nfa_exec_scratch_thread(void);
+
+// Hash of a sorted list of states, used to look up DFA states by the NFA states they stand for
+uint64_t nfa_frozen_states_hash(const uint32_t* states, uint32_t states_len);
+
+// qsort comparator for uint32_t states
+int nfa_frozen_states_compare(const void* a, const void* b);
+
+#endif
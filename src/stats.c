@@ -0,0 +1,108 @@
+#include <c_nfa/stats.h>
+
+#include "util.h"
+#include <string.h>
+
+// Runs the chosen engine without collecting counters, defined in nfa.c
+int nfa_machine_execute_engine_n(const nfa_machine* machine, const uint8_t* data, size_t len, nfa_execution_mode mode);
+
+#ifdef C_NFA_STATS_ENABLED
+#ifdef _MSC_VER
+#include <windows.h>
+#define c_nfa_atomic_add(pointer, value) InterlockedExchangeAdd64((volatile LONG64*)(pointer), (LONG64)(value))
+#define c_nfa_atomic_load(pointer) ((uint64_t)InterlockedCompareExchange64((volatile LONG64*)(pointer), 0, 0))
+#define c_nfa_atomic_compare_exchange(pointer, expected, desired) \
+	((uint64_t)InterlockedCompareExchange64((volatile LONG64*)(pointer), (LONG64)(desired), (LONG64)(expected)) == (expected))
+#else
+#define c_nfa_atomic_add(pointer, value) __atomic_fetch_add((pointer), (value), __ATOMIC_RELAXED)
+#define c_nfa_atomic_load(pointer) __atomic_load_n((pointer), __ATOMIC_RELAXED)
+#define c_nfa_atomic_compare_exchange(pointer, expected, desired) \
+	__atomic_compare_exchange_n((pointer), &(uint64_t){ (expected) }, (desired), 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED)
+#endif
+
+C_NFA_THREAD_LOCAL nfa_exec_stats* c_nfa_stats_current = NULL;
+
+static nfa_stats_callback stats_callback = NULL;
+static void* stats_callback_user_data = NULL;
+
+void nfa_machine_stats_accumulate(nfa_machine_stats* totals, const nfa_exec_stats* stats)
+{
+	c_nfa_atomic_add(&totals->executions, 1);
+	c_nfa_atomic_add(&totals->totals.contexts_pushed, stats->contexts_pushed);
+	c_nfa_atomic_add(&totals->totals.contexts_popped, stats->contexts_popped);
+	c_nfa_atomic_add(&totals->totals.epsilon_expansions, stats->epsilon_expansions);
+	c_nfa_atomic_add(&totals->totals.set_hits, stats->set_hits);
+	c_nfa_atomic_add(&totals->totals.transitions_scanned, stats->transitions_scanned);
+	c_nfa_atomic_add(&totals->totals.bytes_consumed, stats->bytes_consumed);
+	c_nfa_atomic_add(&totals->totals.allocations, stats->allocations);
+
+	uint64_t peak = c_nfa_atomic_load(&totals->totals.peak_stack_depth);
+	while (stats->peak_stack_depth > peak && !c_nfa_atomic_compare_exchange(&totals->totals.peak_stack_depth, peak, stats->peak_stack_depth))
+	{
+		peak = c_nfa_atomic_load(&totals->totals.peak_stack_depth);
+	}
+}
+#endif
+
+int nfa_machine_execute_stats_n(const nfa_machine* machine, const uint8_t* data, size_t len, nfa_execution_mode mode, nfa_exec_stats* stats)
+{
+	nfa_exec_stats call_stats;
+	memset(&call_stats, 0, sizeof(call_stats));
+
+#ifdef C_NFA_STATS_ENABLED
+	// restored afterwards in case this execution was started from inside another, e.g. by a callback
+	nfa_exec_stats* previous = c_nfa_stats_current;
+	c_nfa_stats_current = &call_stats;
+	int result = nfa_machine_execute_engine_n(machine, data, len, mode);
+	c_nfa_stats_current = previous;
+
+	if (machine->stats != NULL)
+	{
+		nfa_machine_stats_accumulate(machine->stats, &call_stats);
+	}
+	if (stats_callback != NULL)
+	{
+		stats_callback(machine, &call_stats, stats_callback_user_data);
+	}
+#else
+	int result = nfa_machine_execute_engine_n(machine, data, len, mode);
+#endif
+
+	if (stats != NULL)
+	{
+		*stats = call_stats;
+	}
+	return result;
+}
+
+void nfa_machine_get_stats(const nfa_machine* machine, nfa_machine_stats* stats)
+{
+	memset(stats, 0, sizeof(nfa_machine_stats));
+#ifdef C_NFA_STATS_ENABLED
+	if (machine->stats != NULL)
+	{
+		stats->executions = c_nfa_atomic_load(&machine->stats->executions);
+		stats->totals.contexts_pushed = c_nfa_atomic_load(&machine->stats->totals.contexts_pushed);
+		stats->totals.contexts_popped = c_nfa_atomic_load(&machine->stats->totals.contexts_popped);
+		stats->totals.epsilon_expansions = c_nfa_atomic_load(&machine->stats->totals.epsilon_expansions);
+		stats->totals.set_hits = c_nfa_atomic_load(&machine->stats->totals.set_hits);
+		stats->totals.transitions_scanned = c_nfa_atomic_load(&machine->stats->totals.transitions_scanned);
+		stats->totals.peak_stack_depth = c_nfa_atomic_load(&machine->stats->totals.peak_stack_depth);
+		stats->totals.bytes_consumed = c_nfa_atomic_load(&machine->stats->totals.bytes_consumed);
+		stats->totals.allocations = c_nfa_atomic_load(&machine->stats->totals.allocations);
+	}
+#else
+	(void)machine;
+#endif
+}
+
+void nfa_stats_set_callback(nfa_stats_callback callback, void* user_data)
+{
+#ifdef C_NFA_STATS_ENABLED
+	stats_callback = callback;
+	stats_callback_user_data = user_data;
+#else
+	(void)callback;
+	(void)user_data;
+#endif
+}
@@ -0,0 +1,89 @@
+#include <c_nfa/stream.h>
+
+#include "state_set.h"
+#include <stdlib.h>
+
+struct nfa_stream
+{
+	const nfa_frozen_machine* machine;
+	nfa_exec_scratch* scratch;
+	size_t bytes_fed;
+};
+
+nfa_stream* nfa_stream_begin(const nfa_frozen_machine* machine)
+{
+	nfa_stream* stream = malloc(sizeof(nfa_stream));
+	stream->machine = machine;
+	stream->scratch = nfa_exec_scratch_alloc();
+	stream->bytes_fed = 0;
+
+	nfa_exec_scratch_prepare(stream->scratch, machine->states_len);
+	nfa_frozen_state_set_add_closure(machine, &stream->scratch->current, machine->start_state_index, nfa_frozen_graph_state(machine, machine->start_state_index), stream->scratch->stack);
+
+	return stream;
+}
+
+void nfa_stream_feed(nfa_stream* stream, const uint8_t* data, size_t len)
+{
+	nfa_exec_scratch* scratch = stream->scratch;
+
+	for (size_t data_index = 0; data_index < len && scratch->current.len > 0; ++data_index)
+	{
+		nfa_frozen_state_set_step(stream->machine, &scratch->current, &scratch->next, data[data_index], scratch->stack);
+
+		nfa_frozen_state_set tmp = scratch->current;
+		scratch->current = scratch->next;
+		scratch->next = tmp;
+	}
+
+	stream->bytes_fed += len;
+}
+
+size_t nfa_stream_feed_budget(nfa_stream* stream, const uint8_t* data, size_t len, size_t* steps_left)
+{
+	nfa_exec_scratch* scratch = stream->scratch;
+
+	size_t data_index = 0;
+	for (; data_index < len && scratch->current.len > 0; ++data_index)
+	{
+		// stepping a byte costs one step per active state
+		if (scratch->current.len > *steps_left)
+		{
+			stream->bytes_fed += data_index;
+			return data_index;
+		}
+		*steps_left -= scratch->current.len;
+
+		nfa_frozen_state_set_step(stream->machine, &scratch->current, &scratch->next, data[data_index], scratch->stack);
+
+		nfa_frozen_state_set tmp = scratch->current;
+		scratch->current = scratch->next;
+		scratch->next = tmp;
+	}
+
+	stream->bytes_fed += len;
+	return len;
+}
+
+int nfa_stream_end(nfa_stream* stream)
+{
+	int result = nfa_stream_is_accepting(stream);
+	nfa_exec_scratch_free(stream->scratch);
+	free(stream);
+	return result;
+}
+
+int nfa_stream_is_accepting(const nfa_stream* stream)
+{
+	return nfa_frozen_state_set_is_accepting(stream->machine, &stream->scratch->current);
+}
+
+int nfa_stream_is_dead(const nfa_stream* stream)
+{
+	return stream->scratch->current.len == 0;
+}
+
+size_t nfa_stream_bytes_fed(const nfa_stream* stream)
+{
+	return stream->bytes_fed;
+}
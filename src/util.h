@@ -9,4 +9,29 @@
 
 #define C_NFA_MAX(a, b) ((a) > (b) ? (a) : (b))
 
-#endif
\ No newline at end of file
+// bitsets are stored as arrays of uint64_t words
+#define C_NFA_BITSET_WORDS(bits_len) (((bits_len) + 63) / 64)
+#define C_NFA_BITSET_HAS(bitset, index) (((bitset)[(index) / 64] >> ((index) % 64)) & 1)
+#define C_NFA_BITSET_SET(bitset, index) ((bitset)[(index) / 64] |= (uint64_t)1 << ((index) % 64))
+
+#ifdef _MSC_VER
+#define C_NFA_THREAD_LOCAL __declspec(thread)
+#else
+#define C_NFA_THREAD_LOCAL _Thread_local
+#endif
+
+// Execution counters, see stats.h. Each macro compiles to nothing unless C_NFA_STATS_ENABLED is defined
+#ifdef C_NFA_STATS_ENABLED
+#include <c_nfa/stats.h>
+
+// counters of the execution running on this thread, NULL outside nfa_machine_execute_stats_n
+extern C_NFA_THREAD_LOCAL nfa_exec_stats* c_nfa_stats_current;
+
+#define C_NFA_STATS_ADD(field, n) do { if (c_nfa_stats_current != NULL) { c_nfa_stats_current->field += (n); } } while (0)
+#define C_NFA_STATS_MAX(field, value) do { if (c_nfa_stats_current != NULL && (uint64_t)(value) > c_nfa_stats_current->field) { c_nfa_stats_current->field = (uint64_t)(value); } } while (0)
+#else
+#define C_NFA_STATS_ADD(field, n)
+#define C_NFA_STATS_MAX(field, value)
+#endif
+
+#endif
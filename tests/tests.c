@@ -1,10 +1,136 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <assert.h>
+#include <string.h>
 
 #include <c_nfa/core.h>
 #include <c_nfa/nfa.h>
 #include <c_nfa/regex.h>
+#include <c_nfa/frozen.h>
+#include <c_nfa/lazy_dfa.h>
+#include <c_nfa/dfa.h>
+#include <c_nfa/stream.h>
+#include <c_nfa/search.h>
+#include <c_nfa/set.h>
+#include <c_nfa/batch.h>
+#include <c_nfa/glushkov.h>
+#include <c_nfa/cache.h>
+#include <c_nfa/image.h>
+#include <c_nfa/stats.h>
+#include <c_nfa/cursor.h>
+
+#define C_NFA_TEST_BATCH_WORDS(inputs_len) (((inputs_len) + 63) / 64)
+
+void count_stats_callback(const nfa_machine* machine, const nfa_exec_stats* stats, void* user_data)
+{
+	(void)machine;
+	(void)stats;
+	++*(size_t*)user_data;
+}
+
+// Patterns over {a, b} with nested stars and empty branches, shared by the blocks that compare engines
+const char* test_patterns[] = { "(a|b)*", "a*b*", "(a*)*b", "(ab|a)*(b|)", "((a|)(b|))*a", "(a(b|a*)*)*", "", "a(b|c)d" };
+#define TEST_PATTERNS_LEN (sizeof(test_patterns) / sizeof(test_patterns[0]))
+
+// Runs input through an engine, returns 1 if it passes
+typedef int (*test_engine_run)(const void* engine, const char* input);
+
+int test_run_nfa(const void* engine, const char* input)
+{
+	return nfa_machine_execute(engine, input);
+}
+
+int test_run_backtrack(const void* engine, const char* input)
+{
+	return nfa_machine_execute_mode(engine, input, NFA_EXECUTION_MODE_BACKTRACK);
+}
+
+int test_run_frozen(const void* engine, const char* input)
+{
+	return nfa_frozen_machine_execute(engine, input);
+}
+
+int test_run_lazy_dfa(const void* engine, const char* input)
+{
+	return nfa_lazy_dfa_execute((nfa_lazy_dfa*)engine, input);
+}
+
+int test_run_dfa(const void* engine, const char* input)
+{
+	return dfa_machine_execute(engine, input);
+}
+
+int test_run_glushkov(const void* engine, const char* input)
+{
+	return nfa_glushkov_machine_execute(engine, input);
+}
+
+int test_run_regex(const void* engine, const char* input)
+{
+	return regex_execute(engine, input);
+}
+
+// Returns 1 if engine and expected_engine agree on every string over alphabet of up to max_len characters
+int check_engine_agrees(const void* engine, test_engine_run run, const void* expected_engine, test_engine_run expected_run, const char* alphabet, size_t max_len)
+{
+	size_t alphabet_len = strlen(alphabet);
+	char input[16];
+	for (size_t len = 0; len <= max_len && len < sizeof(input); ++len)
+	{
+		size_t combinations = 1;
+		for (size_t index = 0; index < len; ++index)
+		{
+			combinations *= alphabet_len;
+		}
+		for (size_t combination = 0; combination < combinations; ++combination)
+		{
+			size_t value = combination;
+			for (size_t index = 0; index < len; ++index, value /= alphabet_len)
+			{
+				input[index] = alphabet[value % alphabet_len];
+			}
+			input[len] = '\0';
+			if (run(engine, input) != expected_run(expected_engine, input))
+			{
+				return 0;
+			}
+		}
+	}
+	return 1;
+}
+
+// Returns 1 if every engine running pattern agrees with the state-set simulation of expected_pattern
+int check_pattern_agrees(const char* pattern, const char* expected_pattern, const char* alphabet, size_t max_len)
+{
+	nfa_machine* machine = regex_to_nfa(pattern);
+	nfa_machine* expected_machine = regex_to_nfa(expected_pattern);
+	nfa_machine* optimized = nfa_machine_optimize(machine);
+	nfa_frozen_machine* frozen = nfa_machine_freeze(machine);
+	nfa_lazy_dfa* lazy_dfa = nfa_lazy_dfa_alloc(frozen, C_NFA_LAZY_DFA_DEFAULT_BUDGET);
+	dfa_machine* dfa = nfa_to_dfa(machine, 1000);
+	dfa_machine* minimal = dfa_minimize(dfa);
+	regex_t* regex = regex_parse(pattern);
+	nfa_glushkov_machine* glushkov = regex_to_glushkov(regex);
+
+	int agrees = check_engine_agrees(machine, test_run_nfa, expected_machine, test_run_nfa, alphabet, max_len) &&
+		check_engine_agrees(machine, test_run_backtrack, expected_machine, test_run_nfa, alphabet, max_len) &&
+		check_engine_agrees(optimized, test_run_nfa, expected_machine, test_run_nfa, alphabet, max_len) &&
+		check_engine_agrees(lazy_dfa, test_run_lazy_dfa, expected_machine, test_run_nfa, alphabet, max_len) &&
+		check_engine_agrees(minimal, test_run_dfa, expected_machine, test_run_nfa, alphabet, max_len) &&
+		check_engine_agrees(pattern, test_run_regex, expected_machine, test_run_nfa, alphabet, max_len) &&
+		(glushkov == NULL || check_engine_agrees(glushkov, test_run_glushkov, expected_machine, test_run_nfa, alphabet, max_len));
+
+	nfa_glushkov_machine_free(glushkov);
+	regex_free(regex);
+	dfa_machine_free(minimal);
+	dfa_machine_free(dfa);
+	nfa_lazy_dfa_free(lazy_dfa);
+	nfa_frozen_machine_free(frozen);
+	nfa_machine_free(optimized);
+	nfa_machine_free(expected_machine);
+	nfa_machine_free(machine);
+	return agrees;
+}
 
 int main(void)
 {
@@ -25,4 +151,1046 @@ int main(void)
 
 	assert(regex_execute("", "") == 1);
 	assert(regex_execute("", "a") == 0);
+
+	// both execution engines agree
+	{
+		nfa_machine* machine = regex_to_nfa("(0|(1(01*(00)*0)*1)*)*");
+		const char* inputs[] = { "", "0", "1", "11", "110", "111", "1001", "1111", "10010", "111111111111111111111111111111" };
+		for (size_t index = 0; index < sizeof(inputs) / sizeof(inputs[0]); ++index)
+		{
+			assert(nfa_machine_execute_mode(machine, inputs[index], NFA_EXECUTION_MODE_STATE_SET) == nfa_machine_execute_mode(machine, inputs[index], NFA_EXECUTION_MODE_BACKTRACK));
+		}
+		assert(nfa_machine_execute(machine, "1111") == 1);
+		assert(nfa_machine_execute(machine, "111") == 0);
+		nfa_machine_free(machine);
+	}
+
+	// compiled machine
+	{
+		nfa_machine* machine = nfa_machine_alloc();
+		machine->start_state_index = 0;
+		machine->final_states = malloc(sizeof(int));
+		machine->final_states[0] = 1;
+		machine->final_state_len = 1;
+		nfa_machine_add_transition(machine, 0, 1, 'a');
+		nfa_machine_add_transition(machine, 0, 2, 'b');
+		nfa_machine_add_transition(machine, 1, 2, C_NFA_EPSILON);
+		nfa_machine_add_transition(machine, 2, 1, C_NFA_EPSILON);
+		nfa_machine_add_transition(machine, 1, 1, 'a');
+		nfa_machine_add_transition(machine, 2, 2, 'b');
+
+		// execution keeps its compiled form until another transition is added
+		assert(nfa_machine_execute(machine, "ab") == 1 && nfa_machine_execute(machine, "c") == 0);
+		nfa_machine_add_transition(machine, 0, 1, 'c');
+		assert(nfa_machine_execute(machine, "c") == 1 && nfa_machine_execute(machine, "cc") == 0);
+		machine->transitions_len--;
+		nfa_machine_invalidate(machine);
+		assert(nfa_machine_execute(machine, "c") == 0);
+
+		nfa_frozen_machine* frozen = nfa_machine_freeze(machine);
+		nfa_machine_free(machine);
+
+		assert(frozen->states_len == 3);
+		assert(frozen->epsilon_offsets[1] - frozen->epsilon_offsets[0] == 0);
+		assert(frozen->byte_offsets[1] - frozen->byte_offsets[0] == 2);
+		assert(nfa_frozen_machine_is_final(frozen, 1) == 1);
+		assert(nfa_frozen_machine_is_final(frozen, 2) == 0);
+
+		assert(nfa_frozen_machine_execute(frozen, "") == 0);
+		assert(nfa_frozen_machine_execute(frozen, "a") == 1);
+		assert(nfa_frozen_machine_execute(frozen, "b") == 1);
+		assert(nfa_frozen_machine_execute(frozen, "babbababbabbabaaababab") == 1);
+		assert(nfa_frozen_machine_execute(frozen, "abc") == 0);
+		nfa_frozen_machine_free(frozen);
+	}
+
+	// precomputed e-closures give the same answers as the backtracking engine
+	{
+		for (size_t pattern_index = 0; pattern_index < TEST_PATTERNS_LEN; ++pattern_index)
+		{
+			nfa_machine* machine = regex_to_nfa(test_patterns[pattern_index]);
+			nfa_frozen_machine* frozen = nfa_machine_freeze(machine);
+			assert(frozen->closure_offsets != NULL);
+			assert(check_engine_agrees(frozen, test_run_frozen, machine, test_run_backtrack, "abcd", 6));
+
+			nfa_frozen_machine_free(frozen);
+			nfa_machine_free(machine);
+		}
+	}
+
+	// lazy DFA, with a roomy budget and with one small enough to force flushes and the NFA fallback
+	{
+		nfa_machine* machine = regex_to_nfa("(0|(1(01*(00)*0)*1)*)*");
+		nfa_frozen_machine* frozen = nfa_machine_freeze(machine);
+		nfa_lazy_dfa* roomy = nfa_lazy_dfa_alloc(frozen, C_NFA_LAZY_DFA_DEFAULT_BUDGET);
+		nfa_lazy_dfa* tiny = nfa_lazy_dfa_alloc(frozen, 100); // room for about two states
+
+		// binary numbers 0 to 511, a multiple of 3 passes
+		char input[16];
+		for (size_t number = 0; number < 512; ++number)
+		{
+			size_t len = 0;
+			for (size_t bit = 10; bit > 0; --bit)
+			{
+				if (len > 0 || ((number >> (bit - 1)) & 1))
+				{
+					input[len++] = (number >> (bit - 1)) & 1 ? '1' : '0';
+				}
+			}
+			input[len] = '\0';
+
+			int expected = number % 3 == 0;
+			assert(nfa_lazy_dfa_execute(roomy, input) == expected);
+			assert(nfa_lazy_dfa_execute(tiny, input) == expected);
+			assert(nfa_lazy_dfa_states_len(tiny) <= 3); // the table and set pool count against the budget too
+		}
+		assert(nfa_lazy_dfa_flush_count(roomy) == 0);
+		assert(nfa_lazy_dfa_flush_count(tiny) > 0);
+		assert(nfa_lazy_dfa_execute(roomy, "1112") == 0);
+		assert(nfa_machine_execute_mode(machine, "1111", NFA_EXECUTION_MODE_LAZY_DFA) == 1);
+
+		// the machine keeps its lazy DFA, so running the same input again only follows cached transitions
+		nfa_exec_stats stats;
+		assert(nfa_machine_execute_stats_n(machine, (const uint8_t*)"1111", 4, NFA_EXECUTION_MODE_LAZY_DFA, &stats) == 1);
+#ifdef C_NFA_STATS_ENABLED
+		assert(stats.allocations == 0 && stats.transitions_scanned == 0);
+#endif
+
+		nfa_lazy_dfa_free(roomy);
+		nfa_lazy_dfa_free(tiny);
+		nfa_frozen_machine_free(frozen);
+		nfa_machine_free(machine);
+	}
+
+	// subset construction and minimization
+	{
+		nfa_machine* machine = regex_to_nfa("(0|(1(01*(00)*0)*1)*)*");
+		assert(nfa_to_dfa(machine, 2) == NULL);
+
+		dfa_machine* dfa = nfa_to_dfa(machine, 1000);
+		dfa_machine* minimal = dfa_minimize(dfa);
+
+		// one state per remainder mod 3 plus the dead state
+		assert(minimal->states_len == 4);
+		assert(minimal->dead_state_index != DFA_NO_DEAD_STATE);
+		assert(dfa_machine_execute(minimal, "") == 1);
+		assert(dfa_machine_execute(minimal, "1111") == 1);
+		assert(dfa_machine_execute(minimal, "111") == 0);
+		assert(dfa_machine_execute(minimal, "11a") == 0);
+
+		dfa_machine_free(minimal);
+		dfa_machine_free(dfa);
+		nfa_machine_free(machine);
+
+		for (size_t pattern_index = 0; pattern_index < TEST_PATTERNS_LEN; ++pattern_index)
+		{
+			machine = regex_to_nfa(test_patterns[pattern_index]);
+			dfa = nfa_to_dfa(machine, 1000);
+			minimal = dfa_minimize(dfa);
+			assert(minimal->states_len <= dfa->states_len);
+			assert(check_engine_agrees(dfa, test_run_dfa, machine, test_run_nfa, "abcd", 6));
+			assert(check_engine_agrees(minimal, test_run_dfa, machine, test_run_nfa, "abcd", 6));
+
+			dfa_machine_free(minimal);
+			dfa_machine_free(dfa);
+			nfa_machine_free(machine);
+		}
+	}
+
+	// optimized machines have no e-transitions, fewer transitions, and accept the same strings
+	{
+		for (size_t pattern_index = 0; pattern_index < TEST_PATTERNS_LEN; ++pattern_index)
+		{
+			nfa_machine* machine = regex_to_nfa(test_patterns[pattern_index]);
+			nfa_machine* optimized = nfa_machine_optimize(machine);
+			assert(optimized->transitions_len <= machine->transitions_len);
+			for (size_t index = 0; index < optimized->transitions_len; ++index)
+			{
+				assert(optimized->transitions[index].rule != C_NFA_EPSILON);
+			}
+			assert(check_engine_agrees(optimized, test_run_nfa, machine, test_run_nfa, "abcd", 6));
+
+			nfa_machine_free(optimized);
+			nfa_machine_free(machine);
+		}
+
+		// (a|b)* is a single state looping on both characters
+		nfa_machine* machine = regex_to_nfa("(a|b)*");
+		nfa_machine* optimized = nfa_machine_optimize(machine);
+		assert(optimized->transitions_len == 2);
+		assert(optimized->final_state_len == 1);
+		nfa_machine_free(optimized);
+		nfa_machine_free(machine);
+
+		// dead states are dropped before merging, so they don't keep a state number in the result
+		machine = nfa_machine_alloc();
+		machine->start_state_index = 0;
+		machine->final_states = malloc(sizeof(int));
+		machine->final_states[0] = 4;
+		machine->final_state_len = 1;
+		nfa_machine_add_transition(machine, 0, 1, 'a');
+		nfa_machine_add_transition(machine, 1, 4, 'd');
+		nfa_machine_add_transition(machine, 0, 2, 'b');
+		nfa_machine_add_transition(machine, 2, 3, 'c');
+		optimized = nfa_machine_optimize(machine);
+		assert(optimized->transitions_len == 2 && get_machine_max_state_index(optimized) == 2);
+		assert(nfa_machine_execute(optimized, "ad") == 1 && nfa_machine_execute(optimized, "bc") == 0);
+		nfa_machine_free(optimized);
+		nfa_machine_free(machine);
+
+		// a machine matching nothing keeps its start state
+		machine = nfa_machine_alloc();
+		machine->start_state_index = 0;
+		nfa_machine_add_transition(machine, 0, 1, 'a');
+		optimized = nfa_machine_optimize(machine);
+		assert(optimized->transitions_len == 0 && optimized->final_state_len == 0 && nfa_machine_execute(optimized, "") == 0);
+		nfa_machine_free(optimized);
+		nfa_machine_free(machine);
+
+		// every state is final here, so finality alone doesn't split them and the first round of merging must
+		machine = regex_to_nfa("(a|)(a|)(a|)");
+		optimized = nfa_machine_optimize(machine);
+		assert(check_engine_agrees(optimized, test_run_nfa, machine, test_run_nfa, "ab", 5));
+		assert(nfa_machine_execute(optimized, "aaaa") == 0);
+		nfa_machine_free(optimized);
+		nfa_machine_free(machine);
+	}
+
+	// the builder emits one transition per character and no e-transitions for concatenation
+	{
+		nfa_machine* machine = regex_to_nfa("abcd");
+		assert(machine->transitions_len == 4);
+		assert(get_machine_max_state_index(machine) == 4);
+		nfa_machine_free(machine);
+
+		size_t len = 20000;
+		char* pattern = malloc(len + 1);
+		memset(pattern, 'a', len);
+		pattern[len] = '\0';
+		machine = regex_to_nfa(pattern);
+		assert(machine->transitions_len == len);
+		assert(nfa_machine_execute(machine, pattern) == 1);
+		pattern[len - 1] = '\0';
+		assert(nfa_machine_execute(machine, pattern) == 0);
+		nfa_machine_free(machine);
+		free(pattern);
+	}
+
+	// parse errors are reported with their position instead of aborting
+	{
+		regex_t* regex;
+		size_t error_position;
+		assert(regex_try_parse("(a|b", &regex, &error_position) == REGEX_ERROR_UNMATCHED_OPEN_PAREN && regex == NULL && error_position == 0);
+		assert(regex_try_parse("ab)c", &regex, &error_position) == REGEX_ERROR_UNMATCHED_CLOSE_PAREN && error_position == 2);
+		assert(regex_try_parse("a|*", &regex, &error_position) == REGEX_ERROR_NOTHING_TO_REPEAT && error_position == 2);
+		assert(regex_try_parse("ab\\", &regex, &error_position) == REGEX_ERROR_TRAILING_ESCAPE && error_position == 2);
+		assert(regex_parse("((a)") == NULL);
+		assert(regex_to_nfa(")") == NULL);
+		assert(regex_execute("(", "") == 0);
+
+		assert(regex_try_parse("(a|\\*)*", &regex, NULL) == REGEX_OK);
+		assert(regex->type == STAR);
+		regex_free(regex);
+		assert(regex_execute("(a|\\*)*", "a**a") == 1);
+		assert(regex_execute("a||b", "") == 1);
+		assert(regex_execute("()", "") == 1);
+
+		// nesting depth doesn't grow the call stack
+		size_t depth = 100000;
+		char* pattern = malloc(2 * depth + 2);
+		memset(pattern, '(', depth);
+		pattern[depth] = 'a';
+		memset(pattern + depth + 1, ')', depth);
+		pattern[2 * depth + 1] = '\0';
+		assert(regex_execute(pattern, "a") == 1);
+		free(pattern);
+	}
+
+	// one scratch can be reused across executions and machines of different sizes
+	{
+		nfa_machine* small_machine = regex_to_nfa("(a|b)*");
+		nfa_machine* large_machine = regex_to_nfa("(0|(1(01*(00)*0)*1)*)*");
+		nfa_frozen_machine* small_frozen = nfa_machine_freeze(small_machine);
+		nfa_frozen_machine* large_frozen = nfa_machine_freeze(large_machine);
+
+		nfa_exec_scratch* scratch = nfa_exec_scratch_alloc();
+		assert(nfa_frozen_machine_execute_scratch(small_frozen, "abba", scratch) == 1);
+		assert(nfa_frozen_machine_execute_scratch(large_frozen, "1111", scratch) == 1);
+		assert(nfa_frozen_machine_execute_scratch(small_frozen, "abc", scratch) == 0);
+		assert(nfa_frozen_machine_execute_scratch(large_frozen, "111", scratch) == 0);
+		nfa_exec_scratch_free(scratch);
+
+		nfa_frozen_machine_free(small_frozen);
+		nfa_frozen_machine_free(large_frozen);
+		nfa_machine_free(small_machine);
+		nfa_machine_free(large_machine);
+	}
+
+	// every byte value can be matched, including '\0', and input doesn't need to be terminated
+	{
+		const uint8_t data[] = { 'a', 0x00, 0xff, 'b', 'c' };
+		assert(regex_execute_n("a\\x00\\xFFb", data, 4) == 1);
+		assert(regex_execute_n("a\\x00\\xFFb", data, 5) == 0);
+		assert(regex_execute_n("a\\x00\\xFFb", data, 3) == 0);
+		assert(regex_execute("a\\x62", "ab") == 1);
+		assert(regex_parse("\\x4") == NULL);
+
+		nfa_machine* machine = nfa_machine_alloc();
+		machine->start_state_index = 0;
+		machine->final_states = malloc(sizeof(int));
+		machine->final_states[0] = 2;
+		machine->final_state_len = 1;
+		nfa_machine_add_transition(machine, 0, 1, '\0');
+		nfa_machine_add_transition(machine, 1, 2, (char)0xff);
+		nfa_machine_add_transition(machine, 2, 2, C_NFA_EPSILON);
+		assert(machine->transitions[1].rule == 0xff);
+
+		const uint8_t zero_ff[] = { 0x00, 0xff };
+		assert(nfa_machine_execute_n(machine, zero_ff, 2) == 1);
+		assert(nfa_machine_execute_mode_n(machine, zero_ff, 2, NFA_EXECUTION_MODE_BACKTRACK) == 1);
+		assert(nfa_machine_execute_mode_n(machine, zero_ff, 2, NFA_EXECUTION_MODE_LAZY_DFA) == 1);
+		assert(nfa_machine_execute_n(machine, zero_ff, 1) == 0);
+
+		dfa_machine* dfa = nfa_to_dfa(machine, 100);
+		assert(dfa_machine_execute_n(dfa, zero_ff, 2) == 1);
+		assert(dfa_machine_execute_n(dfa, zero_ff + 1, 1) == 0);
+		dfa_machine_free(dfa);
+		nfa_machine_free(machine);
+	}
+
+	// streaming gives the same answer whichever way the input is split into chunks
+	{
+		nfa_machine* machine = regex_to_nfa("(0|(1(01*(00)*0)*1)*)*");
+		nfa_frozen_machine* frozen = nfa_machine_freeze(machine);
+		const uint8_t* input = (const uint8_t*)"110011001100110011"; // 208947, a multiple of 3
+		size_t len = 18;
+
+		for (size_t chunk_len = 1; chunk_len <= len; ++chunk_len)
+		{
+			nfa_stream* stream = nfa_stream_begin(frozen);
+			for (size_t offset = 0; offset < len; offset += chunk_len)
+			{
+				nfa_stream_feed(stream, input + offset, offset + chunk_len <= len ? chunk_len : len - offset);
+			}
+			assert(nfa_stream_bytes_fed(stream) == len);
+			assert(nfa_stream_end(stream) == 1);
+		}
+
+		nfa_stream* stream = nfa_stream_begin(frozen);
+		assert(nfa_stream_is_accepting(stream) == 1);
+		nfa_stream_feed(stream, (const uint8_t*)"1", 1);
+		assert(nfa_stream_is_accepting(stream) == 0);
+		assert(nfa_stream_is_dead(stream) == 0);
+		nfa_stream_feed(stream, (const uint8_t*)"2", 1);
+		assert(nfa_stream_is_dead(stream) == 1);
+		assert(nfa_stream_end(stream) == 0);
+
+		nfa_frozen_machine_free(frozen);
+		nfa_machine_free(machine);
+	}
+
+	// search finds the same leftmost-longest match as trying every substring
+	{
+		const char* patterns[] = { "a*b", "(ab|b)*a", "ba|aab", "(a|b)*", "" };
+		nfa_exec_scratch* scratch = nfa_exec_scratch_alloc();
+		for (size_t pattern_index = 0; pattern_index < sizeof(patterns) / sizeof(patterns[0]); ++pattern_index)
+		{
+			nfa_machine* machine = regex_to_nfa(patterns[pattern_index]);
+			nfa_frozen_machine* frozen = nfa_machine_freeze(machine);
+			for (int len = 0; len <= 6; ++len)
+			{
+				for (int bits = 0; bits < (1 << len); ++bits)
+				{
+					uint8_t input[6];
+					for (int i = 0; i < len; ++i)
+					{
+						input[i] = (bits >> i) & 1 ? 'b' : 'a';
+					}
+
+					int expected = 0;
+					nfa_match expected_match = { 0, 0 };
+					for (int start = 0; start <= len && !expected; ++start)
+					{
+						for (int end = len; end >= start; --end)
+						{
+							if (nfa_frozen_machine_execute_n(frozen, input + start, end - start, scratch))
+							{
+								expected = 1;
+								expected_match.start = start;
+								expected_match.end = end;
+								break;
+							}
+						}
+					}
+
+					nfa_match match;
+					assert(nfa_frozen_machine_search(frozen, input, len, &match, scratch) == expected);
+					if (expected)
+					{
+						assert(match.start == expected_match.start && match.end == expected_match.end);
+					}
+				}
+			}
+			nfa_frozen_machine_free(frozen);
+			nfa_machine_free(machine);
+		}
+
+		nfa_machine* machine = regex_to_nfa("ab*");
+		nfa_frozen_machine* frozen = nfa_machine_freeze(machine);
+		const uint8_t* input = (const uint8_t*)"xabbxaxab";
+		size_t expected_matches[][2] = { { 1, 4 }, { 5, 6 }, { 7, 9 } };
+		nfa_match_iterator iterator;
+		nfa_match match;
+		size_t count = 0;
+		nfa_match_iterator_init(&iterator, frozen, input, 9, scratch);
+		while (nfa_match_iterator_next(&iterator, &match))
+		{
+			assert(count < 3);
+			assert(match.start == expected_matches[count][0] && match.end == expected_matches[count][1]);
+			++count;
+		}
+		assert(count == 3);
+		nfa_frozen_machine_free(frozen);
+		nfa_machine_free(machine);
+
+		// empty matches still make progress, one per offset
+		machine = regex_to_nfa("a*");
+		frozen = nfa_machine_freeze(machine);
+		count = 0;
+		nfa_match_iterator_init(&iterator, frozen, (const uint8_t*)"bab", 3, scratch);
+		while (nfa_match_iterator_next(&iterator, &match))
+		{
+			++count;
+		}
+		assert(count == 4); // [0,0), [1,2), [2,2), [3,3)
+		nfa_frozen_machine_free(frozen);
+		nfa_machine_free(machine);
+		nfa_exec_scratch_free(scratch);
+	}
+
+	// a regex set reports the same matches as running every pattern on its own, across several mask words
+	{
+		char generated[130][8];
+		const char* patterns[135] = { "(a|b)*", "a*b", "(ab|b)*a", "", "b(a|b)*" };
+		for (int index = 0; index < 130; ++index)
+		{
+			// index written in binary with a and b, so every pattern is a different literal
+			int len = 0;
+			for (int value = index + 1; value > 1; value >>= 1)
+			{
+				generated[index][len++] = value & 1 ? 'b' : 'a';
+			}
+			generated[index][len] = '\0';
+			patterns[5 + index] = generated[index];
+		}
+
+		size_t error_index = 0;
+		const char* invalid[] = { "a", "(a" };
+		assert(nfa_regex_set_compile(invalid, 2, &error_index) == NULL);
+		assert(error_index == 1);
+
+		nfa_regex_set* set = nfa_regex_set_compile(patterns, 135, NULL);
+		assert(nfa_regex_set_patterns_len(set) == 135);
+		assert(nfa_regex_set_mask_words(set) == 3);
+
+		nfa_exec_scratch* scratch = nfa_exec_scratch_alloc();
+		uint64_t matched[3];
+		for (int len = 0; len <= 6; ++len)
+		{
+			for (int bits = 0; bits < (1 << len); ++bits)
+			{
+				char input[7];
+				for (int i = 0; i < len; ++i)
+				{
+					input[i] = (bits >> i) & 1 ? 'b' : 'a';
+				}
+				input[len] = '\0';
+
+				size_t matched_len = nfa_regex_set_execute(set, input, matched, scratch);
+				size_t expected_len = 0;
+				for (size_t pattern = 0; pattern < 135; ++pattern)
+				{
+					int expected = regex_execute(patterns[pattern], input);
+					expected_len += expected;
+					assert((int)((matched[pattern / 64] >> (pattern % 64)) & 1) == expected);
+				}
+				assert(matched_len == expected_len);
+			}
+		}
+
+		nfa_exec_scratch_free(scratch);
+		nfa_regex_set_free(set);
+	}
+
+	// batches give the same results whatever the number of threads and chunk size
+	{
+		nfa_machine* machine = regex_to_nfa("(0|(1(01*(00)*0)*1)*)*");
+		size_t inputs_len = 10000;
+		char* buffer = malloc(inputs_len * 16);
+		const uint8_t** inputs = malloc(inputs_len * sizeof(uint8_t*));
+		size_t* lengths = malloc(inputs_len * sizeof(size_t));
+		size_t expected_len = 0;
+		uint64_t expected[C_NFA_TEST_BATCH_WORDS(10000)];
+		memset(expected, 0, sizeof(expected));
+		for (size_t index = 0; index < inputs_len; ++index)
+		{
+			// index in binary
+			char* input = buffer + index * 16;
+			size_t len = 0;
+			for (size_t value = index; value > 0; value >>= 1)
+			{
+				input[len++] = '0' + (value & 1);
+			}
+			inputs[index] = (const uint8_t*)input;
+			lengths[index] = len;
+
+			if (nfa_machine_execute_n(machine, inputs[index], len))
+			{
+				expected[index / 64] |= (uint64_t)1 << (index % 64);
+				++expected_len;
+			}
+		}
+
+		nfa_batch_options options_list[] = { { 1, 0 }, { 4, 0 }, { 8, 1 }, { 3, 1000 }, { 0, 0 } };
+		for (size_t options_index = 0; options_index < sizeof(options_list) / sizeof(options_list[0]); ++options_index)
+		{
+			uint64_t results[C_NFA_TEST_BATCH_WORDS(10000)];
+			assert(nfa_machine_execute_batch(machine, inputs, lengths, inputs_len, results, &options_list[options_index]) == expected_len);
+			assert(memcmp(results, expected, sizeof(results)) == 0);
+		}
+
+		uint64_t results[C_NFA_TEST_BATCH_WORDS(100)];
+		assert(nfa_machine_execute_batch(machine, inputs, lengths, 100, results, NULL) == 34);
+		assert(memcmp(results, expected, sizeof(results) - sizeof(uint64_t)) == 0);
+		assert(results[1] == (expected[1] & (((uint64_t)1 << 36) - 1)));
+		assert(nfa_machine_execute_batch(machine, inputs, lengths, 0, results, NULL) == 0);
+
+		free(lengths);
+		free(inputs);
+		free(buffer);
+		nfa_machine_free(machine);
+	}
+
+	// required literals, and search with a prefilter finds the same matches as without one
+	{
+		const char* literal_patterns[] = { "error(0|1)*", "(0|1)*error", "a(bc|bd)e", "(a|b)*", "(x|y)abc(x|y)" };
+		const char* expected_literals[] = { "error", "error", "ab", "", "abc" };
+		int expected_is_prefix[] = { 1, 0, 1, 0, 0 };
+		for (size_t index = 0; index < 5; ++index)
+		{
+			regex_t* regex = regex_parse(literal_patterns[index]);
+			regex_literal literal = regex_required_literal(regex);
+			assert(literal.len == strlen(expected_literals[index]));
+			assert(memcmp(literal.bytes, expected_literals[index], literal.len) == 0);
+			assert(literal.len == 0 || literal.is_prefix == expected_is_prefix[index]);
+			regex_free(regex);
+		}
+
+		const char* patterns[] = { "error(0|1)*", "(0|1)*error", "a(bc|bd)e", "(ab|cb)*xyz", "(x|y)abc(x|y)", "ab*", "abababababababababababababababababababab" };
+		const char* alphabet = "abcdexyzor01";
+		nfa_exec_scratch* scratch = nfa_exec_scratch_alloc();
+		for (size_t pattern_index = 0; pattern_index < sizeof(patterns) / sizeof(patterns[0]); ++pattern_index)
+		{
+			nfa_frozen_machine* compiled = regex_compile(patterns[pattern_index]);
+			assert(compiled->prefilter_len > 0);
+			nfa_machine* machine = regex_to_nfa(patterns[pattern_index]);
+			nfa_frozen_machine* frozen = nfa_machine_freeze(machine);
+
+			uint32_t seed = 1;
+			uint8_t input[64];
+			for (int round = 0; round < 2000; ++round)
+			{
+				seed = seed * 1103515245 + 12345;
+				size_t len = (seed >> 16) % sizeof(input);
+				for (size_t i = 0; i < len; ++i)
+				{
+					seed = seed * 1103515245 + 12345;
+					input[i] = alphabet[(seed >> 16) % 12];
+				}
+				// plant a match now and then, otherwise most patterns would never match
+				if (round % 4 == 0 && len > 0)
+				{
+					size_t pattern_len = strlen(patterns[pattern_index]);
+					size_t offset = (seed >> 8) % len;
+					for (size_t i = 0; i < pattern_len && offset + i < len; ++i)
+					{
+						char c = patterns[pattern_index][i];
+						input[offset + i] = c == '(' || c == ')' || c == '|' || c == '*' ? 'x' : c;
+					}
+				}
+
+				nfa_match expected_match;
+				nfa_match match;
+				nfa_match_iterator expected_iterator;
+				nfa_match_iterator iterator;
+				nfa_match_iterator_init(&expected_iterator, frozen, input, len, scratch);
+				nfa_match_iterator_init(&iterator, compiled, input, len, scratch);
+				int expected;
+				do
+				{
+					expected = nfa_match_iterator_next(&expected_iterator, &expected_match);
+					assert(nfa_match_iterator_next(&iterator, &match) == expected);
+					assert(!expected || (match.start == expected_match.start && match.end == expected_match.end));
+				} while (expected);
+			}
+
+			nfa_frozen_machine_free(frozen);
+			nfa_machine_free(machine);
+			nfa_frozen_machine_free(compiled);
+		}
+		nfa_exec_scratch_free(scratch);
+		assert(regex_compile("(a") == NULL);
+	}
+
+	// bytes that no transition tells apart share a class, and tables only have a column per class
+	{
+		nfa_machine* machine = regex_to_nfa("(0|1(01*0)*1)*");
+		nfa_frozen_machine* frozen = nfa_machine_freeze(machine);
+		assert(frozen->classes_len == 4); // below '0', '0', '1', above '1'
+		assert(frozen->byte_classes['a'] == frozen->byte_classes[0xff]);
+		assert(frozen->byte_classes['0'] != frozen->byte_classes['1']);
+
+		dfa_machine* dfa = nfa_to_dfa(machine, 100);
+		dfa_machine* minimal = dfa_minimize(dfa);
+		assert(minimal->classes_len == 4);
+		assert(minimal->states_len == 4); // multiples of 3 plus the dead state
+		assert(dfa_machine_execute(minimal, "110") == 1);
+		assert(dfa_machine_execute(minimal, "11a") == 0);
+
+		nfa_lazy_dfa* lazy_dfa = nfa_lazy_dfa_alloc(frozen, C_NFA_LAZY_DFA_DEFAULT_BUDGET);
+		assert(nfa_lazy_dfa_execute(lazy_dfa, "1001") == 1);
+		assert(nfa_lazy_dfa_execute(lazy_dfa, "10a1") == 0);
+		nfa_lazy_dfa_free(lazy_dfa);
+
+		dfa_machine_free(minimal);
+		dfa_machine_free(dfa);
+		nfa_frozen_machine_free(frozen);
+		nfa_machine_free(machine);
+	}
+
+	// the position automaton agrees with the NFA, and patterns with too many characters are refused
+	{
+		const char* patterns[] = { "(0|(1(01*(00)*0)*1)*)*", "(a|b)*abb", "a(|b)*", "", "(ab|a)(ba|b)*", "((a*)*|b)*a", "a*b*(ab)*" };
+		for (size_t pattern_index = 0; pattern_index < sizeof(patterns) / sizeof(patterns[0]); ++pattern_index)
+		{
+			regex_t* regex = regex_parse(patterns[pattern_index]);
+			nfa_glushkov_machine* glushkov = regex_to_glushkov(regex);
+			nfa_machine* machine = regex_to_nfa(patterns[pattern_index]);
+			assert(check_engine_agrees(glushkov, test_run_glushkov, machine, test_run_nfa, pattern_index == 0 ? "01" : "ab", 8));
+			assert(nfa_glushkov_machine_execute(glushkov, "c") == 0);
+			nfa_machine_free(machine);
+			nfa_glushkov_machine_free(glushkov);
+			regex_free(regex);
+		}
+
+		// 63 characters fit, 64 don't
+		char long_pattern[65];
+		memset(long_pattern, 'a', 64);
+		long_pattern[63] = '\0';
+		regex_t* regex = regex_parse(long_pattern);
+		nfa_glushkov_machine* glushkov = regex_to_glushkov(regex);
+		assert(glushkov != NULL);
+		assert(nfa_glushkov_machine_execute(glushkov, long_pattern) == 1);
+		long_pattern[62] = '\0';
+		assert(nfa_glushkov_machine_execute(glushkov, long_pattern) == 0);
+		nfa_glushkov_machine_free(glushkov);
+		regex_free(regex);
+
+		long_pattern[62] = 'a';
+		long_pattern[63] = 'a';
+		long_pattern[64] = '\0';
+		regex = regex_parse(long_pattern);
+		assert(regex_to_glushkov(regex) == NULL);
+		regex_free(regex);
+		assert(regex_execute(long_pattern, long_pattern) == 1);
+	}
+
+	// regex_execute compiles each pattern once, and the cache evicts the least recently used patterns
+	{
+		regex_cache_stats stats;
+		regex_cache_clear();
+		regex_cache_set_capacity(4 * C_NFA_REGEX_CACHE_STRIPES);
+		regex_cache_get_stats(&stats);
+		assert(stats.capacity == 4 * C_NFA_REGEX_CACHE_STRIPES && stats.entries_len == 0 && stats.hits == 0);
+
+		for (int round = 0; round < 3; ++round)
+		{
+			assert(regex_execute("(a|b)*abb", "aabb") == 1);
+			assert(regex_execute("(a|b)*abb", "abba") == 0);
+			assert(regex_execute("(a", "a") == 0);
+		}
+		regex_cache_get_stats(&stats);
+		assert(stats.misses == 2 && stats.hits == 7 && stats.entries_len == 2);
+
+		// an entry that is still acquired survives being evicted
+		regex_cache_entry* entry = regex_cache_acquire("(0|1)*");
+		char pattern[16];
+		for (int index = 0; index < 100; ++index)
+		{
+			sprintf(pattern, "a*%d", index);
+			assert(regex_execute(pattern, "aaa") == 0);
+		}
+		regex_cache_get_stats(&stats);
+		assert(stats.entries_len <= 4 * C_NFA_REGEX_CACHE_STRIPES && stats.evictions > 0);
+		assert(stats.evictions == stats.misses - stats.entries_len);
+		assert(regex_cache_entry_execute_n(entry, (const uint8_t*)"0110", 4) == 1);
+		regex_cache_release(entry);
+
+		regex_cache_set_capacity(0);
+		regex_cache_get_stats(&stats);
+		assert(stats.entries_len == 0);
+		assert(regex_cache_acquire("a") == NULL);
+		assert(regex_execute("a*", "aaa") == 1);
+
+		regex_cache_set_capacity(C_NFA_REGEX_CACHE_DEFAULT_CAPACITY);
+		regex_cache_clear();
+	}
+
+	// images of compiled machines load back into machines that give the same answers
+	{
+		const char* pattern = "error(0|(1(01*(00)*0)*1)*)*";
+		nfa_frozen_machine* frozen = regex_compile(pattern);
+		nfa_machine* machine = regex_to_nfa(pattern);
+		dfa_machine* dfa = nfa_to_dfa(machine, 1000);
+
+		size_t frozen_size = nfa_frozen_machine_serialize(frozen, NULL, 0);
+		uint64_t* frozen_image = malloc(frozen_size);
+		assert(nfa_frozen_machine_serialize(frozen, frozen_image, frozen_size) == frozen_size);
+		nfa_frozen_machine* loaded = nfa_frozen_machine_load(frozen_image, frozen_size, 1);
+		assert(loaded != NULL && loaded->borrowed == 1 && loaded->prefilter_len == 5);
+
+		size_t dfa_size = dfa_machine_serialize(dfa, NULL, 0);
+		uint64_t* dfa_image = malloc(dfa_size);
+		dfa_machine_serialize(dfa, dfa_image, dfa_size);
+		dfa_machine* loaded_dfa = dfa_machine_load(dfa_image, dfa_size, 1);
+		assert(loaded_dfa != NULL);
+
+		assert(nfa_frozen_machine_save(frozen, "c_nfa_test.image") == 1);
+		nfa_image_file* file = nfa_image_file_map("c_nfa_test.image");
+		assert(file != NULL && nfa_image_file_size(file) == frozen_size);
+		nfa_frozen_machine* mapped = nfa_frozen_machine_load(nfa_image_file_data(file), nfa_image_file_size(file), 1);
+		assert(mapped != NULL);
+
+		char input[32] = "error";
+		for (size_t number = 0; number < 256; ++number)
+		{
+			size_t len = 5;
+			for (size_t value = number; value > 0; value >>= 1)
+			{
+				input[len++] = '0' + (value & 1);
+			}
+			input[len] = '\0';
+
+			int expected = nfa_frozen_machine_execute(frozen, input);
+			assert(nfa_frozen_machine_execute(loaded, input) == expected);
+			assert(nfa_frozen_machine_execute(mapped, input) == expected);
+			assert(dfa_machine_execute(loaded_dfa, input) == expected);
+		}
+		nfa_match match;
+		assert(nfa_frozen_machine_search(mapped, (const uint8_t*)"xxerror11", 9, &match, NULL) == 1);
+		assert(match.start == 2 && match.end == 9);
+
+		// damaged, truncated, or mismatched images are refused
+		((uint8_t*)frozen_image)[frozen_size - 1] ^= 1;
+		assert(nfa_frozen_machine_load(frozen_image, frozen_size, 1) == NULL);
+		assert(nfa_frozen_machine_load(frozen_image, frozen_size - 8, 0) == NULL);
+		assert(dfa_machine_load(frozen_image, frozen_size, 0) == NULL);
+		assert(nfa_frozen_machine_load(dfa_image, dfa_size, 0) == NULL);
+
+		// images with offsets, states or byte classes outside their tables are refused even without the checksum
+		assert(frozen->states_len > 1 && frozen->classes_len < 256 && dfa->classes_len < 256);
+		uint32_t* frozen_values[] = { &frozen->byte_edges[0].to_state_index, &frozen->epsilon_offsets[1] };
+		for (size_t value_index = 0; value_index < 2; ++value_index)
+		{
+			uint32_t value = *frozen_values[value_index];
+			*frozen_values[value_index] = UINT32_MAX;
+			nfa_frozen_machine_serialize(frozen, frozen_image, frozen_size);
+			assert(nfa_frozen_machine_load(frozen_image, frozen_size, 0) == NULL);
+			*frozen_values[value_index] = value;
+		}
+		uint8_t frozen_class = frozen->byte_classes['e'];
+		frozen->byte_classes['e'] = (uint8_t)frozen->classes_len;
+		nfa_frozen_machine_serialize(frozen, frozen_image, frozen_size);
+		assert(nfa_frozen_machine_load(frozen_image, frozen_size, 0) == NULL);
+		frozen->byte_classes['e'] = frozen_class;
+
+		uint32_t transition = dfa->transitions[0];
+		dfa->transitions[0] = dfa->states_len;
+		dfa_machine_serialize(dfa, dfa_image, dfa_size);
+		assert(dfa_machine_load(dfa_image, dfa_size, 0) == NULL);
+		dfa->transitions[0] = transition;
+		uint8_t dfa_class = dfa->byte_classes['e'];
+		dfa->byte_classes['e'] = (uint8_t)dfa->classes_len;
+		dfa_machine_serialize(dfa, dfa_image, dfa_size);
+		assert(dfa_machine_load(dfa_image, dfa_size, 0) == NULL);
+		dfa->byte_classes['e'] = dfa_class;
+
+		nfa_frozen_machine_free(mapped);
+		nfa_image_file_unmap(file);
+		remove("c_nfa_test.image");
+		dfa_machine_free(loaded_dfa);
+		free(dfa_image);
+		nfa_frozen_machine_free(loaded);
+		free(frozen_image);
+		dfa_machine_free(dfa);
+		nfa_machine_free(machine);
+		nfa_frozen_machine_free(frozen);
+	}
+
+	// counted repetitions keep their counters in the image, and images with counters that don't nest are refused
+	{
+		nfa_frozen_machine* frozen = regex_compile("(a{1,2}b){2,3}c");
+		assert(frozen->counters_len == 2 && frozen->counters[1].parent == 0 && frozen->states_len > frozen->graph_states_len);
+
+		size_t frozen_size = nfa_frozen_machine_serialize(frozen, NULL, 0);
+		uint64_t* frozen_image = malloc(frozen_size);
+		nfa_frozen_machine_serialize(frozen, frozen_image, frozen_size);
+		nfa_frozen_machine* loaded = nfa_frozen_machine_load(frozen_image, frozen_size, 1);
+		assert(loaded != NULL && loaded->counters_len == 2);
+		assert(check_engine_agrees(loaded, test_run_frozen, frozen, test_run_frozen, "abc", 8));
+		nfa_frozen_machine_free(loaded);
+
+		frozen->counters[1].parent = C_NFA_NO_COUNTER;
+		nfa_frozen_machine_serialize(frozen, frozen_image, frozen_size);
+		assert(nfa_frozen_machine_load(frozen_image, frozen_size, 0) == NULL);
+		frozen->counters[1].parent = 0;
+		++frozen->counters[0].passes;
+		nfa_frozen_machine_serialize(frozen, frozen_image, frozen_size);
+		assert(nfa_frozen_machine_load(frozen_image, frozen_size, 0) == NULL);
+		--frozen->counters[0].passes;
+		uint32_t graph_state_counter = frozen->graph_state_counters[1];
+		frozen->graph_state_counters[1] = graph_state_counter == 0 ? 1 : 0;
+		nfa_frozen_machine_serialize(frozen, frozen_image, frozen_size);
+		assert(nfa_frozen_machine_load(frozen_image, frozen_size, 0) == NULL);
+		frozen->graph_state_counters[1] = graph_state_counter;
+
+		free(frozen_image);
+		nfa_frozen_machine_free(frozen);
+	}
+
+	// execution counters, only collected when built with C_NFA_STATS_ENABLED
+	{
+		nfa_machine* machine = regex_to_nfa("(a*)*b");
+		size_t callbacks = 0;
+		nfa_stats_set_callback(count_stats_callback, &callbacks);
+
+		nfa_exec_stats stats;
+		assert(nfa_machine_execute_stats_n(machine, (const uint8_t*)"aaab", 4, NFA_EXECUTION_MODE_STATE_SET, &stats) == 1);
+		nfa_exec_stats backtrack_stats;
+		assert(nfa_machine_execute_stats_n(machine, (const uint8_t*)"aaaa", 4, NFA_EXECUTION_MODE_BACKTRACK, &backtrack_stats) == 0);
+		assert(nfa_machine_execute(machine, "ab") == 1);
+		nfa_exec_stats reused_stats;
+		assert(nfa_machine_execute_stats_n(machine, (const uint8_t*)"aaab", 4, NFA_EXECUTION_MODE_STATE_SET, &reused_stats) == 1);
+
+		nfa_machine_stats totals;
+		nfa_machine_get_stats(machine, &totals);
+#ifdef C_NFA_STATS_ENABLED
+		assert(stats.bytes_consumed == 4 && stats.transitions_scanned > 0 && stats.allocations > 0);
+		assert(backtrack_stats.contexts_pushed == backtrack_stats.contexts_popped && backtrack_stats.peak_stack_depth > 0);
+		assert(backtrack_stats.epsilon_expansions > 0 && backtrack_stats.set_hits > 0);
+		assert(totals.executions == 4 && callbacks == 4);
+		assert(totals.totals.bytes_consumed >= stats.bytes_consumed + backtrack_stats.bytes_consumed + 2);
+		assert(reused_stats.allocations == 0); // the compiled form and scratch built by the first execution are reused
+#else
+		assert(stats.bytes_consumed == 0 && backtrack_stats.contexts_pushed == 0);
+		assert(totals.executions == 0 && callbacks == 0);
+#endif
+
+		nfa_stats_set_callback(NULL, NULL);
+		nfa_machine_free(machine);
+	}
+
+	// resumable execution with budgets and cancellation
+	{
+		nfa_frozen_machine* frozen = regex_compile("(a|b)*abb(a|b)*");
+		char input[16];
+		for (size_t len = 0; len <= 10; ++len)
+		{
+			for (size_t bits = 0; bits < ((size_t)1 << len); ++bits)
+			{
+				for (size_t index = 0; index < len; ++index)
+				{
+					input[index] = (bits >> index) & 1 ? 'b' : 'a';
+				}
+				input[len] = '\0';
+
+				// one step per call still gets through the whole input, one byte at a time
+				nfa_exec_budget budget = { 1 /*max_steps*/, 0 /*max_bytes*/ };
+				nfa_cursor* cursor = nfa_cursor_begin(frozen, (const uint8_t*)input, len, NULL);
+				nfa_exec_status status;
+				size_t slices = 0;
+				while ((status = nfa_cursor_resume(cursor, &budget)) == NFA_IN_PROGRESS)
+				{
+					assert(nfa_cursor_position(cursor) == ++slices);
+				}
+				assert((int)status == nfa_frozen_machine_execute(frozen, input));
+				nfa_cursor_free(cursor);
+			}
+		}
+
+		size_t len = 100000;
+		uint8_t* data = malloc(len);
+		memset(data, 'a', len);
+		nfa_exec_budget budget = { 0, 1000 };
+		nfa_cursor* cursor = nfa_cursor_begin(frozen, data, len, NULL);
+		assert(nfa_cursor_resume(cursor, &budget) == NFA_IN_PROGRESS && nfa_cursor_position(cursor) == 1000);
+		assert(nfa_cursor_resume(cursor, NULL) == NFA_REJECTED && nfa_cursor_position(cursor) == len);
+		nfa_cursor_free(cursor);
+
+		volatile int cancel = 0;
+		cursor = nfa_cursor_begin(frozen, data, len, &cancel);
+		assert(nfa_cursor_resume(cursor, &budget) == NFA_IN_PROGRESS);
+		cancel = 1;
+		assert(nfa_cursor_resume(cursor, &budget) == NFA_CANCELLED && nfa_cursor_position(cursor) == 1000);
+		assert(nfa_cursor_resume(cursor, NULL) == NFA_CANCELLED);
+		nfa_cursor_free(cursor);
+
+		free(data);
+		nfa_frozen_machine_free(frozen);
+	}
+
+	// classes, '.', '+' and '?' against the same languages spelled out with '|' and '*'
+	{
+		// '\n' is only matched by the negated class
+		const char* patterns[][2] = {
+			{ "[ab]c", "(a|b)c" },
+			{ "[^a]*", "(b|c|\\x0a)*" },
+			{ "a+b?", "aa*(b|)" },
+			{ "(ab|c)+", "(ab|c)(ab|c)*" },
+			{ "(c(a)+)?", "(caa*|)" },
+			{ ".+", "(a|b|c)(a|b|c)*" },
+			{ "[a-b]+c?[]a]", "(a|b)(a|b)*(c|)(]|a)" },
+			{ "(a?)*", "a*" },
+			{ "(a*b+)?c+", "(a*bb*|)cc*" },
+			{ "[-a]?[c-]", "(-|a|)(c|-)" },
+		};
+		for (size_t pattern_index = 0; pattern_index < sizeof(patterns) / sizeof(patterns[0]); ++pattern_index)
+		{
+			assert(check_pattern_agrees(patterns[pattern_index][0], patterns[pattern_index][1], "abc\n", 6));
+		}
+
+		// a class is one range transition per run of bytes rather than a branch per byte
+		nfa_machine* machine = regex_to_nfa("[a-z0-9_]");
+		assert(machine->transitions_len == 3);
+		assert(nfa_machine_execute(machine, "q") == 1 && nfa_machine_execute(machine, "7") == 1 && nfa_machine_execute(machine, "A") == 0);
+		nfa_frozen_machine* frozen = nfa_machine_freeze(machine);
+		assert(frozen->classes_len == 7);
+		size_t image_size = nfa_frozen_machine_serialize(frozen, NULL, 0);
+		uint64_t* image = malloc(image_size);
+		nfa_frozen_machine_serialize(frozen, image, image_size);
+		nfa_frozen_machine* loaded = nfa_frozen_machine_load(image, image_size, 1);
+		assert(nfa_frozen_machine_execute(loaded, "m") == 1 && nfa_frozen_machine_execute(loaded, "-") == 0);
+		nfa_frozen_machine_free(loaded);
+		free(image);
+		nfa_frozen_machine_free(frozen);
+		nfa_machine_free(machine);
+
+		assert(regex_execute("\\x00[\\x01-\\x03]+", "\x00\x01\x03") == 0); // the input stops at the first '\0'
+		assert(regex_execute_n("\\x00[\\x01-\\x03]+", (const uint8_t*)"\x00\x01\x03", 3) == 1);
+		assert(regex_execute("[\\]\\\\]+", "]\\]") == 1);
+		assert(regex_execute(".", "\n") == 0 && regex_execute("[^\\n]", "\r") == 1);
+		assert(regex_execute("[^\\n]", "\n") == 0 && regex_execute("[^\\n]", "n") == 1);
+		assert(regex_execute("a\\tb\\r\\n", "a\tb\r\n") == 1 && regex_execute("\\t", "t") == 0);
+		assert(regex_execute("[\\t-\\r]+", "\t\n\v\f\r") == 1);
+
+		regex_t* regex;
+		size_t error_position;
+		assert(regex_try_parse("a[bc", &regex, &error_position) == REGEX_ERROR_UNMATCHED_OPEN_BRACKET && error_position == 1);
+		assert(regex_try_parse("ab[z-a]", &regex, &error_position) == REGEX_ERROR_INVALID_RANGE && error_position == 3);
+		assert(regex_try_parse("a|+", &regex, &error_position) == REGEX_ERROR_NOTHING_TO_REPEAT && error_position == 2);
+		assert(regex_try_parse("?", &regex, &error_position) == REGEX_ERROR_NOTHING_TO_REPEAT && error_position == 0);
+		assert(regex_try_parse("[\\x0g]", &regex, &error_position) == REGEX_ERROR_INVALID_ESCAPE && error_position == 1);
+		assert(regex_try_parse("[]]", &regex, NULL) == REGEX_OK && regex->type == CLASS);
+		regex_free(regex);
+	}
+
+	// counted repetition against the same languages with the copies written out
+	{
+		const char* patterns[][2] = {
+			{ "a{3}", "aaa" },
+			{ "a{2,}", "aaa*" },
+			{ "a{0,}", "a*" },
+			{ "(ab){0,2}", "(|ab|abab)" },
+			{ "[ab]{1,3}c?", "(a|b)((a|b)((a|b)|)|)(c|)" },
+			{ "(a|bc){2,3}", "(a|bc)(a|bc)((a|bc)|)" },
+			{ "(a*b){1,}", "(a*b)(a*b)*" },
+			{ "(a?){2}b", "(a|)(a|)b" },
+			{ "x{0}b", "b" },
+			{ "(a{1,2}b){2}", "(a(a|)b)(a(a|)b)" },
+			{ "(a{1,2}b){2,3}", "(a(a|)b)(a(a|)b)((a(a|)b)|)" },
+			{ "((ab|a){2}){1,2}", "((ab|a)(ab|a))((ab|a)(ab|a)|)" },
+			{ "(a*){2,}", "a*" },
+			{ "(a|){3}", "(a|)(a|)(a|)" },
+			{ "(a{2}|b){2,}c", "(aa|b)(aa|b)(aa|b)*c" },
+			{ "((a|b){1,2}c){0,2}", "(|(a|b)(a|b|)c|(a|b)(a|b|)c(a|b)(a|b|)c)" },
+			{ "a{0}b", "b" },
+		};
+		for (size_t pattern_index = 0; pattern_index < sizeof(patterns) / sizeof(patterns[0]); ++pattern_index)
+		{
+			assert(check_pattern_agrees(patterns[pattern_index][0], patterns[pattern_index][1], "abc", 7));
+		}
+
+		// a '{' that doesn't start a bound is a literal
+		assert(regex_execute("a{,2}", "a{,2}") == 1 && regex_execute("a{", "a{") == 1 && regex_execute("a{x}", "a{x}") == 1);
+		assert(regex_execute("x{0}", "") == 1 && regex_execute("a{0,0}", "a") == 0);
+
+		// the body is built once and run through a counter, so the machine doesn't grow with the bound
+		nfa_machine* machine = regex_to_nfa("a{1000}");
+		assert(machine->transitions_len == 2 && machine->counters_len == 1);
+		assert(nfa_machine_execute(machine, "a") == 0);
+		char thousand[1002];
+		memset(thousand, 'a', 1001);
+		thousand[1001] = '\0';
+		assert(nfa_machine_execute(machine, thousand) == 0);
+		thousand[1000] = '\0';
+		assert(nfa_machine_execute(machine, thousand) == 1);
+		nfa_machine_free(machine);
+
+		// (a(b){1,n}c){1,n}d by hand, with bounds whose product has more states than a machine can have
+		machine = nfa_machine_alloc();
+		nfa_machine_add_transition(machine, 0, 1, 'a');
+		nfa_machine_add_transition(machine, 1, 2, 'b');
+		nfa_machine_add_transition(machine, 3, 4, 'c');
+		nfa_machine_add_transition(machine, 5, 6, 'd');
+		machine->final_states = malloc(sizeof(int));
+		machine->final_states[0] = 6;
+		machine->final_state_len = 1;
+		nfa_counter outer = { .first_state_index = 0, .states_len = 5, .last_state_index = 4, .exit_state_index = 5, .min = 1, .max = 3 };
+		nfa_counter inner = { .first_state_index = 1, .states_len = 2, .last_state_index = 2, .exit_state_index = 3, .min = 1, .max = 3 };
+		nfa_machine_add_counter(machine, &outer);
+		nfa_machine_add_counter(machine, &inner);
+		assert(nfa_machine_execute(machine, "abcd") == 1 && nfa_machine_execute(machine, "abbcabcd") == 1);
+		machine->counters[0].max = 65536;
+		machine->counters[1].max = 65536;
+		nfa_machine_invalidate(machine);
+		assert(nfa_machine_freeze(machine) == NULL && nfa_to_dfa(machine, 1000) == NULL && nfa_machine_optimize(machine) == NULL);
+		assert(nfa_machine_execute(machine, "abcd") == 0);
+		machine->counters[0].max = (size_t)UINT32_MAX + 2;
+		machine->counters[1].max = 1;
+		nfa_machine_invalidate(machine);
+		assert(nfa_machine_freeze(machine) == NULL);
+		nfa_machine_free(machine);
+
+		regex_t* regex = regex_parse("(ab){2}c");
+		regex_literal literal = regex_required_literal(regex);
+		assert(literal.is_prefix && literal.len == 5 && memcmp(literal.bytes, "ababc", 5) == 0);
+		regex_free(regex);
+
+		// the position automaton would need positions for every pass, only the bounds an operator covers are built
+		regex = regex_parse("[ab]{2}");
+		assert(regex_to_glushkov(regex) == NULL);
+		regex_free(regex);
+		regex = regex_parse("(a|b){0,1}c{1,}d{0}");
+		nfa_glushkov_machine* glushkov = regex_to_glushkov(regex);
+		assert(glushkov != NULL && nfa_glushkov_machine_execute(glushkov, "acc") == 1 && nfa_glushkov_machine_execute(glushkov, "abc") == 0);
+		nfa_glushkov_machine_free(glushkov);
+		regex_free(regex);
+
+		size_t error_position;
+		assert(regex_try_parse("a{3,2}", &regex, &error_position) == REGEX_ERROR_INVALID_REPEAT && error_position == 1);
+		assert(regex_try_parse("a{1001}", &regex, &error_position) == REGEX_ERROR_REPEAT_TOO_LARGE && error_position == 1);
+		assert(regex_try_parse("(a{1000}){1000}", &regex, &error_position) == REGEX_ERROR_REPEAT_TOO_LARGE && error_position == 9);
+		assert(regex_try_parse("{2}", &regex, &error_position) == REGEX_ERROR_NOTHING_TO_REPEAT && error_position == 0);
+		assert(regex_try_parse("a|{1,}", &regex, &error_position) == REGEX_ERROR_NOTHING_TO_REPEAT && error_position == 2);
+	}
 }
\ No newline at end of file
@@ -0,0 +1,241 @@
+// Generates standalone C matchers from regexes at build time, e.g.
+//   cnfa_gen -o matchers.c is_multiple_of_three="(0|(1(01*(00)*0)*1)*)*"
+// emits int is_multiple_of_three(const uint8_t* data, size_t len), a minimal DFA stored in static const
+// tables that doesn't depend on the library at runtime
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <c_nfa/core.h>
+#include <c_nfa/nfa.h>
+#include <c_nfa/dfa.h>
+#include <c_nfa/regex.h>
+
+#define CNFA_GEN_DEFAULT_MAX_STATES 100000
+#define CNFA_GEN_NAME_MAX 255
+
+int cnfa_gen_is_identifier(const char* name, size_t len)
+{
+	if (len == 0 || (name[0] >= '0' && name[0] <= '9'))
+	{
+		return 0;
+	}
+	for (size_t index = 0; index < len; ++index)
+	{
+		char c = name[index];
+		if (!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_'))
+		{
+			return 0;
+		}
+	}
+	return 1;
+}
+
+// Prints the pattern so it can't end the comment it is written in
+void cnfa_gen_print_pattern(FILE* out, const char* pattern)
+{
+	for (const unsigned char* c = (const unsigned char*)pattern; *c != '\0'; ++c)
+	{
+		if (*c >= 0x20 && *c < 0x7f && *c != '\\')
+		{
+			fputc(*c, out);
+		}
+		else
+		{
+			fprintf(out, "\\x%02x", *c);
+		}
+	}
+}
+
+// Smallest unsigned type that holds every state index
+const char* cnfa_gen_state_type(uint32_t states_len)
+{
+	if (states_len <= 0x100)
+	{
+		return "uint8_t";
+	}
+	if (states_len <= 0x10000)
+	{
+		return "uint16_t";
+	}
+	return "uint32_t";
+}
+
+void cnfa_gen_emit(FILE* out, const char* name, const char* pattern, const dfa_machine* dfa)
+{
+	const char* state_type = cnfa_gen_state_type(dfa->states_len);
+
+	fprintf(out, "// ");
+	cnfa_gen_print_pattern(out, pattern);
+	fprintf(out, "\n// %u states, %u byte classes\n", dfa->states_len, dfa->classes_len);
+
+	fprintf(out, "static const uint8_t %s_classes[256] = {", name);
+	for (size_t c = 0; c < 256; ++c)
+	{
+		fprintf(out, "%s%u,", c % 32 == 0 ? "\n\t" : " ", dfa->byte_classes[c]);
+	}
+	fprintf(out, "\n};\n\n");
+
+	fprintf(out, "static const %s %s_transitions[%u][%u] = {\n", state_type, name, dfa->states_len, dfa->classes_len);
+	for (uint32_t state = 0; state < dfa->states_len; ++state)
+	{
+		fprintf(out, "\t{");
+		for (uint32_t class_index = 0; class_index < dfa->classes_len; ++class_index)
+		{
+			fprintf(out, "%s%u", class_index == 0 ? " " : ", ", dfa->transitions[(size_t)state * dfa->classes_len + class_index]);
+		}
+		fprintf(out, " },\n");
+	}
+	fprintf(out, "};\n\n");
+
+	fprintf(out, "static const uint8_t %s_final[%u] = {", name, dfa->states_len);
+	for (uint32_t state = 0; state < dfa->states_len; ++state)
+	{
+		fprintf(out, "%s%u,", state % 32 == 0 ? "\n\t" : " ", dfa->final_states[state]);
+	}
+	fprintf(out, "\n};\n\n");
+
+	fprintf(out, "int %s(const uint8_t* data, size_t len)\n{\n", name);
+	fprintf(out, "\t%s state = %u;\n", state_type, dfa->start_state_index);
+	fprintf(out, "\tfor (size_t index = 0; index < len; ++index)\n\t{\n");
+	fprintf(out, "\t\tstate = %s_transitions[state][%s_classes[data[index]]];\n", name, name);
+	if (dfa->dead_state_index != DFA_NO_DEAD_STATE)
+	{
+		fprintf(out, "\t\tif (state == %u)\n\t\t{\n\t\t\treturn 0;\n\t\t}\n", dfa->dead_state_index);
+	}
+	fprintf(out, "\t}\n\treturn %s_final[state];\n}\n\n", name);
+}
+
+int main(int argc, char** argv)
+{
+	const char* output_path = NULL;
+	size_t max_states = CNFA_GEN_DEFAULT_MAX_STATES;
+	int first_pattern = 1;
+
+	for (; first_pattern < argc && argv[first_pattern][0] == '-'; first_pattern += 2)
+	{
+		if (first_pattern + 1 >= argc)
+		{
+			fprintf(stderr, "cnfa_gen: %s needs a value\n", argv[first_pattern]);
+			return 1;
+		}
+		if (strcmp(argv[first_pattern], "-o") == 0)
+		{
+			output_path = argv[first_pattern + 1];
+		}
+		else if (strcmp(argv[first_pattern], "-m") == 0)
+		{
+			max_states = strtoul(argv[first_pattern + 1], NULL, 10);
+		}
+		else
+		{
+			fprintf(stderr, "cnfa_gen: unknown option %s\n", argv[first_pattern]);
+			return 1;
+		}
+	}
+
+	if (first_pattern >= argc)
+	{
+		fprintf(stderr, "usage: cnfa_gen [-o output.c] [-m max_states] name=pattern...\n");
+		return 1;
+	}
+
+	// compile everything before writing, so a bad pattern doesn't leave half a file behind
+	size_t patterns_len = (size_t)(argc - first_pattern);
+	dfa_machine** dfas = calloc(patterns_len, sizeof(dfa_machine*));
+	int failed = 0;
+	for (size_t index = 0; index < patterns_len && !failed; ++index)
+	{
+		const char* argument = argv[first_pattern + index];
+		const char* equals = strchr(argument, '=');
+		if (equals == NULL || !cnfa_gen_is_identifier(argument, (size_t)(equals - argument)))
+		{
+			fprintf(stderr, "cnfa_gen: expected name=pattern with name a C identifier, got %s\n", argument);
+			failed = 1;
+			break;
+		}
+		// names longer than this are refused rather than cut short when emitting
+		size_t name_len = (size_t)(equals - argument);
+		if (name_len > CNFA_GEN_NAME_MAX)
+		{
+			fprintf(stderr, "cnfa_gen: %.32s... is longer than %d characters\n", argument, CNFA_GEN_NAME_MAX);
+			failed = 1;
+			break;
+		}
+		int duplicate = 0;
+		for (size_t previous = 0; previous < index; ++previous)
+		{
+			const char* previous_argument = argv[first_pattern + previous];
+			duplicate |= strchr(previous_argument, '=') - previous_argument == (ptrdiff_t)name_len && memcmp(previous_argument, argument, name_len) == 0;
+		}
+		if (duplicate)
+		{
+			fprintf(stderr, "cnfa_gen: %.*s is defined more than once\n", (int)name_len, argument);
+			failed = 1;
+			break;
+		}
+
+		regex_t* regex;
+		size_t error_position;
+		regex_error error = regex_try_parse(equals + 1, &regex, &error_position);
+		if (error != REGEX_OK)
+		{
+			fprintf(stderr, "cnfa_gen: %.*s: %s at position %zu\n", (int)(equals - argument), argument, regex_error_string(error), error_position);
+			failed = 1;
+			break;
+		}
+		regex_free(regex);
+
+		nfa_machine* machine = regex_to_nfa(equals + 1);
+		dfa_machine* dfa = nfa_to_dfa(machine, max_states);
+		nfa_machine_free(machine);
+		if (dfa == NULL)
+		{
+			fprintf(stderr, "cnfa_gen: %.*s needs more than %zu DFA states, see -m\n", (int)(equals - argument), argument, max_states);
+			failed = 1;
+			break;
+		}
+		dfas[index] = dfa_minimize(dfa);
+		dfa_machine_free(dfa);
+	}
+
+	FILE* out = stdout;
+	if (!failed && output_path != NULL)
+	{
+		out = fopen(output_path, "w");
+		if (out == NULL)
+		{
+			fprintf(stderr, "cnfa_gen: can't open %s\n", output_path);
+			failed = 1;
+		}
+	}
+
+	if (!failed)
+	{
+		fprintf(out, "// Generated by cnfa_gen, do not edit\n\n#include <stddef.h>\n#include <stdint.h>\n\n");
+		for (size_t index = 0; index < patterns_len; ++index)
+		{
+			const char* argument = argv[first_pattern + index];
+			const char* equals = strchr(argument, '=');
+			char name[CNFA_GEN_NAME_MAX + 1];
+			snprintf(name, sizeof(name), "%.*s", (int)(equals - argument), argument);
+			cnfa_gen_emit(out, name, equals + 1, dfas[index]);
+		}
+		if (out != stdout && fclose(out) != 0)
+		{
+			failed = 1;
+		}
+	}
+
+	for (size_t index = 0; index < patterns_len; ++index)
+	{
+		if (dfas[index] != NULL)
+		{
+			dfa_machine_free(dfas[index]);
+		}
+	}
+	free(dfas);
+	return failed;
+}